@@ -0,0 +1,51 @@
+#include <board.h>
+#include <console_main.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <irq_manager.h>
+#include <procfs.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define INTERRUPTS_PROCFS_PATH  PROCFS_PATH "interrupts"
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/*
+ * console_irqstat - print the interrupt counters and latency histograms
+ *
+ * Usage: irqstat [reset]
+ *
+ * The histogram buckets are printed as <upper bound in us>:<count>.
+ */
+int console_irqstat(int argc, const char *argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+    irq_stats_reset();
+    return OK;
+  }
+
+  int fd = open(INTERRUPTS_PROCFS_PATH, O_RDONLY);
+  if (fd < 0) {
+    printf("Error %d open %s\n", fd, INTERRUPTS_PROCFS_PATH);
+    return fd;
+  }
+
+  char buffer[80];
+  int ret;
+
+  while ((ret = read(fd, buffer, sizeof(buffer) - 1)) > 0) {
+    buffer[ret] = '\0';
+    printf("%s", buffer);
+  }
+
+  close(fd);
+  return ret;
+}
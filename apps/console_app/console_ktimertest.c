@@ -0,0 +1,336 @@
+#include <board.h>
+#include <console_main.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <ktimer.h>
+#include <scheduler.h>
+#include <semaphore.h>
+#include <worker.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The first tick of the levels 1 and 2 of the ktimer wheel */
+
+#define KTIMERTEST_LEVEL1_TICKS     (64)
+#define KTIMERTEST_LEVEL2_TICKS     (4096)
+
+#define KTIMERTEST_TICKS_TO_MS(ticks)                                      \
+  ((uint32_t)(((uint64_t)(ticks) * 1000) / SCHED_TICKS_PER_SEC))
+
+/* How late a callback may run on a busy host */
+
+#define KTIMERTEST_MAX_LATE_MS      (50)
+#define KTIMERTEST_PERIOD_MS        (10)
+#define KTIMERTEST_MAX_ONESHOTS     (8)
+
+/* The wheel stays empty for KTIMERTEST_IDLE_SLEEPS sleeps of
+ * KTIMERTEST_IDLE_TICKS. The sleeps take no time on the virtual clock.
+ */
+
+#ifdef CONFIG_SIM_VIRTUAL_TIME
+  #define KTIMERTEST_IDLE_TICKS     (1u << 30)
+  #define KTIMERTEST_IDLE_SLEEPS    (3)
+#else
+  #define KTIMERTEST_IDLE_TICKS     (5 * KTIMERTEST_LEVEL1_TICKS + 11)
+  #define KTIMERTEST_IDLE_SLEEPS    (1)
+#endif
+
+#define KTIMERTEST_CHECK(cond)                                            \
+  do {                                                                    \
+    if (!(cond)) {                                                        \
+      printf("ktimertest: FAIL %s:%d %s\n", __func__, __LINE__, #cond);  \
+      g_ktimertest_failures++;                                            \
+    }                                                                     \
+  } while (0)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* A timer under test and what its callback saw */
+
+struct ktimertest_s {
+  ktimer_t timer;
+  uint32_t delay_ticks;
+  uint32_t armed_tick;
+  uint32_t fired_tick;
+  int calls;
+  int overrun[3];
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static int g_ktimertest_failures;
+
+/* Posted by the callbacks and by the blocked worker */
+
+static sem_t g_ktimertest_done;
+static sem_t g_ktimertest_release;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void ktimertest_record(struct ktimertest_s *test)
+{
+  if (test->calls < ARRAY_LEN(test->overrun)) {
+    test->overrun[test->calls] = ktimer_getoverrun(&test->timer);
+  }
+
+  test->fired_tick = sched_get_ticks();
+  test->calls++;
+}
+
+static void ktimertest_oneshot_cb(void *arg)
+{
+  ktimertest_record(arg);
+  sem_post(&g_ktimertest_done);
+}
+
+/* The first call keeps the timer task away for 3.5 periods */
+
+static void ktimertest_slow_cb(void *arg)
+{
+  struct ktimertest_s *test = arg;
+
+  ktimertest_record(test);
+
+  if (test->calls == 1) {
+    sched_sleep(SCHED_MS_TO_TICKS(KTIMERTEST_PERIOD_MS * 7 / 2));
+  }
+}
+
+/* The worker callback blocks until the test releases it */
+
+static void ktimertest_blocking_cb(void *arg)
+{
+  ktimertest_record(arg);
+  sem_wait(&g_ktimertest_release);
+}
+
+/* Arm one-shot timers together and check that each one expires once and
+ * on time.
+ */
+
+static void ktimertest_oneshots(const uint32_t *delay_ticks, int count)
+{
+  static struct ktimertest_s tests[KTIMERTEST_MAX_ONESHOTS];
+  uint32_t max_delay_ms = 0;
+
+  for (int i = 0; i < count; i++) {
+    struct ktimertest_s *test = &tests[i];
+
+    uint32_t delay_ms = KTIMERTEST_TICKS_TO_MS(delay_ticks[i]);
+
+    *test = (struct ktimertest_s) {
+      .delay_ticks = SCHED_MS_TO_TICKS(delay_ms),
+    };
+
+    if (delay_ms > max_delay_ms) {
+      max_delay_ms = delay_ms;
+    }
+
+    KTIMERTEST_CHECK(ktimer_create(&test->timer, ktimertest_oneshot_cb, test,
+                                   KTIMER_NO_WORKER) == 0);
+
+    test->armed_tick = sched_get_ticks();
+    KTIMERTEST_CHECK(ktimer_settime(&test->timer, delay_ms, 0) == 0);
+  }
+
+  for (int i = 0; i < count; i++) {
+    KTIMERTEST_CHECK(sem_timedwait(&g_ktimertest_done, max_delay_ms +
+                                   KTIMERTEST_MAX_LATE_MS * 2) == 0);
+  }
+
+  int32_t max_late = (int32_t)SCHED_MS_TO_TICKS(KTIMERTEST_MAX_LATE_MS);
+
+  for (int i = 0; i < count; i++) {
+    struct ktimertest_s *test = &tests[i];
+    int32_t late = (int32_t)(test->fired_tick - test->armed_tick -
+                             test->delay_ticks);
+
+    if (test->calls != 1 || late < 0 || late > max_late) {
+      printf("ktimertest: delay %u calls %d late %d\n",
+             (unsigned int)test->delay_ticks, test->calls, (int)late);
+    }
+
+    KTIMERTEST_CHECK(test->calls == 1);
+    KTIMERTEST_CHECK(late >= 0);
+    KTIMERTEST_CHECK(late <= max_late);
+
+    uint32_t value_ms = 1;
+    KTIMERTEST_CHECK(ktimer_gettime(&test->timer, &value_ms, NULL) == 0);
+    KTIMERTEST_CHECK(value_ms == 0);
+    KTIMERTEST_CHECK(ktimer_delete(&test->timer) == 0);
+  }
+}
+
+/* The one-shot timers on both sides of the first wheel levels expire once
+ * and on time after they were cascaded down.
+ */
+
+static void ktimertest_wheel(void)
+{
+  static const uint32_t delay_ticks[] = {
+    1,
+    KTIMERTEST_LEVEL1_TICKS - 1,
+    KTIMERTEST_LEVEL1_TICKS,
+    KTIMERTEST_LEVEL1_TICKS + 1,
+    3 * KTIMERTEST_LEVEL1_TICKS + 7,
+    KTIMERTEST_LEVEL2_TICKS - 1,
+    KTIMERTEST_LEVEL2_TICKS,
+    KTIMERTEST_LEVEL2_TICKS + 1,
+  };
+
+  ktimertest_oneshots(delay_ticks, ARRAY_LEN(delay_ticks));
+}
+
+/* The timer task does not advance an empty wheel. The timers armed after
+ * a long idle time still expire on time, on the virtual clock of the sim
+ * the idle time is longer than half of the tick range.
+ */
+
+static void ktimertest_idle(void)
+{
+  static const uint32_t delay_ticks[] = {
+    1,
+    KTIMERTEST_LEVEL1_TICKS + 1,
+    2 * KTIMERTEST_LEVEL1_TICKS + 3,
+  };
+
+  for (int i = 0; i < KTIMERTEST_IDLE_SLEEPS; i++) {
+    sched_sleep(KTIMERTEST_IDLE_TICKS);
+  }
+
+  ktimertest_oneshots(delay_ticks, ARRAY_LEN(delay_ticks));
+}
+
+/* A one-shot timer runs once. A periodic timer whose callback holds the
+ * timer task skips the missed periods and reports them as overruns.
+ */
+
+static void ktimertest_periodic(void)
+{
+  static struct ktimertest_s oneshot, periodic;
+
+  oneshot  = (struct ktimertest_s) { 0 };
+  periodic = (struct ktimertest_s) { 0 };
+
+  KTIMERTEST_CHECK(ktimer_create(&oneshot.timer, ktimertest_oneshot_cb,
+                                 &oneshot, KTIMER_NO_WORKER) == 0);
+  KTIMERTEST_CHECK(ktimer_create(&periodic.timer, ktimertest_slow_cb,
+                                 &periodic, KTIMER_NO_WORKER) == 0);
+
+  KTIMERTEST_CHECK(ktimer_settime(&oneshot.timer, KTIMERTEST_PERIOD_MS,
+                                  0) == 0);
+  KTIMERTEST_CHECK(ktimer_settime(&periodic.timer, KTIMERTEST_PERIOD_MS,
+                                  KTIMERTEST_PERIOD_MS) == 0);
+
+  uint32_t value_ms = 0, interval_ms = 0;
+  KTIMERTEST_CHECK(ktimer_gettime(&periodic.timer, &value_ms,
+                                  &interval_ms) == 0);
+  KTIMERTEST_CHECK(value_ms > 0 && value_ms <= KTIMERTEST_PERIOD_MS);
+  KTIMERTEST_CHECK(interval_ms == KTIMERTEST_PERIOD_MS);
+
+  sched_sleep(SCHED_MS_TO_TICKS(KTIMERTEST_PERIOD_MS * 10));
+
+  KTIMERTEST_CHECK(ktimer_delete(&periodic.timer) == 0);
+  KTIMERTEST_CHECK(ktimer_delete(&oneshot.timer) == 0);
+  KTIMERTEST_CHECK(sem_trywait(&g_ktimertest_done) == 0);
+
+  KTIMERTEST_CHECK(oneshot.calls == 1);
+  KTIMERTEST_CHECK(periodic.calls >= 3);
+  KTIMERTEST_CHECK(periodic.overrun[0] == 0);
+  KTIMERTEST_CHECK(periodic.overrun[1] >= 2);
+
+  /* Nothing runs after the delete */
+
+  int calls = periodic.calls;
+  sched_sleep(SCHED_MS_TO_TICKS(KTIMERTEST_PERIOD_MS * 3));
+  KTIMERTEST_CHECK(periodic.calls == calls);
+}
+
+/* An expiration that waits in a busy worker keeps the timer structure in
+ * use, ktimer_delete reports it until the worker runs it.
+ */
+
+static void ktimertest_worker(void)
+{
+  static struct ktimertest_s test;
+
+  test = (struct ktimertest_s) { 0 };
+
+  int worker_id = worker_create(SCHED_PRIORITY_MAX, "ktimertest");
+  KTIMERTEST_CHECK(worker_id >= 0);
+  if (worker_id < 0) {
+    return;
+  }
+
+  KTIMERTEST_CHECK(ktimer_create(&test.timer, ktimertest_blocking_cb, &test,
+                                 worker_id) == 0);
+  KTIMERTEST_CHECK(ktimer_settime(&test.timer, KTIMERTEST_PERIOD_MS,
+                                  KTIMERTEST_PERIOD_MS) == 0);
+
+  /* The first expiration blocks the worker, the second one waits in it and
+   * the next ones find it queued.
+   */
+
+  sched_sleep(SCHED_MS_TO_TICKS(KTIMERTEST_PERIOD_MS * 9 / 2));
+
+  KTIMERTEST_CHECK(ktimer_getoverrun(&test.timer) >= 1);
+  KTIMERTEST_CHECK(ktimer_delete(&test.timer) == -EBUSY);
+  KTIMERTEST_CHECK(test.calls == 1);
+
+  /* Release the first call and the queued one */
+
+  sem_post(&g_ktimertest_release);
+  sem_post(&g_ktimertest_release);
+
+  sched_sleep(SCHED_MS_TO_TICKS(KTIMERTEST_PERIOD_MS * 2));
+
+  KTIMERTEST_CHECK(test.calls == 2);
+  KTIMERTEST_CHECK(ktimer_delete(&test.timer) == 0);
+  KTIMERTEST_CHECK(worker_destroy(worker_id) == 0);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/*
+ * console_ktimertest - run the software timer self test
+ *
+ * Usage: ktimertest
+ *
+ * It checks the one-shot timers around the first two level boundaries of
+ * the wheel and after the wheel sat empty, the overruns of a periodic
+ * timer that falls behind and the delete of a timer whose expiration waits
+ * in a worker. It takes about 5 s at 1 kHz. The failed checks are printed
+ * and the last line is "ktimertest: PASS" or "ktimertest: FAILED <count>".
+ */
+int console_ktimertest(int argc, const char *argv[])
+{
+  g_ktimertest_failures = 0;
+
+  sem_init(&g_ktimertest_done, 0, 0);
+  sem_init(&g_ktimertest_release, 0, 0);
+
+  ktimertest_wheel();
+  ktimertest_idle();
+  ktimertest_periodic();
+  ktimertest_worker();
+
+  if (g_ktimertest_failures > 0) {
+    printf("ktimertest: FAILED %d\n", g_ktimertest_failures);
+    return -EINVAL;
+  }
+
+  printf("ktimertest: PASS\n");
+  return OK;
+}
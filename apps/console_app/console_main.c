@@ -66,6 +66,34 @@ int console_touch(int argc, const char *argv[]);
 int console_mkdir(int argc, const char *argv[]);
 #endif
 
+#ifdef CONFIG_CONSOLE_STACK
+int console_stack(int argc, const char *argv[]);
+#endif
+
+#ifdef CONFIG_CONSOLE_TOP
+int console_top(int argc, const char *argv[]);
+#endif
+
+#ifdef CONFIG_CONSOLE_TRACE
+int console_trace(int argc, const char *argv[]);
+#endif
+
+#ifdef CONFIG_CONSOLE_PROFILE
+int console_profile(int argc, const char *argv[]);
+#endif
+
+#ifdef CONFIG_CONSOLE_IRQSTAT
+int console_irqstat(int argc, const char *argv[]);
+#endif
+
+#ifdef CONFIG_CONSOLE_MQTEST
+int console_mqtest(int argc, const char *argv[]);
+#endif
+
+#ifdef CONFIG_CONSOLE_KTIMERTEST
+int console_ktimertest(int argc, const char *argv[]);
+#endif
+
 static int console_help(int argc, const char *argv[]);
 
 
@@ -199,6 +227,62 @@ static console_command_entry_t g_cmd_table[] =
   },
 #endif
 
+#ifdef CONFIG_CONSOLE_STACK
+  { .cmd_name            = "stack",
+    .cmd_function        = console_stack,
+    .stack_size          = CONFIG_CONSOLE_STACK_SIZE,
+    .cmd_help            = "Show the peak stack usage of the tasks",
+  },
+#endif
+
+#ifdef CONFIG_CONSOLE_TOP
+  { .cmd_name            = "top",
+    .cmd_function        = console_top,
+    .stack_size          = CONFIG_CONSOLE_STACK_SIZE,
+    .cmd_help            = "Show the CPU usage: top [iterations] [interval_ms]",
+  },
+#endif
+
+#ifdef CONFIG_CONSOLE_TRACE
+  { .cmd_name            = "trace",
+    .cmd_function        = console_trace,
+    .stack_size          = CONFIG_CONSOLE_STACK_SIZE,
+    .cmd_help            = "Dump the scheduler events: trace [on|off|clear]",
+  },
+#endif
+
+#ifdef CONFIG_CONSOLE_PROFILE
+  { .cmd_name            = "profile",
+    .cmd_function        = console_profile,
+    .stack_size          = CONFIG_CONSOLE_STACK_SIZE,
+    .cmd_help            = "Sample the running code: profile <seconds> [hz]",
+  },
+#endif
+
+#ifdef CONFIG_CONSOLE_IRQSTAT
+  { .cmd_name            = "irqstat",
+    .cmd_function        = console_irqstat,
+    .stack_size          = CONFIG_CONSOLE_STACK_SIZE,
+    .cmd_help            = "Show the interrupt statistics: irqstat [reset]",
+  },
+#endif
+
+#ifdef CONFIG_CONSOLE_MQTEST
+  { .cmd_name            = "mqtest",
+    .cmd_function        = console_mqtest,
+    .stack_size          = CONFIG_CONSOLE_STACK_SIZE,
+    .cmd_help            = "Run the message queue self test",
+  },
+#endif
+
+#ifdef CONFIG_CONSOLE_KTIMERTEST
+  { .cmd_name            = "ktimertest",
+    .cmd_function        = console_ktimertest,
+    .stack_size          = CONFIG_CONSOLE_STACK_SIZE,
+    .cmd_help            = "Run the software timer self test",
+  },
+#endif
+
   { .cmd_name     = "help",
     .cmd_function = console_help,
     .stack_size   = CONFIG_CONSOLE_STACK_SIZE,
@@ -228,7 +312,8 @@ static int execute_command(int argc, const char *argv[])
             g_cmd_table[j].stack_size,
             argc,
             (char **)argv,
-            g_cmd_table[j].cmd_name);
+            g_cmd_table[j].cmd_name,
+            SCHED_PRIORITY_DEFAULT);
 #else
         return g_cmd_table[j].cmd_function(argc, argv);
 #endif /* CONFIG_RUN_APPS_IN_OWN_THREAD */
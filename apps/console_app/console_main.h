@@ -7,6 +7,14 @@
 
 #define CONFIG_CMD_BUFER_LEN            (80)
 
+/* The console reads the UART input so it runs ahead of the commands that
+ * it spawns.
+ */
+
+#ifndef CONFIG_CONSOLE_PRIORITY
+  #define CONFIG_CONSOLE_PRIORITY       (SCHED_PRIORITY_DEFAULT + 1)
+#endif
+
 typedef int (* console_command)(int argc, const char *argv[]);
 
 typedef struct console_command_entry_s
@@ -0,0 +1,193 @@
+#include <board.h>
+#include <console_main.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <mqueue.h>
+#include <scheduler.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define MQTEST_MAXMSG           (6)
+#define MQTEST_MSGSIZE          (sizeof(int))
+#define MQTEST_TIMEOUT_MS       (50)
+
+#define MQTEST_CHECK(cond)                                                \
+  do {                                                                    \
+    if (!(cond)) {                                                        \
+      printf("mqtest: FAIL %s:%d %s\n", __func__, __LINE__, #cond);      \
+      g_mqtest_failures++;                                                \
+    }                                                                     \
+  } while (0)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static int g_mqtest_failures;
+
+/* Pointer aligned storage for the queue under test */
+
+static void *g_mqtest_buffer[MQ_BUFFER_SIZE(MQTEST_MAXMSG, MQTEST_MSGSIZE) /
+                             sizeof(void *)];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Send the values with the given priorities and expect them back in order */
+
+static void mqtest_order(mq_t *mq)
+{
+  static const int sent_prio[MQTEST_MAXMSG] = { 1, 5, 3, 5, 0, 7 };
+  static const int recv_value[MQTEST_MAXMSG] = { 5, 1, 3, 2, 0, 4 };
+
+  for (int i = 0; i < MQTEST_MAXMSG; i++) {
+    MQTEST_CHECK(mq_send(mq, &i, sizeof(i), sent_prio[i]) == 0);
+  }
+
+  MQTEST_CHECK(mq_getcount(mq) == MQTEST_MAXMSG);
+
+  for (int i = 0; i < MQTEST_MAXMSG; i++) {
+    unsigned int prio;
+    int value = -1;
+
+    MQTEST_CHECK(mq_receive(mq, &value, sizeof(value), &prio) ==
+                 sizeof(value));
+    MQTEST_CHECK(value == recv_value[i]);
+    MQTEST_CHECK(prio == sent_prio[recv_value[i]]);
+  }
+}
+
+/* A full queue times out the senders and an empty one the receivers */
+
+static void mqtest_timeouts(mq_t *mq)
+{
+  int value = 0;
+
+  for (int i = 0; i < MQTEST_MAXMSG; i++) {
+    MQTEST_CHECK(mq_trysend(mq, &i, sizeof(i), 0) == 0);
+  }
+
+  uint32_t start = sched_get_ticks();
+  MQTEST_CHECK(mq_timedsend(mq, &value, sizeof(value), 0,
+                            MQTEST_TIMEOUT_MS) == -ETIMEDOUT);
+  MQTEST_CHECK(sched_get_ticks() - start >=
+               SCHED_MS_TO_TICKS_FLOOR(MQTEST_TIMEOUT_MS));
+  MQTEST_CHECK(mq_trysend(mq, &value, sizeof(value), 0) == -EAGAIN);
+  MQTEST_CHECK(mq_reserve(mq, 0) == NULL);
+
+  for (int i = 0; i < MQTEST_MAXMSG; i++) {
+    MQTEST_CHECK(mq_timedreceive(mq, &value, sizeof(value), NULL, 0) ==
+                 sizeof(value));
+    MQTEST_CHECK(value == i);
+  }
+
+  start = sched_get_ticks();
+  MQTEST_CHECK(mq_timedreceive(mq, &value, sizeof(value), NULL,
+                               MQTEST_TIMEOUT_MS) == -ETIMEDOUT);
+  MQTEST_CHECK(sched_get_ticks() - start >=
+               SCHED_MS_TO_TICKS_FLOOR(MQTEST_TIMEOUT_MS));
+
+  size_t len;
+  MQTEST_CHECK(mq_acquire(mq, &len, NULL, 0) == NULL);
+}
+
+/* Build a message in place and take it without a copy */
+
+static void mqtest_zero_copy(mq_t *mq)
+{
+  int *slot = mq_reserve(mq, 0);
+  MQTEST_CHECK(slot != NULL);
+  if (slot == NULL) {
+    return;
+  }
+
+  *slot = 42;
+  MQTEST_CHECK(mq_commit(mq, slot, MQTEST_MSGSIZE + 1, 2) == -EINVAL);
+  MQTEST_CHECK(mq_commit(mq, slot, sizeof(*slot), MQ_PRIO_MAX) == -EINVAL);
+  MQTEST_CHECK(mq_commit(mq, slot, sizeof(*slot), 2) == 0);
+
+  size_t len = 0;
+  unsigned int prio = 0;
+  int *msg = mq_acquire(mq, &len, &prio, 0);
+
+  MQTEST_CHECK(msg == slot);
+  MQTEST_CHECK(len == sizeof(*slot) && prio == 2);
+  if (msg != NULL) {
+    MQTEST_CHECK(*msg == 42);
+    MQTEST_CHECK(mq_release(mq, msg) == 0);
+  }
+
+  MQTEST_CHECK(mq_getcount(mq) == 0);
+}
+
+/* The slots that do not belong to the queue are rejected */
+
+static void mqtest_foreign_slot(mq_t *mq)
+{
+  int foreign = 0;
+
+  MQTEST_CHECK(mq_commit(mq, &foreign, sizeof(foreign), 0) == -EINVAL);
+  MQTEST_CHECK(mq_release(mq, &foreign) == -EINVAL);
+
+  uint8_t *slot = mq_reserve(mq, 0);
+  MQTEST_CHECK(slot != NULL);
+  if (slot == NULL) {
+    return;
+  }
+
+  MQTEST_CHECK(mq_commit(mq, slot + 1, sizeof(foreign), 0) == -EINVAL);
+  MQTEST_CHECK(mq_release(mq, slot + 1) == -EINVAL);
+  MQTEST_CHECK(mq_release(mq, slot) == 0);
+  MQTEST_CHECK(mq_getcount(mq) == 0);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/*
+ * console_mqtest - run the message queue self test
+ *
+ * Usage: mqtest
+ *
+ * It checks the priority order and the FIFO order for the same priority,
+ * the timeouts of a full and of an empty queue and the zero-copy slots.
+ * The failed checks are printed and the last line is "mqtest: PASS" or
+ * "mqtest: FAILED <count>".
+ */
+int console_mqtest(int argc, const char *argv[])
+{
+  struct mq_attr attr = {
+    .mq_maxmsg  = MQTEST_MAXMSG,
+    .mq_msgsize = MQTEST_MSGSIZE,
+  };
+  mq_t mq;
+
+  g_mqtest_failures = 0;
+
+  int ret = mq_init(&mq, &attr, g_mqtest_buffer);
+  if (ret < 0) {
+    printf("mqtest: FAILED init %d\n", ret);
+    return ret;
+  }
+
+  mqtest_order(&mq);
+  mqtest_timeouts(&mq);
+  mqtest_zero_copy(&mq);
+  mqtest_foreign_slot(&mq);
+
+  mq_destroy(&mq);
+
+  if (g_mqtest_failures > 0) {
+    printf("mqtest: FAILED %d\n", g_mqtest_failures);
+    return -EINVAL;
+  }
+
+  printf("mqtest: PASS\n");
+  return OK;
+}
@@ -0,0 +1,81 @@
+#include <board.h>
+#include <console_main.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <profile.h>
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/*
+ * console_profile - sample the running code for a number of seconds
+ *
+ * Usage: profile <seconds> [frequency_hz]
+ *
+ * The histogram is printed one entry for each line:
+ *  "profile: base <address of profile_start>"
+ *  "profile: task <task_id> <samples> <name>"
+ *  "profile: pc <pc> <samples> <task_id>"
+ * Capture the console output and resolve the PCs to functions with
+ * tools/profile2symbols.py.
+ */
+int console_profile(int argc, const char *argv[])
+{
+  if (argc < 2 || atoi(argv[1]) <= 0) {
+    printf("Usage: profile <seconds> [frequency_hz]\n");
+    return -EINVAL;
+  }
+
+  int seconds = atoi(argv[1]);
+  int frequency = argc > 2 ? atoi(argv[2]) :
+    CONFIG_SCHEDULER_PROFILE_FREQUENCY;
+
+  int ret = profile_start(frequency > 0 ? frequency : 0);
+  if (ret < 0) {
+    printf("Invalid frequency %d\n", frequency);
+    return ret;
+  }
+
+  sleep(seconds);
+  profile_stop();
+
+  struct profile_sample_s *samples =
+    malloc(CONFIG_SCHEDULER_PROFILE_SLOTS * sizeof(struct profile_sample_s));
+  struct profile_task_s *tasks =
+    malloc(CONFIG_SCHEDULER_PROFILE_TASKS * sizeof(struct profile_task_s));
+  if (samples == NULL || tasks == NULL) {
+    free(samples);
+    free(tasks);
+    return -ENOMEM;
+  }
+
+  int num_samples = profile_snapshot(samples, CONFIG_SCHEDULER_PROFILE_SLOTS);
+  int num_tasks = profile_tasks(tasks, CONFIG_SCHEDULER_PROFILE_TASKS);
+
+  /* The base lets the host script relocate the PCs of a position
+   * independent image.
+   */
+
+  printf("profile: base %lx\n", (unsigned long)profile_start);
+  printf("profile: dropped %u\n", profile_dropped());
+
+  for (int i = 0; i < num_tasks; i++) {
+    printf("profile: task %d %u %s\n", tasks[i].task_id, tasks[i].count,
+           tasks[i].name);
+  }
+
+  for (int i = 0; i < num_samples; i++) {
+    printf("profile: pc %lx %u %d\n", (unsigned long)samples[i].pc,
+           samples[i].count, samples[i].task_id);
+  }
+
+  free(samples);
+  free(tasks);
+
+  return OK;
+}
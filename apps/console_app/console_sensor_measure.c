@@ -128,9 +128,9 @@ static int64_t get_timestamp_us(void)
   return cc;
 }
 
-static void sleep(uint32_t t_ms)
+static void sensor_sleep_ms(uint32_t t_ms)
 {
-  usleep(100 * t_ms);
+  usleep(1000 * t_ms);
 }
 
 static int8_t bus_read(uint8_t dev_addr, uint8_t reg_addr,
@@ -180,7 +180,7 @@ static int sensor_measure_bma680(void)
   }
 
 #ifdef CONFIG_LIBRARY_BSEC
-  bsec_ret = bsec_iot_init(BSEC_SAMPLE_RATE_LP, 0.0f, bus_write, bus_read, sleep,
+  bsec_ret = bsec_iot_init(BSEC_SAMPLE_RATE_LP, 0.0f, bus_write, bus_read, sensor_sleep_ms,
     state_load, config_load);
   if (bsec_ret.bme680_status) {
     printf("Error init BSEC lib %d\n", bsec_ret.bme680_status);
@@ -188,7 +188,7 @@ static int sensor_measure_bma680(void)
     return -EINVAL;
   }
 
-  bsec_iot_loop(sleep, get_timestamp_us, bsec_out_data, state_save, 10000);
+  bsec_iot_loop(sensor_sleep_ms, get_timestamp_us, bsec_out_data, state_save, 10000);
 #endif
   close(g_sensor_fd);
   return ret;
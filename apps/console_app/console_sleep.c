@@ -13,6 +13,6 @@ int console_sleep(int argc, const char *argv[])
   uint32_t milis = 0;
 
   sscanf(argv[1], "%d", &milis);
-  usleep(milis * 100);
+  usleep(milis * 1000);
   return 0;
 }
@@ -0,0 +1,42 @@
+#include <board.h>
+#include <console_main.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <procfs.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define STACKS_PROCFS_PATH      PROCFS_PATH "stacks"
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/*
+ * console_stack - print the peak stack usage of every task in bytes
+ *
+ */
+int console_stack(int argc, const char *argv[])
+{
+  int fd = open(STACKS_PROCFS_PATH, O_RDONLY);
+  if (fd < 0) {
+    printf("Error %d open %s\n", fd, STACKS_PROCFS_PATH);
+    return fd;
+  }
+
+  char buffer[80];
+  int ret;
+
+  while ((ret = read(fd, buffer, sizeof(buffer) - 1)) > 0) {
+    buffer[ret] = '\0';
+    printf("%s", buffer);
+  }
+
+  close(fd);
+  return ret;
+}
@@ -0,0 +1,183 @@
+#include <board.h>
+#include <console_main.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <procfs.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define TOP_PROCFS_PATH         PROCFS_PATH "cpu"
+
+/* The number of tasks remembered between two refreshes */
+
+#define TOP_MAX_TASKS           (32)
+
+#define TOP_DEFAULT_ITERATIONS  (5)
+#define TOP_DEFAULT_INTERVAL_MS (1000)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* The run time of a task from the previous refresh */
+
+struct top_sample_s {
+  int id;
+  int run_ms;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct top_sample_s g_top_prev[TOP_MAX_TASKS];
+static int g_top_num_prev;
+static int g_top_prev_uptime;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int top_read_snapshot(char *buf, size_t len)
+{
+  int fd = open(TOP_PROCFS_PATH, O_RDONLY);
+  if (fd < 0) {
+    return fd;
+  }
+
+  int nread = 0;
+  int ret;
+
+  while (nread < len - 1 &&
+         (ret = read(fd, buf + nread, len - 1 - nread)) > 0) {
+    nread += ret;
+  }
+
+  buf[nread] = '\0';
+  close(fd);
+
+  return nread;
+}
+
+static int top_prev_run_ms(int id)
+{
+  for (int i = 0; i < g_top_num_prev; i++) {
+    if (g_top_prev[i].id == id) {
+      return g_top_prev[i].run_ms;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * top_show - print the CPU share of every task since the previous refresh
+ *
+ */
+static void top_show(char *snapshot)
+{
+  struct top_sample_s curr[TOP_MAX_TASKS];
+  int num_curr = 0;
+  char *line_save;
+  char *field_save;
+
+  /* The first lines hold the uptime, the sleep time and the header */
+
+  char *line = strtok_r(snapshot, "\n", &line_save);
+  if (line == NULL) {
+    return;
+  }
+
+  strtok_r(line, "\t", &field_save);
+  int uptime = atoi(strtok_r(NULL, "\t", &field_save));
+
+  strtok_r(NULL, "\n", &line_save);
+  strtok_r(NULL, "\n", &line_save);
+
+  int elapsed = uptime - g_top_prev_uptime;
+  if (elapsed <= 0) {
+    elapsed = 1;
+  }
+
+  printf("\nID\tCPU\tRUN_MS\tWAIT_MS\tVCSW\tIVCSW\tTASK\n");
+
+  while ((line = strtok_r(NULL, "\n", &line_save)) != NULL) {
+    char *fields[6];
+    int i;
+
+    fields[0] = strtok_r(line, "\t", &field_save);
+    for (i = 1; i < 6 && fields[i - 1] != NULL; i++) {
+      fields[i] = strtok_r(NULL, "\t", &field_save);
+    }
+
+    if (i < 6 || fields[5] == NULL) {
+      continue;
+    }
+
+    int id     = atoi(fields[0]);
+    int run_ms = atoi(fields[1]);
+    int share  = (run_ms - top_prev_run_ms(id)) * 1000 / elapsed;
+
+    printf("%d\t%d.%d\t%s\t%s\t%s\t%s\t%s\n", id, share / 10, share % 10,
+           fields[1], fields[2], fields[3], fields[4], fields[5]);
+
+    if (num_curr < TOP_MAX_TASKS) {
+      curr[num_curr].id     = id;
+      curr[num_curr].run_ms = run_ms;
+      num_curr++;
+    }
+  }
+
+  memcpy(g_top_prev, curr, num_curr * sizeof(struct top_sample_s));
+  g_top_num_prev    = num_curr;
+  g_top_prev_uptime = uptime;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/*
+ * console_top - show the CPU usage of the tasks
+ *
+ * Usage: top [iterations] [interval_ms]
+ *
+ */
+int console_top(int argc, const char *argv[])
+{
+  int iterations  = argc > 1 ? atoi(argv[1]) : TOP_DEFAULT_ITERATIONS;
+  int interval_ms = argc > 2 ? atoi(argv[2]) : TOP_DEFAULT_INTERVAL_MS;
+  int ret = OK;
+
+  char *snapshot = malloc(CONFIG_PROCFS_BUFFER_SIZE);
+  if (snapshot == NULL) {
+    return -ENOMEM;
+  }
+
+  g_top_num_prev    = 0;
+  g_top_prev_uptime = 0;
+
+  for (int i = 0; i < iterations; i++) {
+    if (i > 0) {
+      usleep((useconds_t)interval_ms * 1000);
+    }
+
+    ret = top_read_snapshot(snapshot, CONFIG_PROCFS_BUFFER_SIZE);
+    if (ret < 0) {
+      printf("Error %d open %s\n", ret, TOP_PROCFS_PATH);
+      break;
+    }
+
+    top_show(snapshot);
+    ret = OK;
+  }
+
+  free(snapshot);
+  return ret;
+}
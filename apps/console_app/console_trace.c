@@ -0,0 +1,65 @@
+#include <board.h>
+#include <console_main.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <trace.h>
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/*
+ * console_trace - control and dump the scheduler event trace
+ *
+ * Usage: trace [on|off|clear]
+ *
+ * Without arguments it prints "trace: events <count>" and then the recorded
+ * events, one for each line:
+ * "trace: <timestamp_us> <type> <task_id> <arg8> <arg0> <arg1>" with the
+ * last two in hex. Capture the console output and convert it with
+ * tools/trace2perfetto.py.
+ */
+int console_trace(int argc, const char *argv[])
+{
+  if (argc > 1) {
+    if (strcmp(argv[1], "on") == 0) {
+      trace_enable(true);
+    } else if (strcmp(argv[1], "off") == 0) {
+      trace_enable(false);
+    } else if (strcmp(argv[1], "clear") == 0) {
+      trace_clear();
+    } else {
+      printf("Usage: trace [on|off|clear]\n");
+      return -EINVAL;
+    }
+
+    return OK;
+  }
+
+  struct trace_event_s *events =
+    malloc(CONFIG_SCHEDULER_TRACE_EVENTS * sizeof(struct trace_event_s));
+  if (events == NULL) {
+    return -ENOMEM;
+  }
+
+  /* Stop the recording, printing the events would overwrite them */
+
+  bool was_enabled = trace_enable(false);
+  int num_events = trace_snapshot(events, CONFIG_SCHEDULER_TRACE_EVENTS);
+
+  printf("trace: events %d\n", num_events);
+
+  for (int i = 0; i < num_events; i++) {
+    printf("trace: %u %d %d %d %x %x\n", events[i].timestamp_us,
+           events[i].type, events[i].task_id, events[i].arg8,
+           events[i].arg0, events[i].arg1);
+  }
+
+  trace_enable(was_enabled);
+  free(events);
+
+  return OK;
+}
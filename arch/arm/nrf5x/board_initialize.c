@@ -9,6 +9,7 @@
 #include <rtc.h>
 #include <timer.h>
 #include <scheduler.h>
+#include <string.h>
 
 
 #ifdef CONFIG_DISPLAY_SSD1331
@@ -128,6 +129,10 @@ void board_init(void)
   timer_init();
 #endif
 
+#ifdef CONFIG_NRF5X_RTC_TICK
+  rtc_tick_init();
+#endif
+
   struct spi_master_config_s spi[] = {
 #ifdef CONFIG_SPI_0
     {
@@ -238,13 +243,15 @@ void board_entersleep(void)
  */
 int cpu_inittask(tcb_t *task_tcb, int argc, char **argv)
 {
-  void **mcu_context = calloc(REG_NUMS, sizeof(void *));
-  if (mcu_context == NULL)
-  {
-    return -ENOMEM;
-  }
+  /* The initial context lives at the top of the task stack so creating a
+   * task does not need a heap allocation.
+   */
 
-  void *bottom_sp = (unsigned int)task_tcb->stack_ptr_top - 8 * sizeof(void *);
+  void **mcu_context = (void **)((unsigned int)task_tcb->stack_ptr_top & ~7) - REG_NUMS;
+  memset(mcu_context, 0, REG_NUMS * sizeof(void *));
+
+  void *bottom_sp =
+    (void *)(((unsigned int)mcu_context - 8 * sizeof(void *)) & ~7);
 
   /* Initial MCU context */
 
@@ -262,13 +269,14 @@ int cpu_inittask(tcb_t *task_tcb, int argc, char **argv)
 }
 
 /*
- * cpu_destroytask - creates the initial state for a task
+ * cpu_destroytask - releases the CPU state of a halted task
  *
  */
 void cpu_destroytask(tcb_t *tcb)
 {
-  free(tcb->mcu_context);
-  free(tcb);
+  /* The context is kept on the task stack, nothing to release */
+
+  tcb->mcu_context = NULL;
 }
 
 /*
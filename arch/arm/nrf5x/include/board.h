@@ -27,6 +27,14 @@ void board_init(void);
 
 void board_entersleep(void);
 
+#ifdef CONFIG_SCHEDULER_TICKLESS
+uint32_t board_tickless_get_ticks(void);
+
+void board_tickless_set_alarm(uint32_t tick);
+
+void board_tickless_cancel_alarm(void);
+#endif
+
 /****************************************************************************
  * Task management functions
  ****************************************************************************/
@@ -13,4 +13,6 @@ typedef struct current_time_s {
 
 void rtc_init(void);
 
+void rtc_tick_init(void);
+
 #endif /* __RTC_H */
@@ -17,7 +17,8 @@
 #define INTENSET               (0x304)
 #define INTENCLR               (0x308)
 #define CC_0                   (0x540)
-#define EVENTS_TICK            (0x100)
+#define EVENTS_OVRFLW          (0x104)
+#define COUNTER                (0x504)
 
 #define RTC_CONFIG(offset_r)                                              \
   ((*((volatile uint32_t *)(RTC_BASE + (offset_r)))))
@@ -27,12 +28,26 @@
 #define INTENSET_CFG           RTC_CONFIG(INTENSET)
 #define INTENCLR_CFG           RTC_CONFIG(INTENCLR)
 #define CC_0_CFG               RTC_CONFIG(CC_0)
-#define EVENTS_TICK_CFG        RTC_CONFIG(EVENTS_TICK)
+#define EVENTS_OVRFLW_CFG      RTC_CONFIG(EVENTS_OVRFLW)
+#define COUNTER_CFG            RTC_CONFIG(COUNTER)
+
+/* The interrupt enable bits */
+
+#define INT_OVRFLW             (1 << 1)
 
 #define PRESCALER_8_HZ         (4095)
 #define PRESCALER_1kHZ         (32)
 #define COMPARE_1_HZ           (8)
 
+/* The 24 bit counter runs at 8Hz and overflows about every 24 days */
+
+#define RTC_COUNTER_BITS       (24)
+#define RTC_COUNTER_SHIFT_SEC  (3)
+
+#define SECONDS_PER_MINUTE     (60)
+#define SECONDS_PER_HOUR       (60 * SECONDS_PER_MINUTE)
+#define SECONDS_PER_DAY        (24 * SECONDS_PER_HOUR)
+
 /****************************************************************************
  * Private Function Definitions
  ****************************************************************************/
@@ -47,14 +62,15 @@ static int rtc_ioctl(struct opened_resource_s *priv, unsigned long request, unsi
  * Private Defintions
  ****************************************************************************/
 
-/* One tick represent 125 ms - generated from 8Hz event */
+/* The time is not kept in interrupts, it is read from the counter so the
+ * RTC wakes up the CPU only on a counter overflow.
+ */
+
+static volatile uint32_t g_rtc_overflows;
 
-static volatile uint32_t g_rtc_ticks_ms;
+/* The seconds added to the counter by SET_RTC_TIME_IO */
 
-volatile uint32_t g_seconds;
-volatile uint32_t g_minutes;
-volatile uint32_t g_hours;
-volatile uint32_t g_days;
+static volatile uint64_t g_rtc_offset_sec;
 
 /* Supported RTC operation */
 
@@ -75,38 +91,42 @@ static volatile int g_opened_count = 0;
 /*
  * rtc_interrupt - RTC interrupt callback
  *
- * Initialize the RTC module from LF clock
+ * Count the counter overflows, the upper bits of the elapsed time.
  */
 static void rtc_interrupt(void)
 {
-  if (EVENTS_TICK_CFG == 1)
+  if (EVENTS_OVRFLW_CFG == 1)
   {
-    ++g_rtc_ticks_ms;
-
-    if (g_rtc_ticks_ms % 8 == 0) {
-      g_rtc_ticks_ms = 0;
+    EVENTS_OVRFLW_CFG = 0;
+    g_rtc_overflows++;
+  }
+}
 
-      g_seconds++;
+/*
+ * rtc_get_seconds - the seconds since the RTC started plus the set offset
+ *
+ * An overflow that is not handled yet because the interrupts are disabled
+ * is counted here, the counter is read again after it.
+ */
+static uint64_t rtc_get_seconds(void)
+{
+  irq_state_t irq_state = cpu_disableint();
 
-      if (g_seconds % 60 == 0) {
+  uint64_t overflows = g_rtc_overflows;
+  uint32_t counter   = COUNTER_CFG;
 
-        g_seconds = 0;
-        g_minutes++;
+  if (EVENTS_OVRFLW_CFG == 1)
+  {
+    overflows++;
+    counter = COUNTER_CFG;
+  }
 
-        if (g_minutes % 60 == 0) {
+  uint64_t seconds = g_rtc_offset_sec +
+    (((overflows << RTC_COUNTER_BITS) | counter) >> RTC_COUNTER_SHIFT_SEC);
 
-          g_minutes = 0;
-          g_hours++;
+  cpu_enableint(irq_state);
 
-          if (g_hours % 24 == 0) {
-            g_hours = 0;
-            g_days++;
-          }
-        }
-      }
-    }
-    EVENTS_TICK_CFG = 0;
-  }
+  return seconds;
 }
 
 /*
@@ -127,7 +147,7 @@ static int rtc_open(struct opened_resource_s *res, const char *pathname,
 
   if (g_opened_count == 0) {
     PRESCALER_CFG = PRESCALER_8_HZ;
-    INTENSET_CFG  = 0x01;
+    INTENSET_CFG  = INT_OVRFLW;
 
     irq_attach(RTC0_IRQn, rtc_interrupt);
     NVIC_EnableIRQ(RTC0_IRQn);
@@ -163,11 +183,13 @@ static int rtc_read(struct opened_resource_s *priv, void *buf, size_t count)
     return -EINVAL;
   }
 
+  uint64_t seconds = rtc_get_seconds();
+
   current_time_t *user_ptr = (current_time_t *)buf;
-  user_ptr->g_second  = g_seconds;
-  user_ptr->g_minute  = g_minutes;
-  user_ptr->g_hours   = g_hours;
-  user_ptr->g_days    = g_days;
+  user_ptr->g_second  = seconds % SECONDS_PER_MINUTE;
+  user_ptr->g_minute  = (seconds / SECONDS_PER_MINUTE) % 60;
+  user_ptr->g_hours   = (seconds / SECONDS_PER_HOUR) % 24;
+  user_ptr->g_days    = seconds / SECONDS_PER_DAY;
 
   return sizeof(current_time_t);
 }
@@ -180,11 +202,16 @@ static int rtc_ioctl(struct opened_resource_s *priv, unsigned long request, unsi
       {
         current_time_t *new_rtc_time = (current_time_t *)arg;
 
+        uint64_t new_seconds = new_rtc_time->g_second +
+          new_rtc_time->g_minute * SECONDS_PER_MINUTE +
+          new_rtc_time->g_hours * SECONDS_PER_HOUR;
+
+        /* Keep the elapsed days, only the time of the day is set */
+
         irq_state_t irq_state = cpu_disableint();
-        g_seconds = new_rtc_time->g_second;
-        g_minutes = new_rtc_time->g_minute;
-        g_hours   = new_rtc_time->g_hours;
-        g_rtc_ticks_ms = 0;
+        uint64_t seconds = rtc_get_seconds();
+        new_seconds += seconds - seconds % SECONDS_PER_DAY;
+        g_rtc_offset_sec += new_seconds - seconds;
         cpu_enableint(irq_state);
         return OK;
       }
@@ -0,0 +1,202 @@
+#include <board.h>
+#include <irq_manager.h>
+#include <scheduler.h>
+#include <rtc.h>
+
+#ifdef CONFIG_NRF5X_RTC_TICK
+
+/****************************************************************************
+ * Pre-Processor Definitions
+ ****************************************************************************/
+
+/* RTC0 is used by the real time clock driver so the tick comes from RTC1 */
+
+#define RTC_TICK_BASE          (0x40011000)
+
+#define TASKS_START            (0x00)
+#define PRESCALER              (0x508)
+#define INTENSET               (0x304)
+#define INTENCLR               (0x308)
+#define EVENTS_TICK            (0x100)
+#define EVENTS_OVRFLW          (0x104)
+#define EVENTS_COMPARE_0       (0x140)
+#define COUNTER                (0x504)
+#define CC_0                   (0x540)
+
+#define RTC_TICK_CONFIG(offset_r)                                         \
+  ((*((volatile uint32_t *)(RTC_TICK_BASE + (offset_r)))))
+
+#define TASKS_START_CFG        RTC_TICK_CONFIG(TASKS_START)
+#define PRESCALER_CFG          RTC_TICK_CONFIG(PRESCALER)
+#define INTENSET_CFG           RTC_TICK_CONFIG(INTENSET)
+#define INTENCLR_CFG           RTC_TICK_CONFIG(INTENCLR)
+#define EVENTS_TICK_CFG        RTC_TICK_CONFIG(EVENTS_TICK)
+#define EVENTS_OVRFLW_CFG      RTC_TICK_CONFIG(EVENTS_OVRFLW)
+#define EVENTS_COMPARE_0_CFG   RTC_TICK_CONFIG(EVENTS_COMPARE_0)
+#define COUNTER_CFG            RTC_TICK_CONFIG(COUNTER)
+#define CC_0_CFG               RTC_TICK_CONFIG(CC_0)
+
+/* The interrupt enable bits */
+
+#define INT_TICK               (1 << 0)
+#define INT_OVRFLW             (1 << 1)
+#define INT_COMPARE_0          (1 << 16)
+
+/* The LF clock frequency that feeds the RTC */
+
+#define LFCLK_FREQUENCY        (32768)
+
+/* The RTC counter has 24 bits. A compare value closer than 2 counts may
+ * not generate the event and an alarm further than half of the counter
+ * range fires early, sched_tick programs it again.
+ */
+
+#define RTC_COUNTER_BITS       (24)
+#define RTC_COUNTER_MASK       ((1u << RTC_COUNTER_BITS) - 1)
+#define RTC_MIN_DELTA          (2)
+#define RTC_MAX_DELTA          (RTC_COUNTER_MASK / 2)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+#ifdef CONFIG_NRF5X_RTC_TICKLESS
+/* The counter overflows, the upper 8 bits of the scheduler tick */
+
+static volatile uint32_t g_rtc_tick_overflows;
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+#ifdef CONFIG_NRF5X_RTC_TICKLESS
+/*
+ * rtc_tick_interrupt - RTC1 interrupt callback
+ *
+ * Count the counter overflows and run the scheduler tick when the compare
+ * event for the next deadline fires.
+ */
+static void rtc_tick_interrupt(void)
+{
+  if (EVENTS_OVRFLW_CFG == 1)
+  {
+    EVENTS_OVRFLW_CFG = 0;
+    g_rtc_tick_overflows++;
+  }
+
+  if (EVENTS_COMPARE_0_CFG == 1)
+  {
+    EVENTS_COMPARE_0_CFG = 0;
+    sched_tick();
+  }
+}
+#else
+/*
+ * rtc_tick_interrupt - RTC1 interrupt callback
+ *
+ * Advance the scheduler tick and wake up the expired sleepers.
+ */
+static void rtc_tick_interrupt(void)
+{
+  if (EVENTS_TICK_CFG == 1)
+  {
+    EVENTS_TICK_CFG = 0;
+    sched_tick();
+  }
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/*
+ * rtc_tick_init - start the scheduler tick
+ *
+ * We use the RTC because it keeps counting from the LF clock while the CPU
+ * sleeps. fRTC [Hz] = 32768 / (PRESCALER + 1)
+ */
+void rtc_tick_init(void)
+{
+  PRESCALER_CFG = LFCLK_FREQUENCY / CONFIG_SYSTEM_SCHEDULER_SLICE_FREQUENCY - 1;
+
+#ifdef CONFIG_NRF5X_RTC_TICKLESS
+  INTENSET_CFG  = INT_OVRFLW;
+#else
+  INTENSET_CFG  = INT_TICK;
+#endif
+
+  irq_attach(RTC1_IRQn, rtc_tick_interrupt);
+  NVIC_EnableIRQ(RTC1_IRQn);
+  TASKS_START_CFG = 1;
+}
+
+#ifdef CONFIG_NRF5X_RTC_TICKLESS
+/*
+ * board_tickless_get_ticks - the scheduler ticks since the RTC started
+ *
+ * An overflow that is not handled yet because the interrupts are disabled
+ * is counted here, the counter is read again after it.
+ */
+uint32_t board_tickless_get_ticks(void)
+{
+  irq_state_t irq_state = cpu_disableint();
+
+  uint32_t overflows = g_rtc_tick_overflows;
+  uint32_t counter   = COUNTER_CFG;
+
+  if (EVENTS_OVRFLW_CFG == 1)
+  {
+    overflows++;
+    counter = COUNTER_CFG;
+  }
+
+  cpu_enableint(irq_state);
+
+  return (overflows << RTC_COUNTER_BITS) | counter;
+}
+
+/*
+ * board_tickless_set_alarm - program the compare event for a tick
+ *
+ * @tick      - the absolute tick of the next deadline
+ *
+ * The scheduler already picked the latest tick that satisfies the slack
+ * of every waiting task. A tick from the past fires right away.
+ */
+void board_tickless_set_alarm(uint32_t tick)
+{
+  irq_state_t irq_state = cpu_disableint();
+
+  int32_t delta = (int32_t)(tick - board_tickless_get_ticks());
+
+  if (delta < RTC_MIN_DELTA)
+  {
+    delta = RTC_MIN_DELTA;
+  }
+  else if (delta > RTC_MAX_DELTA)
+  {
+    delta = RTC_MAX_DELTA;
+  }
+
+  CC_0_CFG             = (COUNTER_CFG + delta) & RTC_COUNTER_MASK;
+  EVENTS_COMPARE_0_CFG = 0;
+  INTENSET_CFG         = INT_COMPARE_0;
+
+  cpu_enableint(irq_state);
+}
+
+/*
+ * board_tickless_cancel_alarm - stop the compare event
+ *
+ * There is no pending deadline, only the overflows wake up the CPU.
+ */
+void board_tickless_cancel_alarm(void)
+{
+  INTENCLR_CFG         = INT_COMPARE_0;
+  EVENTS_COMPARE_0_CFG = 0;
+}
+#endif /* CONFIG_NRF5X_RTC_TICKLESS */
+
+#endif /* CONFIG_NRF5X_RTC_TICK */
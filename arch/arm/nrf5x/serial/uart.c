@@ -129,6 +129,15 @@ struct nrf52840_uart_priv_s {
   bool is_error_detected;
 
   uint32_t baud_rate;
+
+  /* EasyDMA receive: the ring bytes handed to the transfers so far, the
+   * transfers that go to rx_drop_byte because the ring was full (bit 0 for
+   * the one in progress, bit 1 for the programmed one) and the byte itself.
+   */
+
+  uint32_t rx_dma_head;
+  uint8_t rx_dma_drop;
+  uint8_t rx_drop_byte;
 };
 
 /****************************************************************************
@@ -143,6 +152,7 @@ static int nrf52840_lpuart_read(const struct uart_lower_s *lower, void *data,
                                 unsigned int max_buf_sz);
 static int nrf52840_lpuart_config(struct uart_lower_s *lower);
 static void nrf52840_lpuart_int(void);
+static void nrf52840_lpuart_dma_rx_next(struct uart_lower_s *lower);
 
 /****************************************************************************
  * Private Data
@@ -325,8 +335,9 @@ static int nrf52840_lpuart_config(struct uart_lower_s *lower)
     UART_RX_START_TASK(config->base_peripheral_ptr) = 1;
   }
   else {
-    UART_RXD_PTR_CONFIG(config->base_peripheral_ptr)   = (uint32_t)lower->rx_buffer;
-    UART_RX_MAXCNT_CONFIG(config->base_peripheral_ptr) = 1;
+    config->rx_dma_head = lower->rx_ring.head;
+    config->rx_dma_drop = 0;
+    nrf52840_lpuart_dma_rx_next(lower);
     UART_RX_START_TASK(config->base_peripheral_ptr)    = 1;
   }
 
@@ -334,6 +345,33 @@ static int nrf52840_lpuart_config(struct uart_lower_s *lower)
   return OK;
 }
 
+/*
+ * nrf52840_lpuart_dma_rx_next - program the next one byte EasyDMA transfer
+ *
+ * The RXD.PTR register is double buffered, the transfer programmed here
+ * starts when the current one ends. It takes the next free byte of the ring
+ * and when the ring has no room left the byte goes to rx_drop_byte, like
+ * ring_push_byte drops it when it returns -EAGAIN.
+ */
+static void nrf52840_lpuart_dma_rx_next(struct uart_lower_s *lower)
+{
+  struct nrf52840_uart_priv_s *uart_priv = lower->priv;
+  uint32_t reserved = uart_priv->rx_dma_head - lower->rx_ring.head;
+  uint8_t *next_ptr = &uart_priv->rx_drop_byte;
+
+  uart_priv->rx_dma_drop = (uart_priv->rx_dma_drop & 0x01) | 0x02;
+
+  if (ring_space(&lower->rx_ring) > reserved) {
+    next_ptr = lower->rx_buffer +
+      (uart_priv->rx_dma_head & (UART_RX_BUFFER - 1));
+    uart_priv->rx_dma_head++;
+    uart_priv->rx_dma_drop &= ~0x02;
+  }
+
+  UART_RXD_PTR_CONFIG(uart_priv->base_peripheral_ptr)   = (uint32_t)next_ptr;
+  UART_RX_MAXCNT_CONFIG(uart_priv->base_peripheral_ptr) = 1;
+}
+
 static void nrf52840_lpuart_int(void)
 {
   struct uart_lower_s *lower = NULL;
@@ -353,13 +391,37 @@ static void nrf52840_lpuart_int(void)
 
   struct nrf52840_uart_priv_s *uart_priv = lower->priv;
 
+  /* The end of a transfer is handled before the start of the next one so
+   * the ring bytes are published in the order they were handed out.
+   */
+
+  if (uart_priv->is_end_rx_event &&
+      UART_ENDRX_EVENT(uart_priv->base_peripheral_ptr)) {
+      UART_ENDRX_EVENT(uart_priv->base_peripheral_ptr) = 0;
+
+    uint32_t amount = UART_RX_AMOUNT_CFG(uart_priv->base_peripheral_ptr);
+
+    /* A byte that went to rx_drop_byte is lost, the ring was full */
+
+    if ((uart_priv->rx_dma_drop & 0x01) == 0 &&
+        amount <= ring_space(&lower->rx_ring)) {
+      ring_commit_write(&lower->rx_ring, amount);
+    }
+
+    UART_RX_START_TASK(uart_priv->base_peripheral_ptr)    = 1;
+
+    /* Notify that the read request from the peripheral is done */
+    sem_post(&lower->rx_notify);
+  }
+
   if (uart_priv->is_rx_started_event &&
       UART_EVENTS_RXSTARTED_CFG(uart_priv->base_peripheral_ptr) && lower->is_dma_control) {
       UART_EVENTS_RXSTARTED_CFG(uart_priv->base_peripheral_ptr) = 0;
 
-      uint8_t next_index = (lower->index_write_rx_buffer + 1) % UART_RX_BUFFER;
-      UART_RXD_PTR_CONFIG(uart_priv->base_peripheral_ptr) = (uint32_t)(lower->rx_buffer + next_index);
-      UART_RX_MAXCNT_CONFIG(uart_priv->base_peripheral_ptr) = 1;
+      /* The programmed transfer is in progress, program the one after it */
+
+      uart_priv->rx_dma_drop >>= 1;
+      nrf52840_lpuart_dma_rx_next(lower);
   }
 
   if (uart_priv->is_byte_received_event &&
@@ -367,9 +429,8 @@ static void nrf52840_lpuart_int(void)
 
     UART_EVENTS_RXDRDY_CFG(uart_priv->base_peripheral_ptr) = 0;
 
-    lower->rx_buffer[lower->index_write_rx_buffer] =
-      UART_RXD_CONFIG(uart_priv->base_peripheral_ptr);
-    lower->index_write_rx_buffer = (lower->index_write_rx_buffer + 1) % UART_RX_BUFFER;
+    ring_push_byte(&lower->rx_ring,
+                   UART_RXD_CONFIG(uart_priv->base_peripheral_ptr));
 
     /* Notify incomming RX characters */
     sem_post(&lower->rx_notify);
@@ -383,19 +444,6 @@ static void nrf52840_lpuart_int(void)
     sem_post(&lower->tx_notify);
   }
 
-  if (uart_priv->is_end_rx_event &&
-      UART_ENDRX_EVENT(uart_priv->base_peripheral_ptr)) {
-      UART_ENDRX_EVENT(uart_priv->base_peripheral_ptr) = 0;
-
-    lower->index_write_rx_buffer = (lower->index_write_rx_buffer +
-      UART_RX_AMOUNT_CFG(uart_priv->base_peripheral_ptr)) % UART_RX_BUFFER;
-
-    UART_RX_START_TASK(uart_priv->base_peripheral_ptr)    = 1;
-
-    /* Notify that the read request from the peripheral is done */
-    sem_post(&lower->rx_notify);
-  }
-
   if ((uart_priv->is_error_event ||
       uart_priv->is_timeout_event) &&
       UART_ERROR_EVENT(uart_priv->base_peripheral_ptr) ||
@@ -486,46 +534,18 @@ static int nrf52840_lpuart_write(const struct uart_lower_s *lower,
 static int nrf52840_lpuart_read(const struct uart_lower_s *lower_half, void *buf,
                                 unsigned int count)
 {
-  int ret = OK;
-  uint32_t min_copy = 0;
   int total_copy = 0;
 
   struct uart_lower_s *lower = (struct uart_lower_s *)lower_half;
-  struct nrf52840_uart_priv_s *uart_priv = lower->priv;
 
   do {
-    uint8_t available_rx_bytes = 0;
+    uint32_t num_bytes = ring_pop(&lower->rx_ring, buf + total_copy, count);
 
-    sem_wait((sem_t *)&lower->lock);
+    total_copy += num_bytes;
+    count      -= num_bytes;
 
-    if (lower->index_read_rx_buffer < lower->index_write_rx_buffer)
+    if (count > 0)
     {
-      available_rx_bytes = lower->index_write_rx_buffer -
-        lower->index_read_rx_buffer;
-    }
-    else if (lower->index_read_rx_buffer != lower->index_write_rx_buffer)
-    {
-      available_rx_bytes = UART_RX_BUFFER -
-      (lower->index_read_rx_buffer - lower->index_write_rx_buffer);
-    }
-
-    uint8_t min_copy = count > available_rx_bytes ? available_rx_bytes : count;
-    if (min_copy > 0)
-    {
-      memcpy(buf + total_copy, lower->rx_buffer + lower->index_read_rx_buffer,
-             min_copy);
-
-      total_copy += min_copy;
-      count      -= min_copy;
-
-      lower->index_read_rx_buffer += min_copy;
-      lower->index_read_rx_buffer = lower->index_read_rx_buffer % UART_RX_BUFFER;
-
-      sem_post((sem_t *)&lower->lock);
-    }
-    else
-    {
-      sem_post((sem_t *)&lower->lock);
       sem_wait(&lower->rx_notify);
     }
   } while (count > 0);
@@ -550,6 +570,8 @@ int uart_low_init(void)
 {
   if (!g_uart_low_0_priv.is_initialized) {
     sem_init(&g_uart_lowerhalfs[0].lock, 0, 1);
+    ring_init(&g_uart_lowerhalfs[0].rx_ring, g_uart_lowerhalfs[0].rx_buffer,
+              UART_RX_BUFFER);
     nrf52840_lpuart_config((struct uart_lower_s *)&g_uart_lowerhalfs[0]);
   }
 
@@ -615,6 +637,13 @@ struct uart_lower_s *uart_init(size_t *uart_num)
     sem_init(&g_uart_lowerhalfs[i].rx_notify, 0, 0);
     sem_init(&g_uart_lowerhalfs[i].lock, 0, 1);
 
+    /* The console ring is already receiving since uart_low_init */
+
+    if (g_uart_lowerhalfs[i].rx_ring.buffer == NULL) {
+      ring_init(&g_uart_lowerhalfs[i].rx_ring, g_uart_lowerhalfs[i].rx_buffer,
+                UART_RX_BUFFER);
+    }
+
     ret = uart_register(g_uart_lowerhalfs[i].dev_path, &g_uart_lowerhalfs[i]);
     if (ret < 0) {
       return NULL;
@@ -4,6 +4,7 @@
 #include <serial.h>
 #include <stdint.h>
 #include <scheduler.h>
+#include <string.h>
 #include <os_start.h>
 
 /****************************************************************************
@@ -47,14 +48,15 @@ void board_init(void)
  */
 int cpu_inittask(struct tcb_s *tcb, int argc, char **argv)
 {
-  void **mcu_context = calloc(REG_NUMS, sizeof(void *));
-  if (mcu_context == NULL)
-  {
-    return -ENOMEM;
-  }
+  /* The initial context lives at the top of the task stack so creating a
+   * task does not need a heap allocation.
+   */
+
+  void **mcu_context = (void **)((unsigned int)tcb->stack_ptr_top & ~7) - REG_NUMS;
+  memset(mcu_context, 0, REG_NUMS * sizeof(void *));
 
   void *bottom_sp =
-    (void *)((unsigned int)tcb->stack_ptr_top - 8 * sizeof(void *));
+    (void *)(((unsigned int)mcu_context - 8 * sizeof(void *)) & ~7);
 
   /* Initial MCU context */
 
@@ -70,13 +72,14 @@ int cpu_inittask(struct tcb_s *tcb, int argc, char **argv)
 }
 
 /*
- * cpu_destroytask - creates the initial state for a task
+ * cpu_destroytask - releases the CPU state of a halted task
  *
  */
 void cpu_destroytask(tcb_t *tcb)
 {
-  free(tcb->mcu_context);
-  free(tcb);
+  /* The context is kept on the task stack, nothing to release */
+
+  tcb->mcu_context = NULL;
 }
 
 /*
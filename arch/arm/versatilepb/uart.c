@@ -101,8 +101,7 @@ static void versatilepb_lpuart_int(void)
 {
   struct uart_lower_s *lower = &g_uart_lowerhalfs[0];
 
-  lower->rx_buffer[lower->index_write_rx_buffer] = uart0->DR;
-  lower->index_write_rx_buffer = (lower->index_write_rx_buffer + 1) % UART_RX_BUFFER;
+  ring_push_byte(&lower->rx_ring, uart0->DR);
 
   /* Notify incomming RX characters */
   sem_post(&lower->rx_notify);
@@ -153,38 +152,13 @@ static int versatilepb_lpuart_read(const struct uart_lower_s *lower_half,
   struct uart_lower_s *lower = (struct uart_lower_s *)lower_half;
 
   do {
-    uint8_t available_rx_bytes = 0;
+    uint32_t num_bytes = ring_pop(&lower->rx_ring, buf + total_copy, count);
 
-    sem_wait((sem_t *)&lower->lock);
+    total_copy += num_bytes;
+    count      -= num_bytes;
 
-    if (lower->index_read_rx_buffer < lower->index_write_rx_buffer)
+    if (count > 0)
     {
-      available_rx_bytes = lower->index_write_rx_buffer -
-        lower->index_read_rx_buffer;
-    }
-    else if (lower->index_read_rx_buffer != lower->index_write_rx_buffer)
-    {
-      available_rx_bytes = UART_RX_BUFFER -
-      (lower->index_read_rx_buffer - lower->index_write_rx_buffer);
-    }
-
-    uint8_t min_copy = count > available_rx_bytes ? available_rx_bytes : count;
-    if (min_copy > 0)
-    {
-      memcpy(buf + total_copy, lower->rx_buffer + lower->index_read_rx_buffer,
-             min_copy);
-
-      total_copy += min_copy;
-      count      -= min_copy;
-
-      lower->index_read_rx_buffer += min_copy;
-      lower->index_read_rx_buffer = lower->index_read_rx_buffer % UART_RX_BUFFER;
-
-      sem_post((sem_t *)&lower->lock);
-    }
-    else
-    {
-      sem_post((sem_t *)&lower->lock);
       sem_wait(&lower->rx_notify);
     }
   } while (count > 0);
@@ -271,6 +245,8 @@ struct uart_lower_s *uart_init(size_t *uart_num)
     sem_init(&g_uart_lowerhalfs[i].tx_notify, 0, 0);
     sem_init(&g_uart_lowerhalfs[i].rx_notify, 0, 0);
     sem_init(&g_uart_lowerhalfs[i].lock, 0, 1);
+    ring_init(&g_uart_lowerhalfs[i].rx_ring, g_uart_lowerhalfs[i].rx_buffer,
+              UART_RX_BUFFER);
 
     ret = uart_register(g_uart_lowerhalfs[i].dev_path, &g_uart_lowerhalfs[i]);
     if (ret < 0) {
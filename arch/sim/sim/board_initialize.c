@@ -15,6 +15,9 @@
 #include <stdint.h>
 #include <string.h>
 #include <os_start.h>
+#ifdef CONFIG_SCHEDULER_PROFILE
+  #include <profile.h>
+#endif
 #include <rtc.h>
 
 /****************************************************************************
@@ -71,13 +74,30 @@ typedef struct sim_mcu_arguments_s
 
 static volatile int g_simulated_int_num;
 
+/* Save the interrupted PC from the host signal handler */
+
+static volatile uintptr_t g_simulated_int_pc;
+
+/* Save when the host raised the simulated interrupt, if it is known */
+
+static volatile uint32_t g_simulated_int_raised_us;
+static volatile int g_simulated_int_has_raised;
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
 
 /* This function starts to simulate systick events using a host timer */
 
-void host_simulated_systick(void);
+void host_simulated_systick(int period_us);
+
+/* This function prepares the one-shot host timer for the tickless mode */
+
+void host_tickless_init(int period_us);
+
+/* This function arms the host timer that raises the profiling interrupt */
+
+void host_profile_timer(int period_us);
 
 /****************************************************************************
  * Private Functions
@@ -85,8 +105,15 @@ void host_simulated_systick(void);
 
 static void systick_interrupt(void)
 {
-  sched_run();
+  sched_tick();
+}
+
+#ifdef CONFIG_SCHEDULER_PROFILE
+static void profile_interrupt(void)
+{
+  profile_sample(g_simulated_int_pc);
 }
+#endif
 
 /****************************************************************************
  * Public Functions
@@ -126,8 +153,36 @@ void board_init(void)
 
   /* Start the SysTick simulation using the host timer */
 
+#ifdef CONFIG_SIM_SYSTICK
   irq_attach(SYSTICK_IRQ, systick_interrupt);
-//  host_simulated_systick();
+#ifdef CONFIG_SIM_TICKLESS
+  host_tickless_init(1000000 / CONFIG_SYSTEM_SCHEDULER_SLICE_FREQUENCY);
+#else
+  host_simulated_systick(1000000 / CONFIG_SYSTEM_SCHEDULER_SLICE_FREQUENCY);
+#endif
+#endif
+
+#ifdef CONFIG_SCHEDULER_PROFILE
+  irq_attach(PROFILE_IRQ, profile_interrupt);
+#endif
+}
+
+/****************************************************************************
+ * Name: host_sim_virtual_time
+ *
+ * Description:
+ *   Tell the host whether the OS clock runs on the virtual time, it is
+ *   asked before the OS starts.
+ *
+ ****************************************************************************/
+
+int host_sim_virtual_time(void)
+{
+#ifdef CONFIG_SIM_VIRTUAL_TIME
+  return 1;
+#else
+  return 0;
+#endif
 }
 
 /****************************************************************************
@@ -145,6 +200,78 @@ void host_set_simualted_intnum(int int_num)
   g_simulated_int_num = int_num;
 }
 
+/****************************************************************************
+ * Name: host_set_simulated_intpc
+ *
+ * Description:
+ *   This sets the PC where the host signal interrupted the OS, a real board
+ *   would read it from the exception frame.
+ *
+ ****************************************************************************/
+
+void host_set_simulated_intpc(uintptr_t pc)
+{
+  g_simulated_int_pc = pc;
+}
+
+/****************************************************************************
+ * Name: host_set_simulated_intraised
+ *
+ * Description:
+ *   This sets the host monotonic time when the simulated interrupt was
+ *   raised: the expiry of the host timer or the moment the interrupt
+ *   thread sent the signal. has_raised is 0 when the host doesn't know it.
+ *
+ ****************************************************************************/
+
+void host_set_simulated_intraised(uint32_t raised_us, int has_raised)
+{
+  g_simulated_int_raised_us  = raised_us;
+  g_simulated_int_has_raised = has_raised;
+}
+
+#ifdef CONFIG_BOARD_IRQ_TIMESTAMP
+/****************************************************************************
+ * Name: board_irq_get_raised_us
+ *
+ * Description:
+ *   Get the board_clock_get_us time when the current interrupt was raised,
+ *   the difference to the handler entry is the host signal delivery
+ *   latency.
+ *
+ * Return Value:
+ *   OK or -ENODATA when the raise time is not known.
+ *
+ ****************************************************************************/
+
+int board_irq_get_raised_us(uint32_t *raised_us)
+{
+  if (!g_simulated_int_has_raised)
+  {
+    return -ENODATA;
+  }
+
+  *raised_us = g_simulated_int_raised_us;
+  return OK;
+}
+#endif
+
+#ifdef CONFIG_BOARD_PROFILE_TIMER
+/****************************************************************************
+ * Name: board_profile_timer
+ *
+ * Description:
+ *   Raise the profiling interrupt frequency times per second of CPU time
+ *   consumed by the simulation, 0 stops it.
+ *
+ ****************************************************************************/
+
+void board_profile_timer(unsigned int frequency)
+{
+  host_profile_timer(frequency > 0 ? 1000000 / frequency : 0);
+}
+#endif
+
 /****************************************************************************
  * Name: task_entry_point
  *
@@ -177,7 +304,8 @@ void task_entry_point(void)
  * Input Parameters:
  *   tcb  - the task control block
  *   argc - number of arguments for the entry point
- *   argv - arguments buffer for the entry point
+ *   argv - arguments buffer for the entry point, an opaque pointer that is
+ *          passed unchanged when argc is 0
  *
  * Return Value:
  *   On success returns 0 otherwise a negative error code.
@@ -185,34 +313,71 @@ void task_entry_point(void)
  ****************************************************************************/
 
 int cpu_inittask(struct tcb_s *tcb, int argv, char **argc)
-{ 
-  /* Let's create a frame on the stack in the similar way cpu_savecontext
-   * will do.
+{
+  /* The context, the arguments descriptor and the copy of the arguments
+   * are kept at the top of the task stack so creating a task does not need
+   * any heap allocation. Compute the room they need first.
    */
 
-  void **mcu_context = calloc(CONTEXT_SIZE, sizeof(void *));
+  size_t args_size = sizeof(void *) * CONTEXT_SIZE +
+                     sizeof(sim_mcu_arguments_t) +
+                     sizeof(char *) * (argv + 1);
 
-  /* Make sure the address is aligned to 8 */
+  for (int i = 0; i < argv; i++)
+  {
+    args_size += strlen(argc[i]) + 1;
+  }
 
-  mcu_context[REG_PC] = task_entry_point;
-  mcu_context[REG_BP] = ALIGN_STACK_DOWN(tcb->stack_ptr_top);
-  mcu_context[REG_SP] = ALIGN_STACK_DOWN(tcb->stack_ptr_top);
+  if (args_size >= (size_t)(tcb->stack_ptr_top - tcb->stack_ptr_base) / 2)
+  {
+    return -ENOMEM;
+  }
 
-  /* Allocate memory to keep the arguments */
+  void **mcu_context = ALIGN_STACK_DOWN(tcb->stack_ptr_top - args_size);
+  sim_mcu_arguments_t *args = (sim_mcu_arguments_t *)(mcu_context +
+                                                      CONTEXT_SIZE);
 
-  sim_mcu_arguments_t *args = calloc(1, sizeof(sim_mcu_arguments_t));
+  memset(mcu_context, 0, sizeof(void *) * CONTEXT_SIZE);
 
   /* Copy the arguments */
 
   args->argv = argv;
-  args->argc = calloc(argv + 1, sizeof(char *));
+  args->argc = (char **)(args + 1);
 
+  char *arg_str = (char *)(args->argc + argv + 1);
   for (int i = 0; i < argv; i++)
   {
-    args->argc[i] = calloc(strlen(argc[i]) + 1, sizeof(char));
-    memcpy(args->argc[i], argc[i], strlen(argc[i]));
+    size_t len = strlen(argc[i]) + 1;
+    memcpy(arg_str, argc[i], len);
+    args->argc[i] = arg_str;
+    arg_str += len;
+  }
+
+  args->argc[argv] = NULL;
+
+  /* Without arguments the pointer is handed over as it is, like the ARM
+   * ports do, so a task can receive the address of its private state.
+   */
+
+  if (argv == 0)
+  {
+    args->argc = argc;
   }
 
+  /* Let's create a frame on the stack in the similar way cpu_savecontext
+   * will do. The frame starts below the area that holds the arguments.
+   */
+
+  mcu_context[REG_PC] = task_entry_point;
+  mcu_context[REG_BP] = mcu_context;
+
+  /* We jump in the entry point so leave room for the return address that a
+   * call would have pushed. The ABI expects RSP + 8 to be 16 byte aligned on
+   * function entry and the host library code relies on it.
+   */
+
+  mcu_context[REG_SP] = (void *)mcu_context - sizeof(void *);
+
   mcu_context[CONTEXT_ARGS] = args;
   tcb->mcu_context = (void *)mcu_context;
   return 0;
@@ -224,33 +389,17 @@ int cpu_inittask(struct tcb_s *tcb, int argv, char **argc)
  * Description:
  *   This function destroys the task context and its associated resources.
  *   It is called from the Idle task when the Idle task detects that we
- *   have pending tasks that need to be destroyed.
+ *   have pending tasks that need to be destroyed. The context and the
+ *   arguments live on the task stack which is owned by the scheduler.
  *
  * Input Parameters:
  *   tcb  - the task control block
  *
- * Return Value:
- *   On success returns 0 otherwise a negative error code.
- *
  ****************************************************************************/
 
 void cpu_destroytask(struct tcb_s *tcb)
 {
-  void **mcu_context = tcb->mcu_context;
-  sim_mcu_arguments_t *args = mcu_context[CONTEXT_ARGS];
-
-  /* Release the memory allocated for the arguments */
-
-  for (int i = 0; i < args->argv; i++)
-  {
-    free(args->argc[i]);
-  }
-
-  free(tcb->mcu_context);
-
-  free(args->argc);
-  free(args);
-  free(tcb);
+  tcb->mcu_context = NULL;
 }
 
 /****************************************************************************
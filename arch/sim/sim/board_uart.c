@@ -8,6 +8,8 @@
 #include <semaphore.h>
 #include <serial.h>
 #include <errno.h>
+#include <scheduler.h>
+#include <worker.h>
 
 /****************************************************************************
  * Private Function Prototypes
@@ -22,6 +24,7 @@ static int sim_lpuart_read(const struct uart_lower_s *lower, void *data,
                            unsigned int max_buf_sz);
 
 static void sim_lpuart_int(void);
+static void sim_lpuart_rx_work(void *arg);
 
 /****************************************************************************
  * Public Data
@@ -37,9 +40,16 @@ sim_uart_peripheral_t g_uart_peripheral;
 
 static sem_t g_console_sema;
 
+/* The interrupt hands the received characters to this worker, the RX FIFO
+ * is drained in task context.
+ */
+
+static int g_uart_rx_worker = -1;
+static worker_cb_t g_uart_rx_work;
+
 /* Uart 0 lower half operations. There is no need to provide a read_cb function
  * because we notify the incmming data through rx_notify semaphore and we
- * copy it in the rx_buffer from interrupt.
+ * copy it in the rx_buffer from the interrupt bottom half.
  */
 
 static struct uart_lower_s g_uart_lowerhalfs[] =
@@ -70,6 +80,11 @@ static struct uart_lower_s g_uart_lowerhalfs[] =
  */
 
 void host_console_putc(int c);
+void host_console_write(const void *buffer, size_t len);
+
+/* Ask the host I/O loop for more input once the FIFO has room */
+
+void host_uart_rx_resume(void);
 
 /****************************************************************************
  * Private Functions
@@ -94,6 +109,7 @@ static int sim_lpuart_open(const struct uart_lower_s *lower)
 {
   irq_attach(UART_0_IRQ, sim_lpuart_int);
   g_uart_peripheral.is_peripheral_ready = 1;
+  host_uart_rx_resume();
   return OK;
 }
 
@@ -117,8 +133,7 @@ static int sim_lpuart_write(const struct uart_lower_s *lower,
                             const void *ptr_data,
                             unsigned int sz)
 {
-  for (int i = 0; i < sz; i++)
-   host_console_putc((int)*((uint8_t *)ptr_data + i)); 
+  host_console_write(ptr_data, sz);
   return OK;
 }
 
@@ -145,47 +160,84 @@ static int sim_lpuart_read(const struct uart_lower_s *lower, void *data,
 }
 
 /****************************************************************************
- * Name: sim_lpuart_int
+ * Name: sim_lpuart_rx_work
  *
  * Description:
- *   This function is invoked when we receive events from the simulated 
- *   interrupt peripheral. It acts as an interrupt handler..
- * 
+ *   The bottom half of the UART interrupt. It moves the characters from the
+ *   simulated RX FIFO to the RX ring of the lower half and notifies the
+ *   reader.
+ *
  ****************************************************************************/
 
-static void sim_lpuart_int(void)
+static void sim_lpuart_rx_work(void *arg)
 {
-  struct uart_lower_s *lower = &g_uart_lowerhalfs[0];
+  struct uart_lower_s *lower = arg;
+  uint16_t read_index = g_uart_peripheral.uart_reg_read_index;
+  uint16_t write_index = __atomic_load_n(&g_uart_peripheral.uart_reg_write_index,
+                                         __ATOMIC_ACQUIRE);
+
+  /* One pass covers everything the host I/O loop stored since the last
+   * one, it may already have been drained. What does not fit in the RX
+   * ring stays in the FIFO and the loop raises the interrupt again when
+   * the line goes idle.
+   */
+
+  if (read_index == write_index) {
+    return;
+  }
 
-  int available_bytes;
+  while (read_index != write_index) {
+    if (ring_push_byte(&lower->rx_ring,
+                       g_uart_peripheral.sim_uart_data_fifo[read_index]) < 0) {
+      break;
+    }
 
-  if (g_uart_peripheral.uart_reg_read_index < g_uart_peripheral.uart_reg_write_index) {
-    available_bytes = g_uart_peripheral.uart_reg_write_index - g_uart_peripheral.uart_reg_read_index;
-  } else {
-    available_bytes = CONFIG_SIM_LPUART_FIFO_SIZE - (g_uart_peripheral.uart_reg_read_index - g_uart_peripheral.uart_reg_write_index);
+    read_index = (read_index + 1) & (CONFIG_SIM_LPUART_FIFO_SIZE - 1);
   }
 
-  while (true) {  
-    lower->rx_buffer[lower->index_write_rx_buffer] = g_uart_peripheral.sim_uart_data_fifo[g_uart_peripheral.uart_reg_read_index];
-    lower->index_write_rx_buffer = (lower->index_write_rx_buffer + 1) % UART_RX_BUFFER;
-    g_uart_peripheral.uart_reg_read_index = (g_uart_peripheral.uart_reg_read_index + 1) % CONFIG_SIM_LPUART_FIFO_SIZE;
+  __atomic_store_n(&g_uart_peripheral.uart_reg_read_index, read_index,
+                   __ATOMIC_RELEASE);
+  host_uart_rx_resume();
 
-    available_bytes--;
+  /* Notify incomming RX characters */
 
-    if (available_bytes == 0) {
-  
-      /* Notify incomming RX characters */
+  sem_post(&lower->rx_notify);
+}
 
-      sem_post(&lower->rx_notify);
-      break;
-    }
-  }
+/****************************************************************************
+ * Name: sim_lpuart_int
+ *
+ * Description:
+ *   This function is invoked when we receive events from the simulated 
+ *   interrupt peripheral. It acts as an interrupt handler and defers the
+ *   copy of the RX FIFO to the worker. An interrupt that comes while the
+ *   work is still queued is covered by that pass.
+ * 
+ ****************************************************************************/
+
+static void sim_lpuart_int(void)
+{
+  worker_submit(g_uart_rx_worker, &g_uart_rx_work);
 }
 
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: host_uart_rx_has_room
+ *
+ * Description:
+ *   Tell the host whether the console RX ring can take more characters,
+ *   the virtual time mode only raises the UART interrupt when it can.
+ *
+ ****************************************************************************/
+
+int host_uart_rx_has_room(void)
+{
+  return ring_space(&g_uart_lowerhalfs[0].rx_ring) > 0;
+}
+
 /****************************************************************************
  * Name: uart_low_init
  *
@@ -259,11 +311,23 @@ struct uart_lower_s *uart_init(size_t *uart_num)
 
   *uart_num = ARRAY_LEN(g_uart_lowerhalfs);
 
+  /* The RX bottom half runs before the tasks that wait for the input */
+
+  g_uart_rx_worker = worker_create(SCHED_PRIORITY_MAX, "uart_rx");
+  if (g_uart_rx_worker < 0) {
+    return NULL;
+  }
+
+  worker_work_init(&g_uart_rx_work, sim_lpuart_rx_work, &g_uart_lowerhalfs[0]);
+  g_uart_rx_work.priority = WORKER_PRIORITY_HIGH;
+
   for (int i = 0; i < *uart_num; i++) {
 
     sem_init(&g_uart_lowerhalfs[i].tx_notify, 0, 0);
     sem_init(&g_uart_lowerhalfs[i].rx_notify, 0, 0);
     sem_init(&g_uart_lowerhalfs[i].lock, 0, 1);
+    ring_init(&g_uart_lowerhalfs[i].rx_ring, g_uart_lowerhalfs[i].rx_buffer,
+              UART_RX_BUFFER);
 
     ret = uart_register(g_uart_lowerhalfs[i].dev_path, &g_uart_lowerhalfs[i]);
     if (ret < 0) {
@@ -2,6 +2,12 @@
  * Included Files
  ****************************************************************************/
 
+/* Expose REG_RIP from ucontext_t on Linux */
+
+#ifndef __APPLE__
+  #define _GNU_SOURCE
+#endif
+
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -17,11 +23,21 @@
 #include <signal.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <poll.h>
+
+#ifdef __linux__
+  #include <sys/epoll.h>
+  #include <sys/eventfd.h>
+  #include <sys/timerfd.h>
+#endif
+
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../../../include/chip/simulator.h"
@@ -34,9 +50,22 @@
 
 #define _err(fmt, ...)            fprintf(stderr, "[ERROR] "fmt, __VA_ARGS__)
 
-/* The timer interval that generates sys tick events */
+/* The irq_state_t value when the simulated interrupts were disabled */
+
+#define SIM_IRQ_DISABLED          (1 << 0)
+
+/* The simulated interrupts latched while they were disabled */
 
-#define SCHEDULING_TIME_SLICE_MS  (1)
+#define SIM_IRQ_SYSTICK_PENDING   (1 << 0)
+#define SIM_IRQ_UART_PENDING      (1 << 1)
+#define SIM_IRQ_PROFILE_PENDING   (1 << 2)
+#define SIM_IRQ_FLASH_PENDING     (1 << 3)
+
+/* Keep the compiler from moving memory accesses across the interrupt flag,
+ * the signal handler runs on the same thread.
+ */
+
+#define SIM_IRQ_BARRIER()         __atomic_signal_fence(__ATOMIC_SEQ_CST)
 
 /* Simulated flash file path */
 
@@ -50,15 +79,42 @@
 
 #define ARRAY_LEN(x) (sizeof(x) / sizeof(x[0]))
 
+/* The maximum number of simulated CPUs */
+
+#define HOST_MAX_CPUS             (32)
+
+/* The signal that wakes up a simulated CPU from board_entersleep */
+
+#define HOST_IPI_SIGNAL           SIGUSR1
+
+/* The signal raised when a simulated flash transfer completes */
+
+#define HOST_FLASH_SIGNAL         SIGIO
+
+/* The number of events taken from epoll at once */
+
+#define HOST_IO_MAX_EVENTS        (4)
+
+/* The UART interrupt is raised again after this idle time while the OS
+ * leaves data in the FIFO, like the receive timeout of a real UART.
+ */
+
+#define HOST_UART_RX_TIMEOUT_MS   (1)
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
 
-typedef union irq_data_u
-{
-  sigset_t signal_set;
-  irq_state_t irq_state;
-} irq_data_t;
+/* A simulated flash transfer, the OS has one in flight at a time */
+
+struct host_flash_request_s {
+  int is_write;
+  uint8_t *buffer;
+  uint32_t sector;
+  size_t count;
+  volatile int pending;         /* Set until the host I/O loop takes it */
+  volatile int result;          /* The bytes moved or a negative error */
+};
 
 /****************************************************************************
  * Public Data
@@ -86,6 +142,78 @@ static struct termios current;
 
 static int g_sim_flash_fd = -1;
 
+/* With the virtual time the OS clock is g_virtual_now_us, it only moves
+ * forward when the OS is idle and it jumps to the next event.
+ */
+
+static int g_virtual_time;
+static uint64_t g_virtual_now_us;
+
+/* The tick period and the OS clock time when the ticks started */
+
+static uint64_t g_tick_period_us;
+static uint64_t g_tick_start_us;
+
+/* The one-shot timer deadline in OS clock time, 0 when disarmed */
+
+static int g_tick_oneshot;
+static volatile uint64_t g_alarm_deadline_us;
+
+/* When the interrupt thread raised the last UART interrupt */
+
+static volatile uint64_t g_uart_raised_us;
+
+/* Set while the host I/O loop does not watch stdin, because the UART is not
+ * opened yet or its FIFO is full. The UART interrupt handler asks for more
+ * with host_uart_rx_resume.
+ */
+
+static volatile int g_uart_rx_stalled = 1;
+
+/* Set when stdin reached the end of file */
+
+static int g_uart_rx_eof;
+
+/* The simulated flash transfer handed to the host I/O loop */
+
+static struct host_flash_request_s g_flash_request;
+
+#ifdef __linux__
+/* The host I/O loop waits on the epoll set for stdin, the timer and the
+ * event file descriptor the OS writes to when it has work for the loop.
+ */
+
+static int g_io_epoll_fd = -1;
+static int g_io_event_fd = -1;
+static int g_io_timer_fd = -1;
+#endif
+
+/* The kernel lock, only the simulated CPU that holds it runs the OS and
+ * the tasks, so the simulated CPUs never run in parallel. It is a ticket
+ * lock so the CPUs take it in turn.
+ */
+
+static pthread_mutex_t g_kernel_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_kernel_lock_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int g_kernel_next_ticket;
+static unsigned int g_kernel_now_serving;
+
+/* The simulated CPUs, each one is a host thread */
+
+static pthread_t g_host_cpus[HOST_MAX_CPUS];
+static int g_host_num_cpus = 1;
+static __thread int g_host_cpu_id;
+
+/* The simulated interrupts are disabled with a flag instead of the host
+ * signal mask so a critical section does not cost a system call. A signal
+ * that arrives while the flag is set is latched in the pending bits and
+ * cpu_enableint replays it. Each simulated CPU has its own state.
+ */
+
+static __thread volatile sig_atomic_t g_host_int_disabled;
+static __thread volatile uint32_t g_host_int_pending;
+static __thread volatile uintptr_t g_host_pending_pc;
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
@@ -104,389 +232,1507 @@ void irq_generic_handler(void);
 
 void host_set_simualted_intnum(int int_num);
 
+/* Called from the host signal handler to set the interrupted PC */
+
+void host_set_simulated_intpc(uintptr_t pc);
+
+/* Called from the host signal handler to set when the interrupt was raised */
+
+void host_set_simulated_intraised(uint32_t raised_us, int has_raised);
+
+/* The secondary CPUs enter the scheduler here */
+
+void sched_run(void);
+
+/* Check whether the simulated UART driver can take more input */
+
+int host_uart_rx_has_room(void);
+
+/* Check whether the OS was configured to run on the virtual time */
+
+int host_sim_virtual_time(void);
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
 
 /****************************************************************************
- * Name: host_signal_handler
+ * Name: host_get_monotonic_us
  *
  * Description:
- *   Signal handler for the host process that invokes the context switching
- *   mechanism.
- *
- * Input Parameters:
- *   sig    - signal handler number
- *   si     - the signal info
- *   old_ucontext - the old processor state
+ *   Read the host monotonic clock in microseconds.
  *
  ****************************************************************************/
 
-static void host_signal_handler(int sig, siginfo_t *si, void *old_ucontext)
+static uint64_t host_get_monotonic_us(void)
 {
-  if (sig == SIGALRM)
-  {
-    host_set_simualted_intnum(SYSTICK_IRQ);
-  }
-  else if (sig == SIGUSR2)
-  {
-    host_set_simualted_intnum(UART_0_IRQ);
-  }
-  else
-  {
-    return;
-  }
+  struct timespec ts;
 
-  irq_generic_handler();
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
 /****************************************************************************
- * Name: host_simulated_intterupts
+ * Name: host_get_clock_us
  *
  * Description:
- *   Simulated interrupts from peripherals and send signals to the OS thread.
- *
- * Input Parameters:
- *   ignored
+ *   Read the OS clock in microseconds: the virtual clock in the virtual
+ *   time mode otherwise the host monotonic clock.
  *
  ****************************************************************************/
 
-static void *host_simulated_intterupts(void *arg)
+static uint64_t host_get_clock_us(void)
 {
-  char c;
-  int available_bytes;
-
-  while (1) {
-    if (g_uart_peripheral.uart_reg_write_index >= g_uart_peripheral.uart_reg_read_index) {
-      available_bytes = ARRAY_LEN(g_uart_peripheral.sim_uart_data_fifo) - (g_uart_peripheral.uart_reg_write_index - g_uart_peripheral.uart_reg_read_index);
-    } else {
-      available_bytes = g_uart_peripheral.uart_reg_read_index - g_uart_peripheral.uart_reg_write_index - 1;
-    }
-
-    if (g_uart_peripheral.is_peripheral_ready && available_bytes > 0) {
-      c = getchar();
-      if (c == -1) {
-        continue;
-      }
-
-#if 0 /* Enable this section for debug */
-      if (iscntrl(c)) {
-        printf("%d\n", c);
-      } else {
-        printf("%d ('%c')\n", c, c);
-      }
-#endif
-
-      g_uart_peripheral.sim_uart_data_fifo[g_uart_peripheral.uart_reg_write_index] = c;
-      g_uart_peripheral.uart_reg_write_index = (g_uart_peripheral.uart_reg_write_index + 1) %
-        ARRAY_LEN(g_uart_peripheral.sim_uart_data_fifo);
-
-      kill(g_host_pid, SIGUSR2);
-    }
+  if (g_virtual_time) {
+    return g_virtual_now_us;
   }
 
-  return NULL;
+  return host_get_monotonic_us();
 }
 
 /****************************************************************************
- * Name: host_create_interrupt_thread
+ * Name: host_get_systick_raised_us
  *
  * Description:
- *   Creates a new pthread to simulate external events.
+ *   Get the host monotonic time when the current SysTick signal was due:
+ *   the armed deadline of the one-shot timer or the last period boundary
+ *   of the periodic one.
+ *
+ * Return Value:
+ *   1 if the time is known otherwise 0.
  *
  ****************************************************************************/
 
-static void host_create_interrupt_thread(void)
+static int host_get_systick_raised_us(uint64_t *raised_us)
 {
-  int ret;
-  struct sigaction act;
-
-  g_host_pid = getpid();
-
-  act.sa_sigaction = host_signal_handler;
-  sigemptyset(&act.sa_mask);
-  act.sa_flags = SA_SIGINFO;
-
-  if ((ret = sigaction(SIGUSR2, &act, NULL)) != 0) {
-      _err("%d signal handler", ret);
+  if (g_tick_period_us == 0) {
+    return 0;
   }
 
-  ret = pthread_create(&g_simulated_int, NULL, host_simulated_intterupts, NULL);
-  if (ret < 0) {
-    _err("%d start sim interrupts thread\n", ret);
+  if (g_tick_oneshot) {
+    *raised_us = g_alarm_deadline_us;
+    return g_alarm_deadline_us != 0;
   }
+
+  uint64_t elapsed_us = host_get_clock_us() - g_tick_start_us;
+  *raised_us = g_tick_start_us + elapsed_us - elapsed_us % g_tick_period_us;
+  return 1;
 }
 
 /****************************************************************************
- * Name: host_init_termios
+ * Name: host_get_ucontext_pc
  *
  * Description:
- *   Set up the console so that it does not buffer characters.
+ *   Read the program counter saved by the host when the signal interrupted
+ *   the OS thread.
  *
  ****************************************************************************/
 
-static void host_init_termios(int echo)
+static uintptr_t host_get_ucontext_pc(void *old_ucontext)
 {
-  tcgetattr(0, &current);
-  current.c_lflag &= ~ICANON;
-  current.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP
-                        | INLCR | IGNCR | ICRNL | IXON);
-  if (echo) {
-      current.c_lflag |= ECHO;
-  } else {
-      current.c_lflag &= ~ECHO;
-  }
+  ucontext_t *uc = old_ucontext;
 
-  tcsetattr(0, TCSANOW, &current);
+#if defined(__APPLE__) && defined(__x86_64__)
+  return uc->uc_mcontext->__ss.__rip;
+#elif defined(__linux__) && defined(__x86_64__)
+  return uc->uc_mcontext.gregs[REG_RIP];
+#else
+  (void)uc;
+  return 0;
+#endif
 }
 
 /****************************************************************************
- * Name: host_sim_flash_opens
+ * Name: host_signal_pending_bit
  *
  * Description:
- *   Open the simulated flash file.
+ *   Get the pending bit of a simulated interrupt signal or 0.
  *
  ****************************************************************************/
 
-static void host_sim_flash_open(void)
-{
-  int ret = open(CONFIG_SIM_FLASH_FILENAME, O_RDWR);
-  if (ret < 0)
-    return;
-
-  g_sim_flash_fd = ret;
-}
-
-/****************************************************************************
- * Public Functions
- ****************************************************************************/
-
-void board_entersleep(void)
+static uint32_t host_signal_pending_bit(int sig)
 {
-  sleep(1);
+  switch (sig) {
+    case SIGALRM:
+      return SIM_IRQ_SYSTICK_PENDING;
+    case SIGUSR2:
+      return SIM_IRQ_UART_PENDING;
+    case SIGPROF:
+      return SIM_IRQ_PROFILE_PENDING;
+    case HOST_FLASH_SIGNAL:
+      return SIM_IRQ_FLASH_PENDING;
+    default:
+      return 0;
+  }
 }
 
 /****************************************************************************
- * Name: host_console_putc
+ * Name: host_dispatch_interrupt
  *
  * Description:
- *   This function prints out one character to the console. It is invoked from
- *   the lower layer UART to show a character to the console. In a hardware
- *   build this function should be responsible for storing the character in
- *   the UART peripheral register taht will later be transfered on the wire.
+ *   Run the OS interrupt handler for a simulated interrupt signal. It is
+ *   called with the simulated interrupts disabled.
  *
  * Input Parameters:
- *   c    - the character that will be printed to the console
- *
- * Assumptions/Limitations:
- *   Anything else that one might need to know to use this function.
+ *   sig    - signal handler number
+ *   pc     - the interrupted program counter for the profiling signal
  *
  ****************************************************************************/
 
-void host_console_putc(int c)
+static void host_dispatch_interrupt(int sig, uintptr_t pc)
 {
-  write(1, &c, 1);
+  uint64_t raised_us = 0;
+  int has_raised = 0;
+
+  if (sig == SIGALRM) {
+    has_raised = host_get_systick_raised_us(&raised_us);
+    host_set_simualted_intnum(SYSTICK_IRQ);
+  } else if (sig == SIGUSR2) {
+    raised_us  = g_uart_raised_us;
+    has_raised = 1;
+    host_set_simualted_intnum(UART_0_IRQ);
+  } else if (sig == SIGPROF) {
+    host_set_simulated_intpc(pc);
+    host_set_simualted_intnum(PROFILE_IRQ);
+  } else if (sig == HOST_FLASH_SIGNAL) {
+    host_set_simualted_intnum(FLASH_IRQ);
+  } else {
+    return;
+  }
+
+  /* The OS clock is the low 32 bits of host_get_clock_us */
+
+  host_set_simulated_intraised((uint32_t)raised_us, has_raised);
+
+  irq_generic_handler();
 }
 
 /****************************************************************************
- * Name: host_simulated_systick
+ * Name: host_replay_interrupts
  *
  * Description:
- *   Simulate a tick event using a host timer. This function sets up the
- *   signal mask for the host process in which we run Caypso OS, it sets
- *   up a timer and it fires it with SCHEDULING_TIME_SLICE_MS interval.
- *   It is called from the board control logic during initialization.
- *
- * Assumptions/Limitations:
- *   Anything else that one might need to know to use this function.
+ *   Run the handlers of the interrupts latched while they were disabled. It
+ *   is called with the simulated interrupts disabled.
  *
  ****************************************************************************/
 
-void host_simulated_systick(void)
+static void host_replay_interrupts(void)
 {
-  int ret;
-  struct itimerval it;
-
-  struct sigaction act;
-  sigset_t set;
-
-  /* Enable all the signals */
-
-  sigfillset(&set);
-  pthread_sigmask(SIG_UNBLOCK, &set, NULL);
-
-  act.sa_sigaction = host_signal_handler;
-  sigemptyset(&act.sa_mask);
-  act.sa_flags = SA_SIGINFO;
+  uint32_t pending = __atomic_exchange_n(&g_host_int_pending, 0,
+                                         __ATOMIC_SEQ_CST);
 
-  sigemptyset(&set);
-  sigaddset(&set, SIGALRM);
-  sigaddset(&set, SIGSEGV);
-  sigaddset(&set, SIGUSR2);
-  if ((ret = sigaction(SIGALRM, &act, NULL)) != 0) {
-      _err("%d signal handler", ret);
+  if (pending & SIM_IRQ_SYSTICK_PENDING) {
+    host_dispatch_interrupt(SIGALRM, 0);
   }
 
-  it.it_interval.tv_sec  = 0;
-  it.it_interval.tv_usec = SCHEDULING_TIME_SLICE_MS * 1000;
-  it.it_value            = it.it_interval;
-
-  ret = setitimer(ITIMER_REAL, &it, NULL);
-  if (ret < 0) {
-    _err("%d settimer\n", ret);
-    return;
+  if (pending & SIM_IRQ_UART_PENDING) {
+    host_dispatch_interrupt(SIGUSR2, 0);
   }
 
-  return;
-}
-
-/**************************************************************************
- * Name:
- *  cpu_disableint
- *
- * Description:
- *  Disable all interrupts.
- *
- *************************************************************************/
+  if (pending & SIM_IRQ_PROFILE_PENDING) {
+    host_dispatch_interrupt(SIGPROF, g_host_pending_pc);
+  }
 
-irq_state_t cpu_disableint(void)
-{
-//  irq_data_t irq_new_data, irq_old_data;
-//
-//  /* Disable signals */
-//
-//  sigfillset(&irq_new_data.signal_set);
-//  pthread_sigmask(SIG_SETMASK, &irq_new_data.signal_set, &irq_old_data.signal_set);
-//  return irq_old_data.irq_state;
-  return 0;
+  if (pending & SIM_IRQ_FLASH_PENDING) {
+    host_dispatch_interrupt(HOST_FLASH_SIGNAL, 0);
+  }
 }
 
-/**************************************************************************
- * Name:
- *  cpu_enableint
+/****************************************************************************
+ * Name: host_irq_sigset
  *
  * Description:
- *  Enable all interrupts.
+ *   Fill a signal set with the signals that wake up a sleeping simulated
+ *   CPU: the SysTick, the UART and the flash completion.
  *
- *************************************************************************/
+ ****************************************************************************/
 
-void cpu_enableint(irq_state_t last_state)
+static void host_irq_sigset(sigset_t *set)
 {
-//  irq_data_t irq_old_data;
-//  irq_old_data.irq_state = last_state;
-//  pthread_sigmask(SIG_SETMASK, &irq_old_data.signal_set, NULL);
+  sigemptyset(set);
+  sigaddset(set, SIGALRM);
+  sigaddset(set, SIGUSR2);
+  sigaddset(set, HOST_FLASH_SIGNAL);
 }
 
 /****************************************************************************
- * Name: host_sim_flash_read_mtd
+ * Name: host_sim_flash_transfer
  *
  * Description:
- *   Read data from the simulated flash file and fill the provided buffer.
- *
- * Input Arguments:
- *   buffer - the place where we store the data
- *   sector - the sector number
- *   count  - the number of bytes that we would like to read
+ *   Move count bytes between the simulated flash file at the start of a
+ *   sector and the buffer.
  *
  * Returned Value:
- *   The number of bytes read otherwise a negative error code.
+ *   The number of bytes moved otherwise a negative error code.
  *
  ****************************************************************************/
 
-int host_sim_flash_read_mtd(uint8_t *buffer, uint32_t sector, size_t count)
+static int host_sim_flash_transfer(int is_write, uint8_t *buffer,
+                                   uint32_t sector, size_t count)
 {
-  int ret = 0;
-  size_t n_read_bytes = 0;
-  off_t n_seek_offset, n_seeked_offset;
+  off_t offset = (off_t)sector * CONFIG_SIM_FLASH_BLOCK_SIZE;
+  size_t n_bytes = 0;
 
   if (g_sim_flash_fd < 0) {
     _err("[SimFlash] no SIM flash file found fd=%d\n", g_sim_flash_fd);
     return -ENOSYS;
   }
 
-  /* Seek to the specified sector */
+  while (n_bytes < count) {
+    ssize_t ret;
 
-  n_seek_offset = sector * CONFIG_SIM_FLASH_BLOCK_SIZE;
-  n_seeked_offset = lseek(g_sim_flash_fd, n_seek_offset, SEEK_SET);
-  if (n_seek_offset != n_seeked_offset) {
-    _err("[SimFlash] seek to n_seek_offset=%d failed, current:%d\n",
-         (int)n_seek_offset,
-         (int)n_seeked_offset);
-    return -EINVAL;
-  }
+    if (is_write) {
+      ret = pwrite(g_sim_flash_fd, buffer + n_bytes, count - n_bytes,
+                   offset + n_bytes);
+    } else {
+      ret = pread(g_sim_flash_fd, buffer + n_bytes, count - n_bytes,
+                  offset + n_bytes);
+    }
 
-  /* Read the data in the buffer */
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
 
-  do {
-    ret = read(g_sim_flash_fd, buffer, count);
-    if (ret < 0) {
-      return n_read_bytes;
+    if (ret <= 0) {
+      break;
     }
 
-    count  -= ret;
-    buffer += ret;
-    n_read_bytes += ret;
-  } while (count > 0);
+    n_bytes += ret;
+  }
 
-  return n_read_bytes;
+  return n_bytes;
 }
 
 /****************************************************************************
- * Name: host_sim_flash_write_mtd
+ * Name: host_sim_flash_complete
  *
  * Description:
- *   Write data from to the simulated flash file from the received buffer.
- *
- * Input Arguments:
- *   buffer - the buffer to write
- *   sector - the sector number
- *   count  - the number of bytes that we would like to write
- *
- * Returned Value:
- *   The number of bytes written otherwise a negative error code.
+ *   Run the pending simulated flash transfer and raise its completion
+ *   interrupt.
  *
  ****************************************************************************/
 
-int host_sim_flash_write_mtd(uint8_t *buffer, uint32_t sector, size_t count)
+static void host_sim_flash_complete(void)
 {
-  int ret = 0;
-  size_t n_written_bytes = 0;
-  off_t n_seek_offset, n_seeked_offset;
-
-  if (g_sim_flash_fd < 0) {
-    _err("[SimFlash] no SIM flash file found fd=%d\n", g_sim_flash_fd);
-    return -ENOSYS;
-  }
-
-  /* Seek to the specified sector */
+  struct host_flash_request_s *req = &g_flash_request;
 
-  n_seek_offset = sector * CONFIG_SIM_FLASH_BLOCK_SIZE;
-  n_seeked_offset = lseek(g_sim_flash_fd, n_seek_offset, SEEK_SET);
-  if (n_seek_offset != n_seeked_offset) {
-    _err("[SimFlash] seek to n_seek_offset=%d failed, current:%d\n",
-         (int)n_seek_offset,
-         (int)n_seeked_offset);
-    return -EINVAL;
+  if (!__atomic_load_n(&req->pending, __ATOMIC_ACQUIRE)) {
+    return;
   }
 
-  /* Read the data in the buffer */
-
-  do {
-    ret = write(g_sim_flash_fd, buffer, count);
-    if (ret < 0) {
-      return n_written_bytes;
-    }
+  req->result = host_sim_flash_transfer(req->is_write, req->buffer,
+                                        req->sector, req->count);
+  __atomic_store_n(&req->pending, 0, __ATOMIC_RELEASE);
 
-    count  -= ret;
-    buffer += ret;
-    n_written_bytes += ret;
-  } while (count > 0);
-
-  return n_written_bytes;
+  kill(g_host_pid, HOST_FLASH_SIGNAL);
 }
 
 /****************************************************************************
- * Name: main
+ * Name: host_uart_fifo_space
+ *
+ * Description:
+ *   Get the free room in the simulated UART FIFO, one slot stays empty to
+ *   tell a full FIFO from an empty one.
+ *
+ ****************************************************************************/
+
+static unsigned int host_uart_fifo_space(void)
+{
+  unsigned int used = (g_uart_peripheral.uart_reg_write_index -
+                       __atomic_load_n(&g_uart_peripheral.uart_reg_read_index,
+                                       __ATOMIC_ACQUIRE)) &
+                      (CONFIG_SIM_LPUART_FIFO_SIZE - 1);
+
+  return CONFIG_SIM_LPUART_FIFO_SIZE - 1 - used;
+}
+
+/****************************************************************************
+ * Name: host_uart_fill_fifo
+ *
+ * Description:
+ *   Read what stdin has in the free part of the simulated UART FIFO with a
+ *   single read.
+ *
+ * Returned Value:
+ *   The number of bytes stored, 0 when there was nothing to do or -1 at the
+ *   end of file.
+ *
+ ****************************************************************************/
+
+static int host_uart_fill_fifo(void)
+{
+  unsigned int space = host_uart_fifo_space();
+  unsigned int write_index = g_uart_peripheral.uart_reg_write_index;
+  unsigned int contiguous = CONFIG_SIM_LPUART_FIFO_SIZE - write_index;
+
+  if (space == 0) {
+    return 0;
+  }
+
+  if (contiguous > space) {
+    contiguous = space;
+  }
+
+  ssize_t ret = read(0, &g_uart_peripheral.sim_uart_data_fifo[write_index],
+                     contiguous);
+  if (ret < 0 && (errno == EINTR || errno == EAGAIN)) {
+    return 0;
+  }
+
+  if (ret <= 0) {
+    g_uart_rx_eof = 1;
+    return -1;
+  }
+
+  __atomic_store_n(&g_uart_peripheral.uart_reg_write_index,
+                   (write_index + ret) & (CONFIG_SIM_LPUART_FIFO_SIZE - 1),
+                   __ATOMIC_RELEASE);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: host_signal_handler
+ *
+ * Description:
+ *   Signal handler for the host process that invokes the context switching
+ *   mechanism. If the simulated interrupts are disabled the signal is only
+ *   latched, with the interrupted PC for the profiling signal so the
+ *   sample still points in the critical section.
+ *
+ * Input Parameters:
+ *   sig    - signal handler number
+ *   si     - the signal info
+ *   old_ucontext - the old processor state
+ *
+ ****************************************************************************/
+
+static void host_signal_handler(int sig, siginfo_t *si, void *old_ucontext)
+{
+  uintptr_t pc = 0;
+
+  if (sig == SIGPROF) {
+    pc = host_get_ucontext_pc(old_ucontext);
+  }
+
+  if (g_host_int_disabled) {
+    if (sig == SIGPROF) {
+      g_host_pending_pc = pc;
+    }
+
+    g_host_int_pending |= host_signal_pending_bit(sig);
+    return;
+  }
+
+  g_host_int_disabled = 1;
+  SIM_IRQ_BARRIER();
+
+  host_dispatch_interrupt(sig, pc);
+
+  SIM_IRQ_BARRIER();
+  g_host_int_disabled = 0;
+}
+
+#ifdef __linux__
+/****************************************************************************
+ * Name: host_io_kick
+ *
+ * Description:
+ *   Wake up the host I/O loop to look at the UART and flash requests.
+ *
+ ****************************************************************************/
+
+static void host_io_kick(void)
+{
+  uint64_t value = 1;
+
+  if (write(g_io_event_fd, &value, sizeof(value)) < 0) {
+    _err("%d kick the I/O loop\n", errno);
+  }
+}
+
+/****************************************************************************
+ * Name: host_io_watch_stdin
+ *
+ * Description:
+ *   Add stdin to the epoll set or remove it.
+ *
+ ****************************************************************************/
+
+static void host_io_watch_stdin(int watch)
+{
+  struct epoll_event ev = { .events = EPOLLIN, .data.fd = 0 };
+
+  epoll_ctl(g_io_epoll_fd, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, 0, &ev);
+}
+
+/****************************************************************************
+ * Name: host_io_uart_stall
+ *
+ * Description:
+ *   Stop watching stdin while the FIFO is full. The flag is published
+ *   before the FIFO is checked again so that the UART interrupt handler
+ *   either sees it or we see the room it made.
+ *
+ * Returned Value:
+ *   1 if stdin is no longer watched otherwise 0.
+ *
+ ****************************************************************************/
+
+static int host_io_uart_stall(void)
+{
+  __atomic_store_n(&g_uart_rx_stalled, 1, __ATOMIC_SEQ_CST);
+
+  if (host_uart_fifo_space() > 0) {
+    __atomic_store_n(&g_uart_rx_stalled, 0, __ATOMIC_SEQ_CST);
+    return 0;
+  }
+
+  host_io_watch_stdin(0);
+  return 1;
+}
+
+/****************************************************************************
+ * Name: host_io_uart_receive
+ *
+ * Description:
+ *   Fill the simulated UART FIFO from stdin and raise one UART interrupt
+ *   for the whole batch.
+ *
+ ****************************************************************************/
+
+static void host_io_uart_receive(void)
+{
+  int ret = host_uart_fill_fifo();
+
+  if (ret == 0) {
+    if (host_uart_fifo_space() == 0) {
+      host_io_uart_stall();
+    }
+
+    return;
+  }
+
+  if (ret < 0) {
+    __atomic_store_n(&g_uart_rx_stalled, 1, __ATOMIC_SEQ_CST);
+    host_io_watch_stdin(0);
+    return;
+  }
+
+  g_uart_raised_us = host_get_monotonic_us();
+  kill(g_host_pid, SIGUSR2);
+}
+
+/****************************************************************************
+ * Name: host_io_handle_event_fd
+ *
+ * Description:
+ *   The OS has work for the loop: start watching stdin again once the UART
+ *   FIFO has room and run the pending flash transfer.
+ *
+ ****************************************************************************/
+
+static void host_io_handle_event_fd(void)
+{
+  uint64_t value;
+
+  if (read(g_io_event_fd, &value, sizeof(value)) < 0) {
+    return;
+  }
+
+  if (g_uart_rx_stalled && !g_uart_rx_eof &&
+      g_uart_peripheral.is_peripheral_ready && host_uart_fifo_space() > 0) {
+    __atomic_store_n(&g_uart_rx_stalled, 0, __ATOMIC_SEQ_CST);
+    host_io_watch_stdin(1);
+  }
+
+  host_sim_flash_complete();
+}
+
+/****************************************************************************
+ * Name: host_io_loop
+ *
+ * Description:
+ *   The host I/O loop simulates the peripherals. It sleeps in epoll until
+ *   stdin has data, the SysTick timer expires or the OS writes the event
+ *   file descriptor and it raises the matching interrupts.
+ *
+ * Input Parameters:
+ *   ignored
+ *
+ ****************************************************************************/
+
+static void *host_io_loop(void *arg)
+{
+  struct epoll_event events[HOST_IO_MAX_EVENTS];
+
+  while (1) {
+    int timeout_ms = -1;
+
+    if (!g_virtual_time &&
+        g_uart_peripheral.uart_reg_read_index !=
+        g_uart_peripheral.uart_reg_write_index) {
+      timeout_ms = HOST_UART_RX_TIMEOUT_MS;
+    }
+
+    int n = epoll_wait(g_io_epoll_fd, events, HOST_IO_MAX_EVENTS, timeout_ms);
+    if (n == 0) {
+      kill(g_host_pid, SIGUSR2);
+      continue;
+    }
+
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+
+      if (fd == 0) {
+        host_io_uart_receive();
+      } else if (fd == g_io_timer_fd) {
+        uint64_t expirations;
+
+        /* A disarmed or re-armed timer has nothing to read */
+
+        if (read(g_io_timer_fd, &expirations, sizeof(expirations)) > 0) {
+          kill(g_host_pid, SIGALRM);
+        }
+      } else if (fd == g_io_event_fd) {
+        host_io_handle_event_fd();
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Name: host_io_init
+ *
+ * Description:
+ *   Create the epoll set with the event file descriptor and the SysTick
+ *   timer. Stdin is added when the UART is opened.
+ *
+ ****************************************************************************/
+
+static int host_io_init(void)
+{
+  struct epoll_event ev = { .events = EPOLLIN };
+
+  g_io_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  g_io_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  g_io_timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                 TFD_CLOEXEC | TFD_NONBLOCK);
+  if (g_io_epoll_fd < 0 || g_io_event_fd < 0 || g_io_timer_fd < 0) {
+    return -errno;
+  }
+
+  ev.data.fd = g_io_event_fd;
+  if (epoll_ctl(g_io_epoll_fd, EPOLL_CTL_ADD, g_io_event_fd, &ev) < 0) {
+    return -errno;
+  }
+
+  ev.data.fd = g_io_timer_fd;
+  if (epoll_ctl(g_io_epoll_fd, EPOLL_CTL_ADD, g_io_timer_fd, &ev) < 0) {
+    return -errno;
+  }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: host_timer_arm
+ *
+ * Description:
+ *   Arm the SysTick timer at an absolute host monotonic time, with a period
+ *   or as a one-shot. A zero deadline disarms it.
+ *
+ ****************************************************************************/
+
+static void host_timer_arm(uint64_t deadline_us, uint64_t period_us)
+{
+  struct itimerspec its = {0};
+
+  its.it_value.tv_sec     = deadline_us / 1000000;
+  its.it_value.tv_nsec    = deadline_us % 1000000 * 1000;
+  its.it_interval.tv_sec  = period_us / 1000000;
+  its.it_interval.tv_nsec = period_us % 1000000 * 1000;
+
+  if (timerfd_settime(g_io_timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+    _err("%d timerfd_settime\n", errno);
+  }
+}
+#else
+/****************************************************************************
+ * Name: host_io_loop
+ *
+ * Description:
+ *   Simulated interrupts from peripherals and send signals to the OS thread.
+ *
+ * Input Parameters:
+ *   ignored
+ *
+ ****************************************************************************/
+
+static void *host_io_loop(void *arg)
+{
+  char c;
+  int available_bytes;
+
+  while (1) {
+    if (g_uart_peripheral.uart_reg_write_index >= g_uart_peripheral.uart_reg_read_index) {
+      available_bytes = ARRAY_LEN(g_uart_peripheral.sim_uart_data_fifo) - (g_uart_peripheral.uart_reg_write_index - g_uart_peripheral.uart_reg_read_index);
+    } else {
+      available_bytes = g_uart_peripheral.uart_reg_read_index - g_uart_peripheral.uart_reg_write_index - 1;
+    }
+
+    if (g_uart_peripheral.is_peripheral_ready && available_bytes > 0) {
+      c = getchar();
+      if (c == -1) {
+        continue;
+      }
+
+#if 0 /* Enable this section for debug */
+      if (iscntrl(c)) {
+        printf("%d\n", c);
+      } else {
+        printf("%d ('%c')\n", c, c);
+      }
+#endif
+
+      g_uart_peripheral.sim_uart_data_fifo[g_uart_peripheral.uart_reg_write_index] = c;
+      g_uart_peripheral.uart_reg_write_index = (g_uart_peripheral.uart_reg_write_index + 1) %
+        ARRAY_LEN(g_uart_peripheral.sim_uart_data_fifo);
+
+      g_uart_raised_us = host_get_monotonic_us();
+      kill(g_host_pid, SIGUSR2);
+    }
+  }
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Name: host_timer_arm
+ *
+ * Description:
+ *   Arm the SysTick timer at an absolute host monotonic time, with a period
+ *   or as a one-shot. A zero deadline disarms it.
+ *
+ ****************************************************************************/
+
+static void host_timer_arm(uint64_t deadline_us, uint64_t period_us)
+{
+  struct itimerval it = {0};
+
+  if (deadline_us != 0) {
+    uint64_t now_us = host_get_monotonic_us();
+    uint64_t delay_us = deadline_us > now_us ? deadline_us - now_us : 1;
+
+    it.it_value.tv_sec     = delay_us / 1000000;
+    it.it_value.tv_usec    = delay_us % 1000000;
+    it.it_interval.tv_sec  = period_us / 1000000;
+    it.it_interval.tv_usec = period_us % 1000000;
+  }
+
+  if (setitimer(ITIMER_REAL, &it, NULL) < 0) {
+    _err("%d settimer\n", errno);
+  }
+}
+#endif /* __linux__ */
+
+/****************************************************************************
+ * Name: host_create_interrupt_thread
+ *
+ * Description:
+ *   Creates a new pthread to simulate external events.
+ *
+ ****************************************************************************/
+
+static void host_create_interrupt_thread(void)
+{
+  int ret;
+  struct sigaction act;
+
+  g_host_pid = getpid();
+
+  act.sa_sigaction = host_signal_handler;
+  sigemptyset(&act.sa_mask);
+  sigaddset(&act.sa_mask, SIGALRM);
+  sigaddset(&act.sa_mask, SIGPROF);
+  sigaddset(&act.sa_mask, HOST_FLASH_SIGNAL);
+  act.sa_flags = SA_SIGINFO | SA_RESTART;
+
+  if ((ret = sigaction(SIGUSR2, &act, NULL)) != 0) {
+      _err("%d signal handler", ret);
+  }
+
+  /* The flash completion interrupt */
+
+  sigemptyset(&act.sa_mask);
+  sigaddset(&act.sa_mask, SIGALRM);
+  sigaddset(&act.sa_mask, SIGUSR2);
+  sigaddset(&act.sa_mask, SIGPROF);
+
+  if ((ret = sigaction(HOST_FLASH_SIGNAL, &act, NULL)) != 0) {
+      _err("%d signal handler", ret);
+  }
+
+  /* The profiling timer samples the interrupted PC */
+
+  sigemptyset(&act.sa_mask);
+  sigaddset(&act.sa_mask, SIGALRM);
+  sigaddset(&act.sa_mask, SIGUSR2);
+  sigaddset(&act.sa_mask, HOST_FLASH_SIGNAL);
+
+  if ((ret = sigaction(SIGPROF, &act, NULL)) != 0) {
+      _err("%d signal handler", ret);
+  }
+
+  /* With the virtual time the Idle task polls the peripherals itself */
+
+  if (g_virtual_time) {
+    return;
+  }
+
+#ifdef __linux__
+  if ((ret = host_io_init()) < 0) {
+    _err("%d host I/O loop\n", ret);
+  }
+#endif
+
+  ret = pthread_create(&g_simulated_int, NULL, host_io_loop, NULL);
+  if (ret < 0) {
+    _err("%d start sim interrupts thread\n", ret);
+  }
+}
+
+/****************************************************************************
+ * Name: host_init_termios
+ *
+ * Description:
+ *   Set up the console so that it does not buffer characters.
+ *
+ ****************************************************************************/
+
+static void host_init_termios(int echo)
+{
+  tcgetattr(0, &current);
+  current.c_lflag &= ~ICANON;
+  current.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP
+                        | INLCR | IGNCR | ICRNL | IXON);
+  if (echo) {
+      current.c_lflag |= ECHO;
+  } else {
+      current.c_lflag &= ~ECHO;
+  }
+
+  tcsetattr(0, TCSANOW, &current);
+}
+
+/****************************************************************************
+ * Name: host_sim_flash_opens
+ *
+ * Description:
+ *   Open the simulated flash file.
+ *
+ ****************************************************************************/
+
+static void host_sim_flash_open(void)
+{
+  int ret = open(CONFIG_SIM_FLASH_FILENAME, O_RDWR);
+  if (ret < 0)
+    return;
+
+  g_sim_flash_fd = ret;
+}
+
+/****************************************************************************
+ * Name: host_kernel_lock
+ *
+ * Description:
+ *   Wait for our turn to run the OS. Call it with the simulated interrupts
+ *   blocked, a signal handler must not run on a CPU without the lock.
+ *
+ ****************************************************************************/
+
+static void host_kernel_lock(void)
+{
+  pthread_mutex_lock(&g_kernel_lock);
+
+  unsigned int ticket = g_kernel_next_ticket++;
+  while (ticket != g_kernel_now_serving) {
+    pthread_cond_wait(&g_kernel_lock_cond, &g_kernel_lock);
+  }
+
+  pthread_mutex_unlock(&g_kernel_lock);
+}
+
+/****************************************************************************
+ * Name: host_kernel_unlock
+ *
+ * Description:
+ *   Give the OS to the next CPU in line.
+ *
+ ****************************************************************************/
+
+static void host_kernel_unlock(void)
+{
+  pthread_mutex_lock(&g_kernel_lock);
+  g_kernel_now_serving++;
+  pthread_cond_broadcast(&g_kernel_lock_cond);
+  pthread_mutex_unlock(&g_kernel_lock);
+}
+
+/****************************************************************************
+ * Name: host_cpu_entry
+ *
+ * Description:
+ *   The entry point of a secondary CPU thread. The host signals stay
+ *   blocked until the thread holds the kernel lock.
+ *
+ ****************************************************************************/
+
+static void *host_cpu_entry(void *arg)
+{
+  sigset_t set;
+
+  sigfillset(&set);
+  sigdelset(&set, SIGINT);
+  pthread_sigmask(SIG_SETMASK, &set, NULL);
+
+  g_host_cpu_id = (int)(intptr_t)arg;
+
+  host_kernel_lock();
+
+  /* Take the simulated interrupts while we hold the kernel lock */
+
+  host_irq_sigset(&set);
+  sigaddset(&set, SIGPROF);
+  pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+
+  sched_run();
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Name: host_smp_entersleep
+ *
+ * Description:
+ *   Release the kernel lock and wait for a simulated interrupt or for an
+ *   inter-processor interrupt. The signal is taken synchronously and it is
+ *   latched, its handler runs when the Idle task enables the interrupts.
+ *
+ ****************************************************************************/
+
+static void host_smp_entersleep(void)
+{
+  sigset_t set, old_set;
+  siginfo_t si;
+  int sig;
+
+  host_irq_sigset(&set);
+  sigaddset(&set, HOST_IPI_SIGNAL);
+  pthread_sigmask(SIG_BLOCK, &set, &old_set);
+
+  /* An interrupt latched before the signals were blocked wakes us up */
+
+  if (g_host_int_pending != 0) {
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    return;
+  }
+
+  host_kernel_unlock();
+
+  do {
+    sig = sigwaitinfo(&set, &si);
+  } while (sig < 0 && errno == EINTR);
+
+  host_kernel_lock();
+
+  g_host_int_pending |= host_signal_pending_bit(sig);
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+}
+
+/****************************************************************************
+ * Name: host_virtual_time_idle
+ *
+ * Description:
+ *   Raise the next simulated interrupt when the OS is idle in the virtual
+ *   time mode. The input on stdin is taken first, then the virtual clock
+ *   jumps to the armed alarm. When there is nothing left to wait for but
+ *   the input we block on stdin and the simulation ends with it.
+ *
+ ****************************************************************************/
+
+static void host_virtual_time_idle(void)
+{
+  struct pollfd pfd = { .fd = 0, .events = POLLIN };
+
+  while (1) {
+    if (g_uart_peripheral.is_peripheral_ready && !g_uart_rx_eof &&
+        poll(&pfd, 1, 0) > 0) {
+      host_uart_fill_fifo();
+    }
+
+    if (g_uart_peripheral.uart_reg_read_index !=
+        g_uart_peripheral.uart_reg_write_index &&
+        host_uart_rx_has_room()) {
+      g_uart_raised_us = g_virtual_now_us;
+      __atomic_fetch_or(&g_host_int_pending, SIM_IRQ_UART_PENDING,
+                        __ATOMIC_RELAXED);
+      return;
+    }
+
+    if (g_alarm_deadline_us != 0) {
+      if (g_alarm_deadline_us > g_virtual_now_us) {
+        g_virtual_now_us = g_alarm_deadline_us;
+      }
+
+      __atomic_fetch_or(&g_host_int_pending, SIM_IRQ_SYSTICK_PENDING,
+                        __ATOMIC_RELAXED);
+      return;
+    }
+
+    if (g_uart_rx_eof) {
+      exit(0);
+    }
+
+    /* Wait for the input, or for ever when it can't be taken */
+
+    if (!g_uart_peripheral.is_peripheral_ready ||
+        host_uart_fifo_space() == 0) {
+      pause();
+    } else {
+      poll(&pfd, 1, -1);
+    }
+  }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: board_entersleep
+ *
+ * Description:
+ *   Block the host thread until a simulated interrupt arrives. It is called
+ *   from the Idle task with the interrupts disabled. The host signals are
+ *   blocked while we look for a latched interrupt and sigsuspend unblocks
+ *   them and waits atomically so a signal can't be lost in between. The
+ *   signal that wakes us up is latched and replayed by cpu_enableint. With
+ *   several CPUs the kernel lock is released while we wait.
+ *
+ ****************************************************************************/
+
+void board_entersleep(void)
+{
+  sigset_t set, old_set;
+
+  if (g_virtual_time) {
+    host_virtual_time_idle();
+    return;
+  }
+
+  if (g_host_num_cpus > 1) {
+    host_smp_entersleep();
+    return;
+  }
+
+  host_irq_sigset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, &old_set);
+
+  if (g_host_int_pending == 0) {
+    set = old_set;
+    sigdelset(&set, SIGALRM);
+    sigdelset(&set, SIGUSR2);
+    sigdelset(&set, HOST_FLASH_SIGNAL);
+    sigsuspend(&set);
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+}
+
+/****************************************************************************
+ * Name: host_console_putc
+ *
+ * Description:
+ *   This function prints out one character to the console. It is invoked from
+ *   the lower layer UART to show a character to the console. In a hardware
+ *   build this function should be responsible for storing the character in
+ *   the UART peripheral register taht will later be transfered on the wire.
+ *
+ * Input Parameters:
+ *   c    - the character that will be printed to the console
+ *
+ * Assumptions/Limitations:
+ *   Anything else that one might need to know to use this function.
+ *
+ ****************************************************************************/
+
+void host_console_putc(int c)
+{
+  write(1, &c, 1);
+}
+
+/****************************************************************************
+ * Name: host_simulated_systick
+ *
+ * Description:
+ *   Simulate a tick event using a host timer. This function sets up the
+ *   signal mask for the host process in which we run Caypso OS, it sets
+ *   up a timer and it fires it every period_us microseconds.
+ *   It is called from the board control logic during initialization.
+ *
+ * Input Parameters:
+ *   period_us - the tick period in microseconds
+ *
+ ****************************************************************************/
+
+void host_simulated_systick(int period_us)
+{
+  int ret;
+  struct sigaction act;
+  sigset_t set;
+
+  /* Enable all the signals */
+
+  sigfillset(&set);
+  pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+
+  act.sa_sigaction = host_signal_handler;
+  sigemptyset(&act.sa_mask);
+  sigaddset(&act.sa_mask, SIGUSR2);
+  sigaddset(&act.sa_mask, SIGPROF);
+  sigaddset(&act.sa_mask, HOST_FLASH_SIGNAL);
+  act.sa_flags = SA_SIGINFO | SA_RESTART;
+
+  if ((ret = sigaction(SIGALRM, &act, NULL)) != 0) {
+      _err("%d signal handler", ret);
+  }
+
+  g_tick_period_us = period_us;
+  g_tick_start_us  = host_get_monotonic_us();
+
+  host_timer_arm(g_tick_start_us + period_us, period_us);
+}
+
+/****************************************************************************
+ * Name: host_tickless_init
+ *
+ * Description:
+ *   Prepare the one-shot host timer used in tickless mode. The ticks are
+ *   counted from now using the OS clock and the timer is armed only when
+ *   the scheduler has a deadline. With the virtual time the deadline is
+ *   only recorded, the Idle task jumps to it.
+ *
+ * Input Parameters:
+ *   period_us - the duration of a scheduler tick in microseconds
+ *
+ ****************************************************************************/
+
+void host_tickless_init(int period_us)
+{
+  int ret;
+  struct sigaction act;
+
+  g_tick_period_us = period_us;
+  g_tick_start_us  = host_get_clock_us();
+  g_tick_oneshot   = 1;
+
+  act.sa_sigaction = host_signal_handler;
+  sigemptyset(&act.sa_mask);
+  sigaddset(&act.sa_mask, SIGUSR2);
+  sigaddset(&act.sa_mask, SIGPROF);
+  sigaddset(&act.sa_mask, HOST_FLASH_SIGNAL);
+  act.sa_flags = SA_SIGINFO | SA_RESTART;
+
+  if ((ret = sigaction(SIGALRM, &act, NULL)) != 0) {
+      _err("%d signal handler", ret);
+  }
+}
+
+/****************************************************************************
+ * Name: host_profile_timer
+ *
+ * Description:
+ *   Arm the host profiling timer to raise the profiling interrupt every
+ *   period_us microseconds of CPU time consumed by the simulation. The time
+ *   spent blocked in board_entersleep is not sampled.
+ *
+ * Input Parameters:
+ *   period_us - the sampling period in microseconds, 0 stops the timer
+ *
+ ****************************************************************************/
+
+void host_profile_timer(int period_us)
+{
+  struct itimerval it;
+
+  it.it_interval.tv_sec  = period_us / 1000000;
+  it.it_interval.tv_usec = period_us % 1000000;
+  it.it_value            = it.it_interval;
+
+  if (setitimer(ITIMER_PROF, &it, NULL) < 0) {
+    _err("%d settimer\n", errno);
+  }
+}
+
+/****************************************************************************
+ * Name: board_clock_get_us
+ *
+ * Description:
+ *   Read a free running microsecond counter, it wraps after 2^32 us.
+ *
+ ****************************************************************************/
+
+uint32_t board_clock_get_us(void)
+{
+  return (uint32_t)host_get_clock_us();
+}
+
+/****************************************************************************
+ * Name: board_tickless_get_ticks
+ *
+ * Description:
+ *   Get the number of scheduler ticks elapsed since host_tickless_init.
+ *
+ ****************************************************************************/
+
+uint32_t board_tickless_get_ticks(void)
+{
+  return (host_get_clock_us() - g_tick_start_us) / g_tick_period_us;
+}
+
+/****************************************************************************
+ * Name: board_tickless_set_alarm
+ *
+ * Description:
+ *   Arm the one-shot host timer to raise the SysTick interrupt when the
+ *   scheduler reaches the specified tick. A deadline from the past fires
+ *   right away.
+ *
+ * Input Parameters:
+ *   tick - the absolute tick of the next deadline
+ *
+ ****************************************************************************/
+
+void board_tickless_set_alarm(uint32_t tick)
+{
+  uint64_t now_us = host_get_clock_us() - g_tick_start_us;
+  uint32_t now    = now_us / g_tick_period_us;
+  int64_t delay_us;
+
+  /* Compare the ticks by their difference so the wrap around is handled */
+
+  delay_us = (int64_t)(int32_t)(tick - now) * g_tick_period_us -
+    (int64_t)(now_us % g_tick_period_us);
+
+  if (delay_us <= 0) {
+    delay_us = 1;
+  }
+
+  g_alarm_deadline_us = g_tick_start_us + now_us + delay_us;
+
+  if (!g_virtual_time) {
+    host_timer_arm(g_alarm_deadline_us, 0);
+  }
+}
+
+/****************************************************************************
+ * Name: board_tickless_cancel_alarm
+ *
+ * Description:
+ *   Disarm the one-shot host timer when there is no pending deadline.
+ *
+ ****************************************************************************/
+
+void board_tickless_cancel_alarm(void)
+{
+  g_alarm_deadline_us = 0;
+
+  if (!g_virtual_time) {
+    host_timer_arm(0, 0);
+  }
+}
+
+/****************************************************************************
+ * Name: cpu_getid
+ *
+ * Description:
+ *   Get the number of the simulated CPU that runs the caller.
+ *
+ ****************************************************************************/
+
+int cpu_getid(void)
+{
+  return g_host_cpu_id;
+}
+
+/****************************************************************************
+ * Name: cpu_send_ipi
+ *
+ * Description:
+ *   Wake up a simulated CPU from board_entersleep. A CPU that is not
+ *   sleeping finds the signal pending and its next sleep returns at once.
+ *
+ ****************************************************************************/
+
+void cpu_send_ipi(int cpu)
+{
+  if (cpu >= 0 && cpu < g_host_num_cpus) {
+    pthread_kill(g_host_cpus[cpu], HOST_IPI_SIGNAL);
+  }
+}
+
+/****************************************************************************
+ * Name: cpu_kernel_yield
+ *
+ * Description:
+ *   Hand the kernel lock to the next CPU that waits for it and wait for our
+ *   next turn. It returns at once if no other CPU is waiting.
+ *
+ ****************************************************************************/
+
+void cpu_kernel_yield(void)
+{
+  sigset_t set, old_set;
+
+  if (g_host_num_cpus == 1) {
+    return;
+  }
+
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, &old_set);
+
+  pthread_mutex_lock(&g_kernel_lock);
+
+  if (g_kernel_next_ticket - g_kernel_now_serving > 1) {
+    unsigned int ticket = g_kernel_next_ticket++;
+
+    g_kernel_now_serving++;
+    pthread_cond_broadcast(&g_kernel_lock_cond);
+
+    while (ticket != g_kernel_now_serving) {
+      pthread_cond_wait(&g_kernel_lock_cond, &g_kernel_lock);
+    }
+  }
+
+  pthread_mutex_unlock(&g_kernel_lock);
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+}
+
+/****************************************************************************
+ * Name: cpu_start_secondaries
+ *
+ * Description:
+ *   Start the simulated CPUs 1 to num_cpus - 1, the caller is CPU 0 and it
+ *   holds the kernel lock. The inter-processor interrupt signal stays
+ *   blocked, board_entersleep waits for it.
+ *
+ ****************************************************************************/
+
+void cpu_start_secondaries(int num_cpus)
+{
+  sigset_t set;
+
+  if (num_cpus > HOST_MAX_CPUS) {
+    num_cpus = HOST_MAX_CPUS;
+  }
+
+  sigemptyset(&set);
+  sigaddset(&set, HOST_IPI_SIGNAL);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  g_host_cpus[0]  = pthread_self();
+  g_host_num_cpus = num_cpus;
+
+  for (int i = 1; i < num_cpus; i++) {
+    if (pthread_create(&g_host_cpus[i], NULL, host_cpu_entry,
+                       (void *)(intptr_t)i) != 0) {
+      _err("%d start CPU\n", i);
+    }
+  }
+}
+
+/**************************************************************************
+ * Name:
+ *  cpu_disableint
+ *
+ * Description:
+ *  Disable all interrupts. The signal handler only latches the simulated
+ *  interrupts while the flag is set, the host signal mask is not touched.
+ *
+ *************************************************************************/
+
+irq_state_t cpu_disableint(void)
+{
+  irq_state_t irq_state = g_host_int_disabled ? SIM_IRQ_DISABLED : 0;
+
+  g_host_int_disabled = 1;
+  SIM_IRQ_BARRIER();
+
+  return irq_state;
+}
+
+/**************************************************************************
+ * Name:
+ *  cpu_enableint
+ *
+ * Description:
+ *  Restore the interrupts state saved by cpu_disableint. When they become
+ *  enabled the interrupts latched in the meantime are handled first, with
+ *  the interrupts disabled as in the signal handler.
+ *
+ *************************************************************************/
+
+void cpu_enableint(irq_state_t last_state)
+{
+  if (last_state & SIM_IRQ_DISABLED) {
+    return;
+  }
+
+  SIM_IRQ_BARRIER();
+  g_host_int_disabled = 0;
+  SIM_IRQ_BARRIER();
+
+  /* A signal that arrives from now on runs its handler directly */
+
+  while (g_host_int_pending != 0) {
+    g_host_int_disabled = 1;
+    SIM_IRQ_BARRIER();
+
+    host_replay_interrupts();
+
+    SIM_IRQ_BARRIER();
+    g_host_int_disabled = 0;
+    SIM_IRQ_BARRIER();
+  }
+}
+
+/****************************************************************************
+ * Name: host_sim_flash_submit
+ *
+ * Description:
+ *   Hand a transfer to the simulated flash controller. The host I/O loop
+ *   moves the data and raises FLASH_IRQ when it is done, the result is read
+ *   with host_sim_flash_get_result. Only one transfer can be in flight.
+ *
+ * Input Arguments:
+ *   is_write - non zero to write the buffer to the flash
+ *   buffer   - the data to write or the place where we store the data
+ *   sector   - the sector number
+ *   count    - the number of bytes to move
+ *
+ * Returned Value:
+ *   0 if the transfer started otherwise a negative error code.
+ *
+ ****************************************************************************/
+
+int host_sim_flash_submit(int is_write, uint8_t *buffer, uint32_t sector,
+                          size_t count)
+{
+  struct host_flash_request_s *req = &g_flash_request;
+
+  if (__atomic_load_n(&req->pending, __ATOMIC_ACQUIRE)) {
+    return -EBUSY;
+  }
+
+  req->is_write = is_write;
+  req->buffer   = buffer;
+  req->sector   = sector;
+  req->count    = count;
+  req->result   = 0;
+  __atomic_store_n(&req->pending, 1, __ATOMIC_RELEASE);
+
+#ifdef __linux__
+  if (!g_virtual_time) {
+    host_io_kick();
+    return 0;
+  }
+#endif
+
+  /* Without the I/O loop the transfer runs now and it completes at once */
+
+  host_sim_flash_complete();
+  return 0;
+}
+
+/****************************************************************************
+ * Name: host_sim_flash_get_result
+ *
+ * Description:
+ *   Get the result of the last simulated flash transfer.
+ *
+ * Returned Value:
+ *   The number of bytes moved, a negative error code or -EBUSY if the
+ *   transfer did not finish yet.
+ *
+ ****************************************************************************/
+
+int host_sim_flash_get_result(void)
+{
+  struct host_flash_request_s *req = &g_flash_request;
+
+  if (__atomic_load_n(&req->pending, __ATOMIC_ACQUIRE)) {
+    return -EBUSY;
+  }
+
+  return req->result;
+}
+
+/****************************************************************************
+ * Name: host_uart_rx_resume
+ *
+ * Description:
+ *   Tell the host I/O loop that the simulated UART FIFO has room. It is
+ *   called when the UART is opened and from its interrupt handler after the
+ *   FIFO is drained, the loop only watches stdin again if it stopped.
+ *
+ ****************************************************************************/
+
+void host_uart_rx_resume(void)
+{
+#ifdef __linux__
+  if (!g_virtual_time &&
+      __atomic_load_n(&g_uart_rx_stalled, __ATOMIC_SEQ_CST) &&
+      !g_uart_rx_eof) {
+    host_io_kick();
+  }
+#endif
+}
+
+/****************************************************************************
+ * Name: host_console_write
+ *
+ * Description:
+ *   Print a buffer to the console with a single host write.
+ *
+ * Input Parameters:
+ *   buffer - the characters to print
+ *   len    - the number of characters
+ *
+ ****************************************************************************/
+
+void host_console_write(const void *buffer, size_t len)
+{
+  const uint8_t *data = buffer;
+
+  while (len > 0) {
+    ssize_t ret = write(1, data, len);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (ret <= 0) {
+      return;
+    }
+
+    data += ret;
+    len  -= ret;
+  }
+}
+
+/****************************************************************************
+ * Name: main
  *
  * Description:
  *   Main entry point for the simulation. This function calls the entry point
@@ -518,6 +1764,10 @@ int main(int argc, char **argv)
 
   host_sim_flash_open();
 
+  /* The OS clock runs on the virtual time from the start */
+
+  g_virtual_time = host_sim_virtual_time();
+
   /* Create interrupts thread for this simulation */
 
   host_create_interrupt_thread();
@@ -526,6 +1776,12 @@ int main(int argc, char **argv)
 
   pthread_sigmask(SIG_UNBLOCK, &newset, NULL);
 
+  /* The OS runs on CPU 0 with the kernel lock, the other simulated CPUs
+   * wait for it once the scheduler starts them.
+   */
+
+  host_kernel_lock();
+
   /* Start the Calypso OS simulation */
 
   __start();
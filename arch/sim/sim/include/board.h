@@ -15,6 +15,40 @@ void board_init(void);
 
 void board_entersleep(void);
 
+#ifdef CONFIG_BOARD_CLOCK_US
+uint32_t board_clock_get_us(void);
+#endif
+
+#ifdef CONFIG_BOARD_PROFILE_TIMER
+void board_profile_timer(unsigned int frequency);
+#endif
+
+#ifdef CONFIG_BOARD_IRQ_TIMESTAMP
+int board_irq_get_raised_us(uint32_t *raised_us);
+#endif
+
+#ifdef CONFIG_BOARD_SMP
+/****************************************************************************
+ * Multiprocessor functions
+ ****************************************************************************/
+
+int cpu_getid(void);
+
+void cpu_send_ipi(int cpu);
+
+void cpu_kernel_yield(void);
+
+void cpu_start_secondaries(int num_cpus);
+#endif
+
+#ifdef CONFIG_SCHEDULER_TICKLESS
+uint32_t board_tickless_get_ticks(void);
+
+void board_tickless_set_alarm(uint32_t tick);
+
+void board_tickless_cancel_alarm(void);
+#endif
+
 /****************************************************************************
  * Task management functions
  ****************************************************************************/
@@ -7,7 +7,11 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
-#define CONFIG_SIM_LPUART_FIFO_SIZE   (32)
+/* The host I/O loop reads stdin in bulk into the FIFO, the size is a power
+ * of two so the indexes wrap with a mask.
+ */
+
+#define CONFIG_SIM_LPUART_FIFO_SIZE   (1024)
 
 /****************************************************************************
  * Public Types
@@ -18,6 +22,8 @@
 typedef enum {
   UART_0_IRQ   = 0,
   SYSTICK_IRQ  = 1,
+  PROFILE_IRQ  = 2,
+  FLASH_IRQ    = 3,
   NUM_IRQS
 } IRQn_Type;
 
@@ -25,8 +31,8 @@ typedef enum {
 
 typedef struct {
   uint8_t sim_uart_data_fifo[CONFIG_SIM_LPUART_FIFO_SIZE];
-  uint8_t uart_reg_read_index;  /* The read index is incremented when we read data from the FIFO */
-  uint8_t uart_reg_write_index; /* The write index is incremented when we put data in the FIFO */
+  volatile uint16_t uart_reg_read_index;  /* The read index is incremented when we read data from the FIFO */
+  volatile uint16_t uart_reg_write_index; /* The write index is incremented when we put data in the FIFO */
   uint8_t is_peripheral_ready;
 } sim_uart_peripheral_t;
 
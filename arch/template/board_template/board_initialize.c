@@ -44,7 +44,7 @@ int cpu_inittask(struct tcb_s *tcb, int argc, char **argv)
 }
 
 /*
- * cpu_destroytask - creates the initial state for a task
+ * cpu_destroytask - releases the CPU state of a halted task
  *
  */
 void cpu_destroytask(tcb_t *tcb)
@@ -107,7 +107,7 @@ static void bme680_sensor_delay_ms(uint32_t period)
   // TODO : implement with sem_timedwait(...) if the chip is not able
   // to give an interrrupt when samples are ready
 
-  usleep(period * 100);
+  usleep(period * 1000);
 }
 
 static int8_t bme680_sensor_spi_read(uint8_t dev_id, uint8_t reg_addr,
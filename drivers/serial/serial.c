@@ -81,38 +81,16 @@ static int uart_read(struct opened_resource_s *res, void *buf, size_t count)
     return -EINVAL;
   }
 
-  do {
-    uint8_t available_rx_bytes = 0;
-
-    sem_wait((sem_t *)&lower->lock);
+  /* The ring is lock free, wait only when it is empty */
 
-    if (lower->index_read_rx_buffer < lower->index_write_rx_buffer)
-    {
-      available_rx_bytes = lower->index_write_rx_buffer -
-        lower->index_read_rx_buffer;
-    }
-    else if (lower->index_read_rx_buffer != lower->index_write_rx_buffer)
+  do {
+    uint32_t num_bytes = ring_pop(&lower->rx_ring, buf, count);
+    if (num_bytes > 0 || count == 0)
     {
-      available_rx_bytes = UART_RX_BUFFER -
-      (lower->index_read_rx_buffer - lower->index_write_rx_buffer);
+      return num_bytes;
     }
 
-    uint8_t min_copy = count > available_rx_bytes ? available_rx_bytes : count;
-    if (available_rx_bytes > 0)
-    {
-      memcpy(buf, lower->rx_buffer + lower->index_read_rx_buffer, min_copy);
-
-      lower->index_read_rx_buffer += min_copy;
-      lower->index_read_rx_buffer = lower->index_read_rx_buffer % UART_RX_BUFFER;
-      sem_post((sem_t *)&lower->lock);
-
-      return min_copy;
-    }
-    else
-    {
-      sem_post((sem_t *)&lower->lock);
-      sem_wait(&lower->rx_notify);
-    }
+    sem_wait(&lower->rx_notify);
   } while (1);
 
   return 0;
@@ -12,10 +12,13 @@
  * Public Definitionse
  ****************************************************************************/
 
-/* These functions are linked with the host symbols */
+/* These functions are linked with the host symbols. The host moves the
+ * data in the background and raises FLASH_IRQ when the transfer is done.
+ */
 
-int host_sim_flash_read_mtd(uint8_t *buffer, uint32_t sector, size_t count);
-int host_sim_flash_write_mtd(uint8_t *buffer, uint32_t sector, size_t count);
+int host_sim_flash_submit(int is_write, uint8_t *buffer, uint32_t sector,
+                          size_t count);
+int host_sim_flash_get_result(void);
 
 /****************************************************************************
  * Private Data Types
@@ -24,7 +27,8 @@ int host_sim_flash_write_mtd(uint8_t *buffer, uint32_t sector, size_t count);
 /* The simulated flash private data */
 
 typedef struct sim_flash_priv_s {
-  sem_t lock;
+  sem_t lock;                   /* One transfer at a time */
+  sem_t xfer_done;              /* Posted from the completion interrupt */
   int opened_count;
 } sim_flash_priv_t;
 
@@ -143,6 +147,44 @@ static int sim_flash_ioctl(struct opened_resource_s *priv,
   return ret;
 }
 
+/*
+ * sim_flash_int - The simulated flash transfer completion interrupt.
+ */
+static void sim_flash_int(void)
+{
+  sem_post(&g_sim_private_data.xfer_done);
+}
+
+/*
+ * sim_flash_xfer - Move data between a buffer and the simulated flash.
+ *
+ * @is_write  - true to write the buffer to the flash
+ * @buffer    - the data
+ * @sector    - the requested sector number
+ * @count     - the size of the data
+ *
+ * The caller sleeps until the completion interrupt. Before the scheduler
+ * runs sem_wait can't block and we poll the semaphore instead.
+ *
+ * Returns the number of bytes moved or a negative error code.
+ */
+static int sim_flash_xfer(bool is_write, uint8_t *buffer, uint32_t sector,
+                          size_t count)
+{
+  int ret;
+
+  sem_wait(&g_sim_private_data.lock);
+
+  ret = host_sim_flash_submit(is_write, buffer, sector, count);
+  if (ret == OK) {
+    while (sem_wait(&g_sim_private_data.xfer_done) == -EAGAIN);
+    ret = host_sim_flash_get_result();
+  }
+
+  sem_post(&g_sim_private_data.lock);
+  return ret;
+}
+
 /*
  * sim_flash_mtd_read_block - Read blocks from the simulated flash.
  *
@@ -154,7 +196,7 @@ static int sim_flash_ioctl(struct opened_resource_s *priv,
 static int sim_flash_mtd_read_block(uint8_t *buffer, uint32_t sector,
                                     size_t count)
 {
-  return host_sim_flash_read_mtd(buffer, sector, count);
+  return sim_flash_xfer(false, buffer, sector, count);
 }
 
 /*
@@ -168,7 +210,7 @@ static int sim_flash_mtd_read_block(uint8_t *buffer, uint32_t sector,
 static int sim_flash_mtd_write_block(const uint8_t *buffer, uint32_t sector,
                                      size_t count)
 {
-  return host_sim_flash_write_mtd((uint8_t *)buffer, sector, count);
+  return sim_flash_xfer(true, (uint8_t *)buffer, sector, count);
 }
 
 /****************************************************************************
@@ -183,7 +225,9 @@ static int sim_flash_mtd_write_block(const uint8_t *buffer, uint32_t sector,
  */
 int sim_flash_init(void)
 {
-  sem_init(&g_sim_private_data.lock, 0, 0);
+  sem_init(&g_sim_private_data.lock, 0, 1);
+  sem_init(&g_sim_private_data.xfer_done, 0, 0);
+  irq_attach(FLASH_IRQ, sim_flash_int);
 
   return vfs_register_node(CONFIG_SIM_FLASH_NAME,
                            strlen(CONFIG_SIM_FLASH_NAME),
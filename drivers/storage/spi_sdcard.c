@@ -1,4 +1,6 @@
 #include <spi_sdcard.h>
+#include <scheduler.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <errno.h>
 #include <gpio.h>
@@ -47,6 +49,17 @@
 #define SD_TOKEN_FLOATING_BUS                 (0xFF)
 #define SD_CMD_SET_WRITE_BLOCK                (0x18)
 
+/* The SD specification limits for the card initialization, the read access
+ * time and the write busy time.
+ */
+
+#define SD_INIT_TIMEOUT_MS                    (1000)
+#define SD_READ_TIMEOUT_MS                    (100)
+#define SD_WRITE_TIMEOUT_MS                   (250)
+
+#define SD_READ_MAX_RETRIES                   (100)
+#define SD_WRITE_MAX_RETRIES                  (65000)
+
 #define SD_LOGICAL_BLOCK_SIZE                 (512)
 #define SD_CRC_BLOCK_SIZE                     (2)
 
@@ -66,6 +79,15 @@ struct sd_card_s {
   enum card_type_e type;
 };
 
+/* A bounded wait for the card. When the board drives the scheduler tick the
+ * wait is bounded in time, otherwise we count the attempts.
+ */
+
+struct sd_wait_s {
+  uint32_t deadline;
+  int attempts;
+};
+
 /****************************************************************************
  * Private Function Definitions
  ****************************************************************************/
@@ -252,6 +274,38 @@ static void sd_spi_send_cmd(uint8_t cmd, uint32_t arguments)
 #endif
 }
 
+/*
+ * sd_wait_start - start a bounded wait
+ *
+ * @wait         - the wait state
+ * @timeout_ms   - the maximum time that we wait for the card
+ * @max_attempts - the number of attempts if we don't have the scheduler tick
+ *
+ */
+static void sd_wait_start(struct sd_wait_s *wait, uint32_t timeout_ms,
+                          int max_attempts)
+{
+  /* One more tick because the current one is already partially elapsed */
+
+  wait->deadline = sched_get_ticks() + SCHED_MS_TO_TICKS(timeout_ms) + 1;
+  wait->attempts = max_attempts;
+}
+
+/*
+ * sd_wait_expired - verify if a bounded wait expired
+ *
+ * @wait - the wait state
+ *
+ */
+static bool sd_wait_expired(struct sd_wait_s *wait)
+{
+#ifdef CONFIG_SCHEDULER_TICK
+  return (int32_t)(sched_get_ticks() - wait->deadline) >= 0;
+#else
+  return --wait->attempts <= 0;
+#endif
+}
+
 /*
  * sd_spi_read - helper function to read SPI datad
  *
@@ -353,7 +407,7 @@ static int sd_spi_ioctl(struct opened_resource_s *prov, unsigned long request,
 int sd_spi_init(spi_master_dev_t *spi)
 {
   uint8_t spi_rsp;
-  int retry_counter = 0;
+  struct sd_wait_s wait;
 
   g_sd_spi = spi;
   sd_generate_crc_table();
@@ -395,7 +449,6 @@ int sd_spi_init(spi_master_dev_t *spi)
     }
   }
 
-  int counter = 0;
   uint8_t cmd = SPI_SD_SEND_OP_COND_CMD;
 
   LOG_INFO("Send CMD55");
@@ -404,8 +457,8 @@ int sd_spi_init(spi_master_dev_t *spi)
 
   LOG_INFO("Response: 0x%x", spi_rsp);
 
+  sd_wait_start(&wait, SD_INIT_TIMEOUT_MS, SPI_MAX_RESET_RETRIES);
   do {
-    counter++;
     LOG_INFO("Send %s", cmd == SPI_SD_SEND_OP_COND_CMD ? "ACMD41" : "CMD 1");
     sd_spi_send_cmd(cmd, 0x40000000);
     spi_rsp = sd_read_byte_ignore_char(0xFF);
@@ -418,11 +471,11 @@ int sd_spi_init(spi_master_dev_t *spi)
       cmd = SPI_SD_SEND_OP_COND_CMD;
     }
 
-  } while (spi_rsp != 0 && counter < SPI_MAX_RESET_RETRIES);
+  } while (spi_rsp != 0 && !sd_wait_expired(&wait));
 
-  if (counter == SPI_MAX_RESET_RETRIES) {
+  if (spi_rsp != 0) {
     LOG_ERR("cannot reset 0x%x\r\n", spi_rsp);
-    return -EINVAL;
+    return -ETIMEDOUT;
   }
 
   sd_spi_send_cmd(SPI_READ_OCR, 0);
@@ -535,8 +588,9 @@ static int sd_spi_read_logical_block(spi_master_dev_t *spi,
                                      uint8_t offset_in_lba,
                                      size_t requested_read_size)
 {
-  int timer = 100, trailing_bytes;
+  int trailing_bytes;
   uint8_t spi_rsp;
+  struct sd_wait_s wait;
 
   /* Some mandatory checks */
   if (spi == NULL ||
@@ -567,15 +621,18 @@ static int sd_spi_read_logical_block(spi_master_dev_t *spi,
     return -ENOSYS;
   }
 
+  /* Wait for the start of the data block */
+
+  sd_wait_start(&wait, SD_READ_TIMEOUT_MS, SD_READ_MAX_RETRIES);
   sd_spi_set_cs(0);
   do {
     sd_spi_read(&spi_rsp, 1);
-  } while (--timer > 0 && spi_rsp != 0xFE);
+  } while (spi_rsp != SD_TOKEN_START && !sd_wait_expired(&wait));
   sd_spi_set_cs(1);
 
-  if (timer == 0 && spi_rsp != 0xFE) {
+  if (spi_rsp != SD_TOKEN_START) {
     LOG_ERR("timeout trying to read block %d\n", lba_index);
-    return -ENOSYS;
+    return -ETIMEDOUT;
   }
 
   trailing_bytes = (SD_LOGICAL_BLOCK_SIZE + SD_CRC_BLOCK_SIZE) - offset_in_lba
@@ -619,8 +676,8 @@ static int sd_spi_write_logical_block(spi_master_dev_t *spi,
                                       uint8_t offset_in_lba,
                                       size_t requested_write_size)
 {
-  int timer = 100, trailing_bytes;
   uint8_t spi_rsp;
+  struct sd_wait_s wait;
 
   /* Some mandatory checks */
   if (spi == NULL ||
@@ -675,8 +732,17 @@ static int sd_spi_write_logical_block(spi_master_dev_t *spi,
   sd_spi_write(0x00);
   sd_spi_write(0x00);
 
-  for (int bc = 65000; sd_spi_write(0xFF) != 0xFF && bc; bc--);
+  /* The card keeps the line low while it is busy programming the block */
+
+  sd_wait_start(&wait, SD_WRITE_TIMEOUT_MS, SD_WRITE_MAX_RETRIES);
+  while ((spi_rsp = sd_spi_write(0xFF)) != 0xFF && !sd_wait_expired(&wait));
 
   sd_spi_set_cs(1);
+
+  if (spi_rsp != 0xFF) {
+    LOG_ERR("timeout trying to write block %d\n", lba_index);
+    return -ETIMEDOUT;
+  }
+
   return 0;
 }
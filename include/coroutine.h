@@ -0,0 +1,154 @@
+#ifndef __COROUTINE_H
+#define __COROUTINE_H
+
+#include <board.h>
+
+#include <errno.h>
+#include <list.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/****************************************************************************
+ * Preprocessor Definitions
+ ****************************************************************************/
+
+#define CORO_WAIT_FOREVER           SEM_WAIT_FOREVER
+
+/* What a coroutine body returns to its runner */
+
+#define CORO_YIELDED                (0)   /* Run it again after the others */
+#define CORO_BLOCKED                (1)   /* It waits for a sema or a timeout */
+#define CORO_EXITED                 (2)   /* It reached CORO_END or CORO_EXIT */
+
+/* The body of a coroutine is a function that returns at every wait point
+ * and jumps back to it on the next call, like a protothread. The local
+ * variables are lost across a wait, keep the state in a structure reached
+ * from the argument. A wait point can't be placed in a switch statement
+ * and there can't be two wait points on the same line.
+ *
+ * static int blink(coro_t *coro, void *arg)
+ * {
+ *   CORO_BEGIN(coro);
+ *   for (;;)
+ *   {
+ *     gpio_toggle(arg);
+ *     CORO_SLEEP(coro, 500);
+ *   }
+ *   CORO_END(coro);
+ * }
+ */
+
+#define CORO_BEGIN(coro)                                                    \
+  switch ((coro)->resume_line) { case 0:
+
+#define CORO_END(coro)                                                      \
+  } (coro)->resume_line = 0; return CORO_EXITED
+
+#define CORO_EXIT(coro)                                                     \
+  do { (coro)->resume_line = 0; return CORO_EXITED; } while (0)
+
+/* Give the CPU to the other coroutines of the runner */
+
+#define CORO_YIELD(coro)                                                    \
+  do {                                                                      \
+    (coro)->resume_line = __LINE__; return CORO_YIELDED; case __LINE__:;    \
+  } while (0)
+
+/* Yield until the condition is true, it is checked each time the runner
+ * gets around to this coroutine.
+ */
+
+#define CORO_WAIT_UNTIL(coro, cond)                                         \
+  do {                                                                      \
+    (coro)->resume_line = __LINE__; case __LINE__:                          \
+    if (!(cond)) return CORO_YIELDED;                                       \
+  } while (0)
+
+/* Block the coroutine for timeout_ms milliseconds */
+
+#define CORO_SLEEP(coro, timeout_ms)                                        \
+  do {                                                                      \
+    coro_prepare_sleep((coro), (timeout_ms));                               \
+    (coro)->resume_line = __LINE__; return CORO_BLOCKED; case __LINE__:;    \
+  } while (0)
+
+/* Take the semaphore or block until it is posted or the timeout expires.
+ * (coro)->wait_result is 0 when the semaphore was taken and -ETIMEDOUT
+ * otherwise.
+ */
+
+#define CORO_SEM_WAIT(coro, sem, timeout_ms)                                \
+  do {                                                                      \
+    (coro)->resume_line = __LINE__;                                         \
+    if (coro_prepare_sem_wait((coro), (sem), (timeout_ms)))                 \
+      return CORO_BLOCKED;                                                  \
+    case __LINE__:;                                                         \
+  } while (0)
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+struct coro_s;
+
+/* The coroutine body, it returns CORO_YIELDED, CORO_BLOCKED or CORO_EXITED */
+
+typedef int (*coro_entry_t)(struct coro_s *coro, void *arg);
+
+/* The coroutine states, a zeroed coroutine is halted */
+
+enum coro_state_e {
+  CORO_HALTED,
+  CORO_READY,
+  CORO_RUNNING,
+  CORO_SLEEPING,
+  CORO_WAITING_FOR_SEM,
+};
+
+/* A kernel task that runs its coroutines one after the other on its stack */
+
+typedef struct coro_sched_s {
+  struct list_head ready_list;    /* FIFO of the coroutines to run */
+  struct list_head timeout_list;  /* Ordered by the wake-up tick */
+  sem_t wakeup;                   /* Posted when a coroutine gets ready */
+} coro_sched_t;
+
+/* The whole state of a coroutine */
+
+typedef struct coro_s {
+  struct list_head node;          /* Ready list or semaphore waiting list */
+  struct list_head timeout_node;  /* Runner timeout list */
+  coro_entry_t entry;
+  void *arg;
+  coro_sched_t *sched;
+  sem_t *waiting_sem;
+  uint32_t wake_tick;
+  int wait_result;
+  uint16_t resume_line;           /* Where the body continues */
+  uint8_t state;
+  bool has_timeout;
+} coro_t;
+
+/****************************************************************************
+ * Public Functions Prototypes
+ ****************************************************************************/
+
+int coro_sched_create(coro_sched_t *sched, const char *name, int priority);
+
+int coro_start(coro_sched_t *sched, coro_t *coro, coro_entry_t entry,
+               void *arg);
+
+int coro_stop(coro_t *coro);
+
+/* Used by the wait macros */
+
+void coro_prepare_sleep(coro_t *coro, int timeout_ms);
+
+bool coro_prepare_sem_wait(coro_t *coro, sem_t *sem, int timeout_ms);
+
+/* Used by sem_post with the interrupts disabled */
+
+void coro_sem_wakeup(sem_t *sem);
+
+#endif /* __COROUTINE_H */
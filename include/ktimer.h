@@ -0,0 +1,67 @@
+#ifndef __KTIMER_H
+#define __KTIMER_H
+
+#include <board.h>
+
+#include <errno.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <worker.h>
+
+/****************************************************************************
+ * Preprocessor Definitions
+ ****************************************************************************/
+
+/* Run the callback in the timer task instead of a worker */
+
+#define KTIMER_NO_WORKER            (-1)
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* The timer callback, it runs in the timer task or in a worker */
+
+typedef void (*ktimer_cb_t)(void *arg);
+
+/* The whole state of a software timer, the caller owns the structure and
+ * it must stay valid until ktimer_delete.
+ */
+
+typedef struct ktimer_s {
+  struct list_head node;          /* Wheel slot or the expired list */
+  ktimer_cb_t callback;
+  void *arg;
+  int worker_id;                  /* KTIMER_NO_WORKER or the worker */
+  worker_cb_t work;               /* Submitted to the worker */
+  uint32_t expire_tick;
+  uint32_t interval_ticks;        /* 0 for a one-shot timer */
+  uint32_t slack_ticks;           /* How late it may expire */
+  uint32_t overrun;               /* Expirations lost by the last run */
+  int8_t wheel_level;             /* -1 when not in a wheel slot */
+  uint8_t wheel_slot;
+  bool is_armed;
+} ktimer_t;
+
+/****************************************************************************
+ * Public Functions Prototypes
+ ****************************************************************************/
+
+int ktimer_init(void);
+
+int ktimer_create(ktimer_t *timer, ktimer_cb_t callback, void *arg,
+                  int worker_id);
+
+int ktimer_settime(ktimer_t *timer, uint32_t value_ms, uint32_t interval_ms);
+
+int ktimer_gettime(ktimer_t *timer, uint32_t *value_ms,
+                   uint32_t *interval_ms);
+
+int ktimer_getoverrun(ktimer_t *timer);
+
+int ktimer_setslack(ktimer_t *timer, uint32_t slack_ms);
+
+int ktimer_delete(ktimer_t *timer);
+
+#endif /* __KTIMER_H */
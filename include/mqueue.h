@@ -0,0 +1,97 @@
+#ifndef __MQUEUE_H
+#define __MQUEUE_H
+
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/****************************************************************************
+ * Preprocessor Definitions
+ ****************************************************************************/
+
+#define MQ_WAIT_FOREVER             SEM_WAIT_FOREVER
+
+/* The message priorities are 0 .. MQ_PRIO_MAX - 1, the highest first */
+
+#define MQ_PRIO_MAX                 (32)
+
+/* The slot sizes are rounded up so the messages stay pointer aligned */
+
+#define MQ_SLOT_SIZE(msgsize)                                               \
+  (((msgsize) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+/* The size of the storage for a queue, use it to provide a pointer aligned
+ * static buffer to mq_init. The slot bookkeeping comes first and then the
+ * messages.
+ */
+
+#define MQ_SLOTS_SIZE(maxmsg)                                               \
+  MQ_SLOT_SIZE((maxmsg) * sizeof(struct mq_slot_s))
+
+#define MQ_BUFFER_SIZE(maxmsg, msgsize)                                     \
+  (MQ_SLOTS_SIZE(maxmsg) + (maxmsg) * MQ_SLOT_SIZE(msgsize))
+
+/****************************************************************************
+ * Public Types 
+ ****************************************************************************/
+
+struct mq_attr {
+  size_t mq_maxmsg;                 /* The number of message slots */
+  size_t mq_msgsize;                /* The maximum message size in bytes */
+};
+
+/* The bookkeeping for a message slot, the slots are linked by index */
+
+struct mq_slot_s {
+  int16_t next;                     /* The next slot in the list or -1 */
+  uint8_t prio;
+  uint8_t reserved;
+  uint16_t len;                     /* The message size */
+};
+
+typedef struct mq_s {
+  struct mq_slot_s *slots;
+  uint8_t *data;                    /* The message slots */
+  size_t slot_size;
+  struct mq_attr attr;
+  int16_t free_head;                /* The unused slots */
+  int16_t head;                     /* The queued messages, highest priority */
+  int16_t tail;                     /* first and FIFO for the same priority */
+  bool owns_buffer;
+  sem_t free_slots;
+  sem_t used_slots;
+} mq_t;
+
+/****************************************************************************
+ * Public Functions Prototypes 
+ ****************************************************************************/
+
+int mq_init(mq_t *mq, const struct mq_attr *attr, void *buffer);
+
+int mq_destroy(mq_t *mq);
+
+int mq_send(mq_t *mq, const void *msg, size_t len, unsigned int prio);
+
+int mq_timedsend(mq_t *mq, const void *msg, size_t len, unsigned int prio,
+                 int timeout_ms);
+
+int mq_trysend(mq_t *mq, const void *msg, size_t len, unsigned int prio);
+
+ssize_t mq_receive(mq_t *mq, void *msg, size_t len, unsigned int *prio);
+
+ssize_t mq_timedreceive(mq_t *mq, void *msg, size_t len, unsigned int *prio,
+                        int timeout_ms);
+
+void *mq_reserve(mq_t *mq, int timeout_ms);
+
+int mq_commit(mq_t *mq, void *slot, size_t len, unsigned int prio);
+
+void *mq_acquire(mq_t *mq, size_t *len, unsigned int *prio, int timeout_ms);
+
+int mq_release(mq_t *mq, void *slot);
+
+int mq_getcount(mq_t *mq);
+
+#endif /* __MQUEUE_H */
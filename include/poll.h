@@ -68,6 +68,17 @@ struct pollfd {
  * Public Functions 
  ****************************************************************************/
 
+/*
+ * poll - wait for I/O events on a set of file descriptors
+ *
+ * @fds     - the file descriptors and the events that we are interested in
+ * @nfds    - the number of entries in fds
+ * @timeout - the timeout in milliseconds, 0 doesn't block and
+ *            POLL_WAIT_FOREVER waits until an event is generated
+ *
+ * Returns the number of file descriptors with events, 0 on timeout or a
+ * negative error code.
+ */
 int poll(struct pollfd fds[], size_t nfds, int timeout);
 
 #endif /* __POLL_H */
@@ -0,0 +1,74 @@
+/*
+ * include/procfs.h
+ *
+ * Created: 17/10/2026
+ *  Author: sene
+ */
+
+#ifndef __PROCFS_H
+#define __PROCFS_H
+
+#include <board.h>
+
+#include <errno.h>
+#include <stdlib.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The directory where the procfs nodes are registered */
+
+#define PROCFS_PATH                     "/proc/"
+
+/* The size of the snapshot taken when a procfs node is opened */
+
+#ifndef CONFIG_PROCFS_BUFFER_SIZE
+  #define CONFIG_PROCFS_BUFFER_SIZE     (1024)
+#endif
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/*
+ * procfs_show_cb - generate the content of a procfs node
+ *
+ * Input Arguments:
+ *  buf       - the buffer where the text is placed
+ *  len       - the size of the buffer
+ *
+ * Return Values:
+ *  The number of characters placed in the buffer.
+ */
+typedef int (*procfs_show_cb)(char *buf, size_t len);
+
+/****************************************************************************
+ * Public Function Definitions
+ ****************************************************************************/
+
+/**************************************************************************
+ * Name:
+ *  procfs_register
+ *
+ * Description:
+ *  Register a read-only node in /proc/. The content is generated by show
+ *  when the node is opened and read() returns it until the end.
+ *
+ * Return Value:
+ *  OK in case of success otherwise a negative value.
+ *
+ *************************************************************************/
+int procfs_register(const char *name, procfs_show_cb show);
+
+/**************************************************************************
+ * Name:
+ *  procfs_init
+ *
+ * Description:
+ *  Register the kernel statistics nodes. Call it after vfs_init.
+ *
+ *************************************************************************/
+void procfs_init(void);
+
+#endif /* __PROCFS_H */
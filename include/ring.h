@@ -0,0 +1,167 @@
+/*
+ * include/ring.h
+ *
+ * Created: 17/10/2026
+ *  Author: sene
+ */
+
+#ifndef __RING_H
+#define __RING_H
+
+#include <board.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Initialize a ring over a static array, its size must be a power of two */
+
+#define RING_INITIALIZER(array)                                             \
+  { .buffer = (uint8_t *)(array), .mask = sizeof(array) - 1 }
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* A single producer, single consumer byte ring. The producer only writes
+ * head and the consumer only writes tail so no lock is needed between a
+ * task and an interrupt handler. Both indices run freely and wrap at 2^32,
+ * head - tail is the number of queued bytes.
+ */
+
+struct ring_s {
+  uint8_t *buffer;
+  uint32_t mask;                    /* The buffer size - 1 */
+  uint32_t head;                    /* The bytes pushed so far */
+  uint32_t tail;                    /* The bytes popped so far */
+};
+
+/****************************************************************************
+ * Public Function Definitions
+ ****************************************************************************/
+
+/**************************************************************************
+ * Name:
+ *  ring_init
+ *
+ * Description:
+ *  Initialize an empty ring over a buffer of size bytes.
+ *
+ * Return Value:
+ *  OK in case of success or -EINVAL if size is not a power of two.
+ *
+ *************************************************************************/
+int ring_init(struct ring_s *ring, void *buffer, uint32_t size);
+
+/**************************************************************************
+ * Name:
+ *  ring_count
+ *
+ * Description:
+ *  The number of bytes that can be popped.
+ *
+ *************************************************************************/
+uint32_t ring_count(struct ring_s *ring);
+
+/**************************************************************************
+ * Name:
+ *  ring_space
+ *
+ * Description:
+ *  The number of bytes that can be pushed.
+ *
+ *************************************************************************/
+uint32_t ring_space(struct ring_s *ring);
+
+/**************************************************************************
+ * Name:
+ *  ring_push
+ *
+ * Description:
+ *  Copy up to len bytes in the ring. Only the producer can call it.
+ *
+ * Return Value:
+ *  The number of bytes copied, less than len when the ring is full.
+ *
+ *************************************************************************/
+uint32_t ring_push(struct ring_s *ring, const void *data, uint32_t len);
+
+/**************************************************************************
+ * Name:
+ *  ring_push_byte
+ *
+ * Description:
+ *  Push a single byte, the fast path for the receive interrupts.
+ *
+ * Return Value:
+ *  OK in case of success or -EAGAIN when the ring is full.
+ *
+ *************************************************************************/
+int ring_push_byte(struct ring_s *ring, uint8_t byte);
+
+/**************************************************************************
+ * Name:
+ *  ring_pop
+ *
+ * Description:
+ *  Copy up to len bytes out of the ring. Only the consumer can call it.
+ *
+ * Return Value:
+ *  The number of bytes copied, less than len when the ring gets empty.
+ *
+ *************************************************************************/
+uint32_t ring_pop(struct ring_s *ring, void *data, uint32_t len);
+
+/**************************************************************************
+ * Name:
+ *  ring_peek_write
+ *
+ * Description:
+ *  Get the largest contiguous free region to fill it in place, for example
+ *  as a DMA destination. Publish the bytes with ring_commit_write.
+ *
+ * Return Value:
+ *  The start of the region, its size is returned in len.
+ *
+ *************************************************************************/
+void *ring_peek_write(struct ring_s *ring, uint32_t *len);
+
+/**************************************************************************
+ * Name:
+ *  ring_commit_write
+ *
+ * Description:
+ *  Publish len bytes written in the region returned by ring_peek_write.
+ *
+ *************************************************************************/
+void ring_commit_write(struct ring_s *ring, uint32_t len);
+
+/**************************************************************************
+ * Name:
+ *  ring_peek_read
+ *
+ * Description:
+ *  Get the largest contiguous region of queued bytes to use them in place.
+ *  Release them with ring_commit_read.
+ *
+ * Return Value:
+ *  The start of the region, its size is returned in len.
+ *
+ *************************************************************************/
+const void *ring_peek_read(struct ring_s *ring, uint32_t *len);
+
+/**************************************************************************
+ * Name:
+ *  ring_commit_read
+ *
+ * Description:
+ *  Release len bytes from the region returned by ring_peek_read.
+ *
+ *************************************************************************/
+void ring_commit_read(struct ring_s *ring, uint32_t len);
+
+#endif /* __RING_H */
@@ -1,6 +1,9 @@
 #ifndef __SEMAPHORE_H
 #define __SEMAPHORE_H
 
+#include <board_cfg.h>
+#include <list.h>
+
 /****************************************************************************
  * Preprocessor Definitions
  ****************************************************************************/
@@ -13,6 +16,10 @@
 
 typedef struct sem_s {
   volatile int count;
+  struct list_head waiting_list;  /* FIFO of the tasks blocked on this sema */
+#ifdef CONFIG_SCHEDULER_COROUTINE
+  struct list_head coro_waiting_list; /* FIFO of the blocked coroutines */
+#endif
 } sem_t;
 
 /****************************************************************************
@@ -23,7 +30,7 @@ int sem_init(sem_t *sem, int pshared, unsigned int value);
 
 int sem_wait(sem_t *sem);
 
-int sem_timedwait(sem_t *sem, int timeout_abs);
+int sem_timedwait(sem_t *sem, int timeout_ms);
 
 int sem_trywait(sem_t *sem);
 
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <ring.h>
 #include <semaphore.h>
 #include <stddef.h>
 
@@ -11,6 +12,9 @@
  ****************************************************************************/
 
 #define UART_TX_BUFFER                      (64)
+
+/* The receive ring size, a power of two */
+
 #define UART_RX_BUFFER                      (64)
 
 /****************************************************************************
@@ -33,13 +37,15 @@ typedef int (*uart_lowerhalf_read)(const struct uart_lower_s *lower,
                                    unsigned int max_buf_sz);
 typedef int (*uart_lowerhalf_ioctl)(const struct uart_lower_s *lower);
 
-/* The lower half structure used by the serial driver */
+/* The lower half structure used by the serial driver. The receive interrupt
+ * is the only producer of rx_ring and the task that reads the device is the
+ * only consumer, rx_notify is posted when new bytes are pushed.
+ */
 
 struct uart_lower_s {
   void *priv;
   uint8_t rx_buffer[UART_RX_BUFFER];
-  uint8_t index_write_rx_buffer;
-  uint8_t index_read_rx_buffer;
+  struct ring_s rx_ring;
   sem_t rx_notify;
   uint8_t tx_buffer[UART_TX_BUFFER];
   sem_t tx_notify;
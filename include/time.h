@@ -0,0 +1,32 @@
+/*
+ * include/time.h
+ *
+ * Created: 17/10/2026
+ */
+
+#ifndef __TIME_H
+#define __TIME_H
+
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define NSEC_PER_USEC                   (1000)
+#define USEC_PER_SEC                    (1000000)
+#define NSEC_PER_SEC                    (1000000000)
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+typedef int32_t time_t;
+
+struct timespec
+{
+  time_t tv_sec;                        /* Seconds */
+  long   tv_nsec;                       /* Nanoseconds [0, 999999999] */
+};
+
+#endif /* __TIME_H */
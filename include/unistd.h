@@ -4,6 +4,7 @@
 #include <board.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 
 typedef int ssize_t;
 
@@ -71,6 +72,38 @@ int close(int fd);
  *************************************************************************/
 int usleep(useconds_t microseconds);
 
+/**************************************************************************
+ * Name:
+ *  nanosleep
+ *
+ * Description:
+ *  Suspend the calling task for at least the interval specified in req. The
+ *  interval is rounded up to the scheduler tick.
+ *
+ * Input Parameters:
+ *  req - the requested interval
+ *  rem - if not NULL it receives the remaining time, the sleep is never
+ *        interrupted so this is always zero
+ *
+ * Return Value:
+ *  Zero on success otherwise a negative value.
+ *
+ *************************************************************************/
+int nanosleep(const struct timespec *req, struct timespec *rem);
+
+/**************************************************************************
+ * Name:
+ *  sleep
+ *
+ * Description:
+ *  Put the calling process into sleep state for 'seconds'
+ *
+ * Return Value:
+ *  Zero when the requested time has elapsed.
+ *
+ *************************************************************************/
+unsigned int sleep(unsigned int seconds);
+
 /**************************************************************************
  * Name:
  *  unlink
@@ -101,7 +101,8 @@ typedef int (*mkdir_cb)(const char *path, mode_t mode);
  *
  * Input Arguments:
  *  priv      - an opened virtual file system node for a task
- *  poll_sema - the poll semaphore
+ *  poll_sema - the poll semaphore that the driver posts when an event is
+ *              generated. NULL removes the poller.
  *  revents   - (out) the receive mask which is set when an event is generated
  *              in the driver code.
  *
@@ -25,6 +25,7 @@
 #include <list.h>
 #include <semaphore.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /****************************************************************************
  * Macros Defintions
@@ -34,10 +35,23 @@
   # define INT_MAX (2147483647)
 #endif
 
+/* The work priorities, the due work with the highest one runs first */
+
+#define WORKER_PRIORITY_LOW           (0)
+#define WORKER_PRIORITY_HIGH          (3)
+#define WORKER_PRIORITY_LEVELS        (WORKER_PRIORITY_HIGH + 1)
+
+/* The work item flags */
+
+#define WORKER_WORK_QUEUED            (1 << 0)  /* Waits in a worker */
+#define WORKER_WORK_ALLOCATED         (1 << 1)  /* A copy made by the enqueue */
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
 
+struct tcb_s;
+
 /* The work callback */
 
 typedef void (* worker_cb)(void *arg); 
@@ -46,25 +60,63 @@ typedef void (* worker_cb)(void *arg);
 
 typedef void (* worker_cleanup_cb)(void *arg);
 
-/* The work structure with the callback and the arguments to the callback */
+/* The work structure with the callback and the arguments to the callback.
+ * It starts zeroed, from worker_work_init or a static definition, and the
+ * caller fills wake_ms, slack_ms, priority, priv_arg, callback and
+ * cleanup_cb.
+ * worker_enqueue keeps a copy and fills the rest. worker_submit queues the
+ * structure of the caller, it must stay valid while WORKER_WORK_QUEUED is
+ * set in flags and its cleanup_cb is not used. A stack or heap structure
+ * with a stale WORKER_WORK_QUEUED bit is refused with -EBUSY.
+ */
 
 typedef struct worker_cb_s {
-  struct list_head work_list;   /* Ordered list of workers */
-  uint32_t wake_ms;             /* Planned to run time */
+  struct list_head node;        /* Entry in a ready list of a worker task */
+  struct worker_cb_s *inbox_next; /* Entry in the submit inbox */
+  volatile uint8_t flags;       /* WORKER_WORK_QUEUED and _ALLOCATED */
+  uint32_t wake_ms;             /* Delay from the enqueue, 0 runs it now */
+  uint32_t slack_ms;            /* How late it may run to share a wakeup */
+  int priority;                 /* From WORKER_PRIORITY_LOW to _HIGH */
   void *priv_arg;               /* Arguments to the worker callback */
   int work_uid;                 /* Unique work id assigned during enqueue */
   worker_cb callback;           /* Callback to the work to be done */
   worker_cleanup_cb cleanup_cb; /* Clean up the arguments passed to callback */
+  uint32_t wake_tick;           /* The scheduler tick when it is due */
+  uint32_t deadline_tick;       /* The last tick of its slack window */
+  uint32_t seq;                 /* Keeps the FIFO order of equal deadlines */
 } worker_cb_t;
 
-/* Worker structure that contains all the work items list */
+/* One task of a worker with its local work. The delayed work waits in a
+ * min-heap by deadline and moves to the ready list of its priority when
+ * it is due.
+ */
+
+typedef struct worker_thread_s {
+  struct worker_s *worker;      /* The worker that owns the task */
+  worker_cb_t **heap;           /* Min-heap of the delayed work by deadline */
+  int heap_count;               /* The number of delayed work items */
+  int heap_capacity;            /* The number of slots in the heap array */
+  struct list_head ready[WORKER_PRIORITY_LEVELS]; /* Due work, FIFO */
+  struct tcb_s *task;           /* The worker task once it runs */
+  sem_t wakeup;                 /* Posted when the task has new work */
+  bool is_idle;                 /* Sleeps with nothing to run or steal */
+} worker_thread_t;
+
+/* Worker structure, a pool of tasks that share the work */
 
 typedef struct worker_s {
-  struct list_head worker_cb;   /* Ordered list of workers */
-  int worker_priority;          /* The priority of the worker task */
+  struct list_head node;        /* Entry in the system workers list */
+  worker_thread_t *threads;     /* The tasks of the pool */
+  int num_threads;              /* The number of tasks */
+  int next_thread;              /* Where the enqueue looks first */
+  int worker_priority;          /* The priority of the worker tasks */
   const char *worker_name;      /* Worker friendly name */
   int workqueue_id;             /* The handle of the work queue */
-  sem_t g_lock_worker_list;     /* Lock the worker list */
+  int next_work_uid;            /* The uid of the next enqueued work */
+  uint32_t next_seq;            /* The sequence of the next enqueued work */
+  worker_cb_t *inbox_head;      /* Work submitted, oldest first */
+  worker_cb_t *inbox_tail;      /* The last submitted work */
+  sem_t g_lock_worker_list;     /* Lock the work of all the tasks */
   bool is_running_enabled;      /* Flag that indicates the running status */      
   sem_t shutdown_notify;        /* Notification semaphore for thread shutdown */
 } worker_t;
@@ -75,7 +127,10 @@ typedef struct worker_s {
 
 int worker_init(void);
 int worker_create(int priority, const char *name);
+int worker_create_pool(int priority, const char *name, int num_threads);
+void worker_work_init(worker_cb_t *work, worker_cb callback, void *arg);
 int worker_enqueue(int worker_id, worker_cb_t *work);
+int worker_submit(int worker_id, worker_cb_t *work);
 int worker_cancel_work(int worker_id, int job_uid);
 int worker_destroy(int worker_id);
 
@@ -135,10 +135,11 @@ static void vprint(char **buffer, unsigned int *len, const char *fmt,
         print_number(buffer, len, val_3, ARG_INT64);
       } else if (c == 'u') {
         val_2 = va_arg(arg_list, unsigned int);
-        print_number(buffer, len, val_3, ARG_UINT32);
+        print_number(buffer, len, val_2, ARG_UINT32);
       } else if (c == 'l' && *(fmt + 1) == 'u') {
         val_4 = va_arg(arg_list, unsigned long);
-        print_number(buffer, len, val_3, ARG_UINT64);
+        fmt++;
+        print_number(buffer, len, val_4, ARG_UINT64);
       } else if (c == 's') {
         val_5 = va_arg(arg_list, char *); 
         print_string(buffer, len, val_5);
@@ -150,6 +151,7 @@ static void vprint(char **buffer, unsigned int *len, const char *fmt,
         print_number(buffer, len, val_2, ARG_HEXADEC); 
       } else if (c == 'l' && *(fmt + 1) == 'x') {
         val_4 = va_arg(arg_list, unsigned long);
+        fmt++;
         print_number(buffer, len, val_4, ARG_HEXADEC); 
       } else if (c == '0' && ((48 < *(fmt + 1)) && (*(fmt + 1) <= 57))) { 
         unsigned int num_digits = *(fmt + 1) - 48;
@@ -200,13 +202,23 @@ int sprintf(char *out, const char *fmt, ...)
   return 0;
 }
 
+/* snprintf - the output is always NULL terminated and it returns the number
+ * of characters written without the terminator.
+ */
 int snprintf(char *out, unsigned int len, const char *fmt, ...)
 {
   va_list arg_list;
-  unsigned int len_copy = len;
+
+  if (len == 0) {
+    return 0;
+  }
+
+  unsigned int len_copy = len - 1;
 
   va_start(arg_list, fmt);
   vprint(&out, &len_copy, fmt, arg_list);
   va_end(arg_list);
-  return 0;
+
+  *out = '\0';
+  return len - 1 - len_copy;
 }
@@ -0,0 +1,388 @@
+#include <board.h>
+
+#ifdef CONFIG_SCHEDULER_COROUTINE
+
+#include <coroutine.h>
+#include <errno.h>
+#include <scheduler.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SCHEDULER_COROUTINE_STACK_SIZE
+  #define CONFIG_SCHEDULER_COROUTINE_STACK_SIZE  (2048)
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Move a blocked coroutine to the end of its runner ready list. Call it with
+ * the interrupts disabled.
+ */
+
+static void coro_make_ready(coro_t *coro, int wait_result)
+{
+  if (coro->has_timeout)
+  {
+    list_del(&coro->timeout_node);
+    coro->has_timeout = false;
+  }
+
+  coro->waiting_sem = NULL;
+  coro->wait_result = wait_result;
+  coro->state       = CORO_READY;
+  list_add_tail(&coro->node, &coro->sched->ready_list);
+}
+
+/* Insert the coroutine in the timeout list of its runner, the list is kept
+ * ordered by the wake-up tick. Call it with the interrupts disabled.
+ */
+
+static void coro_timeout_add(coro_t *coro, int timeout_ms)
+{
+  struct list_head *timeout_list = &coro->sched->timeout_list;
+  struct list_head *pos;
+
+  coro->wake_tick   = sched_get_ticks() + SCHED_MS_TO_TICKS(timeout_ms);
+  coro->has_timeout = true;
+
+  for (pos = timeout_list->next; pos != timeout_list; pos = pos->next)
+  {
+    coro_t *other = container_of(pos, coro_t, timeout_node);
+
+    if ((int32_t)(other->wake_tick - coro->wake_tick) > 0)
+    {
+      break;
+    }
+  }
+
+  list_add_tail(&coro->timeout_node, pos);
+}
+
+/* Wake up the coroutines whose deadline expired, a coroutine that still
+ * waits for a semaphore gives up with -ETIMEDOUT. Call it with the
+ * interrupts disabled.
+ */
+
+static void coro_expire_timeouts(coro_sched_t *sched)
+{
+  uint32_t now = sched_get_ticks();
+
+  while (sched->timeout_list.next != &sched->timeout_list)
+  {
+    coro_t *coro = container_of(sched->timeout_list.next, coro_t,
+                                timeout_node);
+
+    if ((int32_t)(now - coro->wake_tick) < 0)
+    {
+      break;
+    }
+
+    if (coro->state == CORO_WAITING_FOR_SEM)
+    {
+      list_del(&coro->node);
+      coro_make_ready(coro, -ETIMEDOUT);
+    }
+    else
+    {
+      coro_make_ready(coro, 0);
+    }
+  }
+}
+
+/* The milliseconds until the first deadline of the runner, rounded up, or
+ * SEM_WAIT_FOREVER. Call it with the interrupts disabled.
+ */
+
+static int coro_next_timeout_ms(coro_sched_t *sched)
+{
+  if (sched->timeout_list.next == &sched->timeout_list)
+  {
+    return SEM_WAIT_FOREVER;
+  }
+
+  coro_t *coro = container_of(sched->timeout_list.next, coro_t,
+                              timeout_node);
+  int32_t ticks = (int32_t)(coro->wake_tick - sched_get_ticks());
+
+  if (ticks <= 0)
+  {
+    return 1;
+  }
+
+  return (int)(((uint64_t)ticks * 1000 + SCHED_TICKS_PER_SEC - 1) /
+               SCHED_TICKS_PER_SEC);
+}
+
+/*
+ * coro_sched_main - the runner task
+ *
+ * @argc      - 0
+ * @argv      - the runner state
+ *
+ * Call the ready coroutines one at a time in FIFO order and block on the
+ * wakeup semaphore until the first deadline when none of them is ready.
+ */
+static int coro_sched_main(int argc, char **argv)
+{
+  coro_sched_t *sched = (coro_sched_t *)argv;
+
+  for (;;)
+  {
+    irq_state_t irq_state = cpu_disableint();
+
+    coro_expire_timeouts(sched);
+
+    if (sched->ready_list.next == &sched->ready_list)
+    {
+      int timeout_ms = coro_next_timeout_ms(sched);
+
+      cpu_enableint(irq_state);
+      sem_timedwait(&sched->wakeup, timeout_ms);
+      continue;
+    }
+
+    coro_t *coro = container_of(sched->ready_list.next, coro_t, node);
+
+    list_del(&coro->node);
+    coro->state = CORO_RUNNING;
+
+    cpu_enableint(irq_state);
+
+    int ret = coro->entry(coro, coro->arg);
+
+    irq_state = cpu_disableint();
+
+    /* A blocked coroutine is already on its waiting lists and it may have
+     * been woken up in the meantime, leave it where it is.
+     */
+
+    if (coro->state == CORO_RUNNING)
+    {
+      if (ret == CORO_YIELDED)
+      {
+        coro->state = CORO_READY;
+        list_add_tail(&coro->node, &sched->ready_list);
+      }
+      else
+      {
+        coro->state = CORO_HALTED;
+      }
+    }
+
+    cpu_enableint(irq_state);
+  }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/*
+ * coro_sched_create - create a task that runs coroutines
+ *
+ * @sched     - the runner state, it must outlive the task
+ * @name      - the task name
+ * @priority  - the task priority
+ *
+ * All the coroutines started on the runner share its stack of
+ * CONFIG_SCHEDULER_COROUTINE_STACK_SIZE bytes.
+ *
+ * Returns 0 or a negative error code from sched_create_task.
+ */
+int coro_sched_create(coro_sched_t *sched, const char *name, int priority)
+{
+  if (sched == NULL)
+  {
+    return -EINVAL;
+  }
+
+  INIT_LIST_HEAD(&sched->ready_list);
+  INIT_LIST_HEAD(&sched->timeout_list);
+  sem_init(&sched->wakeup, 0, 0);
+
+  return sched_create_task(coro_sched_main,
+                           CONFIG_SCHEDULER_COROUTINE_STACK_SIZE,
+                           0,
+                           (char **)sched,
+                           name != NULL ? name : "coro",
+                           priority);
+}
+
+/*
+ * coro_start - start a coroutine on a runner
+ *
+ * @sched     - the runner
+ * @coro      - the coroutine state, zeroed or halted
+ * @entry     - the coroutine body
+ * @arg       - the argument passed to the body
+ *
+ * Returns 0 or -EBUSY if the coroutine did not halt yet.
+ */
+int coro_start(coro_sched_t *sched, coro_t *coro, coro_entry_t entry,
+               void *arg)
+{
+  if (sched == NULL || coro == NULL || entry == NULL)
+  {
+    return -EINVAL;
+  }
+
+  irq_state_t irq_state = cpu_disableint();
+
+  if (coro->state != CORO_HALTED)
+  {
+    cpu_enableint(irq_state);
+    return -EBUSY;
+  }
+
+  coro->entry       = entry;
+  coro->arg         = arg;
+  coro->sched       = sched;
+  coro->resume_line = 0;
+  coro->has_timeout = false;
+  coro_make_ready(coro, 0);
+
+  cpu_enableint(irq_state);
+
+  sem_post(&sched->wakeup);
+  return 0;
+}
+
+/*
+ * coro_stop - halt a coroutine from outside its body
+ *
+ * @coro      - the coroutine
+ *
+ * The coroutine is removed from the ready, timeout or semaphore waiting
+ * lists and it can be started again. A coroutine halts itself with
+ * CORO_EXIT.
+ *
+ * Returns 0 or -EBUSY when called from the body of the coroutine.
+ */
+int coro_stop(coro_t *coro)
+{
+  irq_state_t irq_state = cpu_disableint();
+
+  switch (coro->state)
+  {
+    case CORO_RUNNING:
+      cpu_enableint(irq_state);
+      return -EBUSY;
+
+    case CORO_READY:
+    case CORO_WAITING_FOR_SEM:
+      list_del(&coro->node);
+      break;
+
+    default:
+      break;
+  }
+
+  if (coro->has_timeout)
+  {
+    list_del(&coro->timeout_node);
+    coro->has_timeout = false;
+  }
+
+  coro->waiting_sem = NULL;
+  coro->state       = CORO_HALTED;
+
+  cpu_enableint(irq_state);
+  return 0;
+}
+
+/*
+ * coro_prepare_sleep - block the running coroutine for a while
+ *
+ * @coro       - the running coroutine
+ * @timeout_ms - the relative timeout in milliseconds
+ *
+ * Used by CORO_SLEEP, a timeout that is not positive only yields.
+ */
+void coro_prepare_sleep(coro_t *coro, int timeout_ms)
+{
+  irq_state_t irq_state = cpu_disableint();
+
+  if (timeout_ms <= 0)
+  {
+    coro_make_ready(coro, 0);
+  }
+  else
+  {
+    coro->state = CORO_SLEEPING;
+    coro_timeout_add(coro, timeout_ms);
+  }
+
+  cpu_enableint(irq_state);
+}
+
+/*
+ * coro_prepare_sem_wait - take a semaphore or queue the running coroutine
+ *
+ * @coro       - the running coroutine
+ * @sem        - the semaphore
+ * @timeout_ms - the relative timeout in milliseconds or CORO_WAIT_FOREVER
+ *
+ * Used by CORO_SEM_WAIT. The coroutine is placed at the end of the
+ * semaphore coroutine waiting list and in the timeout list of its runner,
+ * sem_post hands the semaphore to it.
+ *
+ * Returns true if the coroutine has to block, otherwise the result is in
+ * coro->wait_result.
+ */
+bool coro_prepare_sem_wait(coro_t *coro, sem_t *sem, int timeout_ms)
+{
+  irq_state_t irq_state = cpu_disableint();
+
+  if (sem->count > 0)
+  {
+    sem->count--;
+    coro->wait_result = 0;
+    cpu_enableint(irq_state);
+    return false;
+  }
+
+  if (timeout_ms == 0 ||
+      (timeout_ms < 0 && timeout_ms != CORO_WAIT_FOREVER))
+  {
+    coro->wait_result = timeout_ms == 0 ? -ETIMEDOUT : -EINVAL;
+    cpu_enableint(irq_state);
+    return false;
+  }
+
+  coro->state       = CORO_WAITING_FOR_SEM;
+  coro->waiting_sem = sem;
+  list_add_tail(&coro->node, &sem->coro_waiting_list);
+
+  if (timeout_ms != CORO_WAIT_FOREVER)
+  {
+    coro_timeout_add(coro, timeout_ms);
+  }
+
+  cpu_enableint(irq_state);
+  return true;
+}
+
+/*
+ * coro_sem_wakeup - hand a semaphore to the first blocked coroutine
+ *
+ * @sem       - the semaphore with a non empty coroutine waiting list
+ *
+ * Called by sem_post with the interrupts disabled, so it works from the
+ * interrupt handlers too.
+ */
+void coro_sem_wakeup(sem_t *sem)
+{
+  coro_t *coro = container_of(sem->coro_waiting_list.next, coro_t, node);
+
+  list_del(&coro->node);
+  coro_make_ready(coro, 0);
+
+  sem_post(&coro->sched->wakeup);
+}
+
+#endif /* CONFIG_SCHEDULER_COROUTINE */
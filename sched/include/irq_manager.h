@@ -2,6 +2,21 @@
 #define __IRQ_MANAGER_H
 
 #include <board.h>
+#include <stddef.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_IRQ_BOTTOM_HALF_STACK_SIZE
+  #define CONFIG_IRQ_BOTTOM_HALF_STACK_SIZE   (2048)
+#endif
+
+/* The latency histograms have a bucket for 0 us and one for each power of
+ * two up to the last bucket that counts everything above 1 ms.
+ */
+
+#define IRQ_STATS_BUCKETS                   (12)
 
 /****************************************************************************
  * Public Typess
@@ -11,6 +26,24 @@
 
 typedef void (* irq_cb)(void);
 
+#ifdef CONFIG_IRQ_STATS
+/* The counters of an interrupt. Bucket n of a histogram counts the
+ * durations from 2^(n-1) us up to 2^n us and the counters saturate.
+ */
+
+struct irq_stats_s {
+  uint32_t count;                   /* Times the vector fired */
+  uint32_t total_us;                /* Time spent in the handler */
+  uint32_t max_us;                  /* The longest handler run */
+  uint32_t max_raise_us;            /* The longest raise to entry delay */
+  uint32_t wakeups;                 /* Tasks made ready by the handler */
+  uint32_t max_wakeup_us;           /* The longest entry to task run delay */
+  uint16_t handler_hist[IRQ_STATS_BUCKETS];
+  uint16_t raise_hist[IRQ_STATS_BUCKETS];
+  uint16_t wakeup_hist[IRQ_STATS_BUCKETS];
+};
+#endif
+
 /****************************************************************************
  * Public Methods
  ****************************************************************************/
@@ -21,4 +54,26 @@ void irq_detach(int irq_num);
 
 void irq_generic_handler(void);
 
+#ifdef CONFIG_IRQ_BOTTOM_HALF
+int irq_attach_bottom_half(int irq_num, irq_cb bottom_half);
+
+void irq_schedule_bottom_half(int irq_num);
+
+int irq_bottom_half_init(void);
+#endif
+
+#ifdef CONFIG_IRQ_STATS
+int irq_get_active(uint32_t *entry_us);
+
+void irq_stats_wakeup(int irq_num, uint32_t latency_us);
+
+int irq_get_stats(int irq_num, struct irq_stats_s *stats);
+
+void irq_stats_reset(void);
+
+#ifdef CONFIG_PROCFS
+int irq_procfs_interrupts(char *buf, size_t len);
+#endif
+#endif
+
 #endif /* __IRQ_MANAGER_H */
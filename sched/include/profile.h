@@ -0,0 +1,73 @@
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <board.h>
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The number of distinct (PC, task) pairs kept in the histogram, a power of
+ * two.
+ */
+
+#ifndef CONFIG_SCHEDULER_PROFILE_SLOTS
+  #define CONFIG_SCHEDULER_PROFILE_SLOTS    (512)
+#endif
+
+/* The number of tasks that have their own sample counter */
+
+#ifndef CONFIG_SCHEDULER_PROFILE_TASKS
+  #define CONFIG_SCHEDULER_PROFILE_TASKS    (16)
+#endif
+
+/* The default sampling frequency in Hz */
+
+#ifndef CONFIG_SCHEDULER_PROFILE_FREQUENCY
+  #define CONFIG_SCHEDULER_PROFILE_FREQUENCY (997)
+#endif
+
+/* The number of task name characters saved with the task counter */
+
+#define PROFILE_TASK_NAME_LEN               (16)
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* The number of samples taken at one PC while a task was running */
+
+struct profile_sample_s {
+  uintptr_t pc;
+  uint32_t count;
+  uint16_t task_id;
+};
+
+/* The number of samples taken while a task was running */
+
+struct profile_task_s {
+  uint32_t count;
+  uint16_t task_id;
+  char name[PROFILE_TASK_NAME_LEN];
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+#ifdef CONFIG_SCHEDULER_PROFILE
+void profile_sample(uintptr_t pc);
+
+int profile_start(unsigned int frequency);
+
+void profile_stop(void);
+
+int profile_snapshot(struct profile_sample_s *samples, int max_samples);
+
+int profile_tasks(struct profile_task_s *tasks, int max_tasks);
+
+uint32_t profile_dropped(void);
+#endif
+
+#endif /* __PROFILE_H */
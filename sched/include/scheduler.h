@@ -13,6 +13,7 @@
 
 #include <list.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <semaphore.h>
 #include <stdio.h>
 
@@ -36,6 +37,84 @@
 
 #define SCHED_ERROR(msg, ...)   printf("[ERROR][SCHED] "msg, __VA_ARGS__)
 
+/* The number of priority levels. Each level has its own ready list and a bit
+ * in the ready bitmap so it can't be more than 32.
+ */
+
+#ifndef CONFIG_SCHEDULER_NUM_PRIORITIES
+  #define CONFIG_SCHEDULER_NUM_PRIORITIES  (8)
+#endif
+
+/* The scheduler tick rate in Hz */
+
+#define SCHED_TICKS_PER_SEC           (CONFIG_SYSTEM_SCHEDULER_SLICE_FREQUENCY)
+
+/* Convert milliseconds to scheduler ticks, rounded up. The conversion is
+ * split so that it does not overflow on 32 bit.
+ */
+
+#define SCHED_MS_TO_TICKS(ms)                                               \
+  ((uint32_t)(ms) / 1000 * SCHED_TICKS_PER_SEC +                            \
+   ((uint32_t)(ms) % 1000 * SCHED_TICKS_PER_SEC + 999) / 1000)
+
+/* Convert milliseconds to scheduler ticks, rounded down, for the delays
+ * that must not be exceeded.
+ */
+
+#define SCHED_MS_TO_TICKS_FLOOR(ms)                                         \
+  ((uint32_t)(ms) / 1000 * SCHED_TICKS_PER_SEC +                            \
+   (uint32_t)(ms) % 1000 * SCHED_TICKS_PER_SEC / 1000)
+
+/* The timer slack of the new tasks */
+
+#ifndef CONFIG_SCHEDULER_TIMER_SLACK_MS
+  #define CONFIG_SCHEDULER_TIMER_SLACK_MS  (0)
+#endif
+
+/* The number of entries added to a task fd table when it is full */
+
+#ifndef CONFIG_SCHEDULER_FD_TABLE_CHUNK
+  #define CONFIG_SCHEDULER_FD_TABLE_CHUNK  (8)
+#endif
+
+/* The task pool size classes go from (1 << SCHED_POOL_MIN_SHIFT) bytes up
+ * to (1 << (SCHED_POOL_MIN_SHIFT + SCHED_POOL_NUM_CLASSES - 1)) bytes.
+ */
+
+#define SCHED_POOL_MIN_SHIFT          (8)
+#define SCHED_POOL_NUM_CLASSES        (16)
+
+#ifndef CONFIG_SCHEDULER_TASK_POOL_SLOTS
+  #define CONFIG_SCHEDULER_TASK_POOL_SLOTS  (2)
+#endif
+
+/* The pattern painted on the task stacks with CONFIG_SCHEDULER_TASK_COLORATION */
+
+#define SCHED_STACK_COLOR             (0xDEADBEEF)
+
+/* Who owns the memory of a TCB and its stack */
+
+#define TCB_FLAG_STATIC               (1 << 0)  /* Provided by the caller */
+#define TCB_FLAG_POOLED               (1 << 1)  /* A task pool slot */
+
+/* Task priorities - a bigger value means that the task is more urgent */
+
+#define SCHED_PRIORITY_IDLE           (0)
+#define SCHED_PRIORITY_DEFAULT        (CONFIG_SCHEDULER_NUM_PRIORITIES / 2)
+#define SCHED_PRIORITY_MAX            (CONFIG_SCHEDULER_NUM_PRIORITIES - 1)
+
+/* The number of CPUs that run tasks, each one has its own ready lists */
+
+#ifdef CONFIG_SCHEDULER_SMP
+  #define SCHED_NCPUS                 (CONFIG_SCHEDULER_SMP_NCPUS)
+#else
+  #define SCHED_NCPUS                 (1)
+#endif
+
+/* The affinity mask that lets a task run on any CPU */
+
+#define SCHED_CPU_MASK_ALL            ((1U << SCHED_NCPUS) - 1)
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
@@ -44,15 +123,27 @@ struct opened_resource_s {
   int open_mode;            /* Currently not used */
   int fd;                   /* OPened resources file descriptor */
   struct vfs_node_s *vfs_node;  /* The node from the virtual file system */
-  struct list_head node;    /* The list of the opened resources ina task */
+  void *priv;               /* Private data for this opened instance */
 };
 
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+/* A time counter split in milliseconds and the remaining microseconds so it
+ * can be updated without 64 bit arithmetic.
+ */
+
+struct sched_time_s {
+  uint32_t ms;
+  uint32_t us;
+};
+#endif
+
 /* The task can be in one of the following states */
 
 enum task_state_e {
   READY,            /* It is not currenly running on the CPU */
   RUNNING,          /* The task was plannend on the CPU and is running */
-  WAITING_FOR_SEM,  /* The task is waiting for an event to wake up */
+  WAITING_FOR_SEM,  /* The task is waiting in the semaphore waiting list */
+  SLEEPING,         /* The task waits in the timeout list for its wake tick */
   HALTED            /* NOT USED currently */
 };
 
@@ -60,15 +151,40 @@ enum task_state_e {
 
 typedef struct tcb_s {
   struct list_head next_tcb;        /* The task list          */
+  struct list_head task_node;       /* The list of all the tasks */
   int (*entry_point)(int, char **); /* The task entry point   */
   enum task_state_e t_state;        /* The task state         */
+  uint8_t priority;                 /* The task priority      */
+  uint8_t tcb_flags;                /* TCB_FLAG_* memory owner */
+  uint32_t task_id;                 /* Unique task number     */
   void *stack_ptr_base;             /* Bootom stack pointer      */
   void *stack_ptr_top;              /* Top stack pointer         */
   void *sp;                         /* Current stack pointer     */
   void *mcu_context;                /* The CPU context           */
   sem_t *waiting_tcb_sema;          /* The waiting semaphore     */
-  struct list_head opened_resource; /* Opened task resources     */
-  uint32_t curr_resource_opened;    /* Num of opened resources   */
+  struct list_head timeout_node;    /* The kernel timeout list   */
+  uint32_t wake_tick;               /* Tick when the timeout expires */
+  uint32_t timer_slack;             /* Ticks a timeout may be late */
+  bool has_timeout;                 /* The wait has a deadline   */
+  int wait_result;                  /* OK or -ETIMEDOUT on wakeup */
+  struct opened_resource_s **fd_table; /* Resources indexed by fd */
+  uint32_t *fd_bitmap;              /* A bit is set for a used fd */
+  uint32_t fd_table_size;           /* Num of fd table entries   */
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+  struct sched_time_s run_time;     /* Time spent on the CPU     */
+  struct sched_time_s wait_time;    /* Time blocked on semaphores */
+  uint32_t wait_start_us;           /* When the semaphore wait started */
+  uint32_t nvcsw;                   /* Switches because it blocked */
+  uint32_t nivcsw;                  /* Switches while still ready */
+#endif
+#ifdef CONFIG_SCHEDULER_SMP
+  uint8_t cpu;                      /* The CPU whose ready list holds it */
+  uint32_t affinity;                /* A bit for each CPU it can run on */
+#endif
+#ifdef CONFIG_IRQ_STATS
+  uint16_t wakeup_irq;              /* 1 + the IRQ that woke the task */
+  uint32_t wakeup_irq_us;           /* When that interrupt was taken */
+#endif
   const char task_name[CONFIG_TASK_NAME_LEN];
 } tcb_t __attribute__((aligned(16)));
 
@@ -82,7 +198,32 @@ int sched_create_task(int (*task_entry_point)(int argc, char **argv),
                       uint32_t stack_size,
                       int argc,
                       char **argv,
-                      const char *task_name);
+                      const char *task_name,
+                      uint8_t priority);
+
+int sched_create_static_task(tcb_t *task_tcb,
+                             void *stack,
+                             uint32_t stack_size,
+                             int (*task_entry_point)(int argc, char **argv),
+                             int argc,
+                             char **argv,
+                             const char *task_name,
+                             uint8_t priority);
+
+#ifdef CONFIG_SCHEDULER_TASK_POOL
+int sched_task_pool_reserve(uint32_t stack_size, int num_slots);
+#endif
+
+int sched_get_stack_usage(tcb_t *tcb);
+
+int sched_foreach_task(int (*task_cb)(tcb_t *tcb, void *arg), void *arg);
+
+#ifdef CONFIG_PROCFS
+int sched_procfs_stacks(char *buf, size_t len);
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+int sched_procfs_cpu(char *buf, size_t len);
+#endif
+#endif
 
 void sched_run(void);
 
@@ -92,6 +233,26 @@ struct tcb_s *sched_get_next_task(void);
 
 void sched_preempt_task(tcb_t *to_preempt_tcb);
 
+bool sched_has_ready_task(tcb_t *except_tcb);
+
+void sched_wakeup_task(tcb_t *tcb);
+
+#ifdef CONFIG_SCHEDULER_SMP
+int sched_set_affinity(tcb_t *tcb, uint32_t cpu_mask);
+#endif
+
+void sched_cancel_timeout(tcb_t *tcb);
+
+void sched_tick(void);
+
+uint32_t sched_get_ticks(void);
+
+int sched_sleep(uint32_t ticks);
+
+int sched_set_timer_slack(tcb_t *tcb, uint32_t slack_ms);
+
+uint32_t sched_clock_us(void);
+
 void sched_context_switch(void);
 
 void sched_default_task_exit_point(void);
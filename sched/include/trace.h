@@ -0,0 +1,93 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <board.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The number of events kept in the ring buffer, a power of two */
+
+#ifndef CONFIG_SCHEDULER_TRACE_EVENTS
+  #define CONFIG_SCHEDULER_TRACE_EVENTS   (1024)
+#endif
+
+/* The task id recorded for the events that happen before the first task */
+
+#define TRACE_NO_TASK                     (0xFFFF)
+
+/* Record an event for the current task. It compiles to nothing when the
+ * tracer is disabled.
+ */
+
+#ifdef CONFIG_SCHEDULER_TRACE
+  #define TRACE_EVENT(type, arg8, arg0, arg1)                               \
+    trace_record((type), (arg8), (uint32_t)(arg0), (uint32_t)(arg1))
+#else
+  #define TRACE_EVENT(type, arg8, arg0, arg1)
+#endif
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* The event types. The meaning of the arguments is:
+ *
+ * TRACE_SWITCH       arg8 = state of the task that leaves the CPU,
+ *                    arg0 = id of the task that runs next
+ * TRACE_WAKEUP       arg8 = state of the woken task, arg0 = its id
+ * TRACE_SEM_BLOCK    arg0 = semaphore address, arg1 = timeout in ms
+ * TRACE_SEM_POST     arg0 = semaphore address
+ * TRACE_IRQ_ENTER    arg8 = interrupt number
+ * TRACE_IRQ_EXIT     arg8 = interrupt number
+ * TRACE_TASK_CREATE  task_id = the new task, arg8 = its priority,
+ *                    arg0 and arg1 = the first 8 characters of its name
+ * TRACE_TASK_EXIT    the task that exits
+ */
+
+enum trace_event_type_e {
+  TRACE_SWITCH,
+  TRACE_WAKEUP,
+  TRACE_SEM_BLOCK,
+  TRACE_SEM_POST,
+  TRACE_IRQ_ENTER,
+  TRACE_IRQ_EXIT,
+  TRACE_TASK_CREATE,
+  TRACE_TASK_EXIT,
+  TRACE_NUM_EVENTS,
+};
+
+/* A recorded event, this is also the layout read from /dev/trace */
+
+struct trace_event_s {
+  uint32_t timestamp_us;            /* sched_clock_us() when it happened */
+  uint8_t type;                     /* enum trace_event_type_e */
+  uint8_t arg8;
+  uint16_t task_id;                 /* The task that was running */
+  uint32_t arg0;
+  uint32_t arg1;
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+#ifdef CONFIG_SCHEDULER_TRACE
+void trace_record(uint8_t type, uint8_t arg8, uint32_t arg0, uint32_t arg1);
+
+void trace_record_task(uint16_t task_id, uint8_t type, uint8_t arg8,
+                       uint32_t arg0, uint32_t arg1);
+
+bool trace_enable(bool enable);
+
+void trace_clear(void);
+
+int trace_snapshot(struct trace_event_s *events, int max_events);
+
+int trace_init(void);
+#endif
+
+#endif /* __TRACE_H */
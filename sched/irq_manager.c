@@ -1,6 +1,20 @@
 #include <board.h>
 
+#include <errno.h>
 #include <irq_manager.h>
+#include <scheduler.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <string.h>
+#include <trace.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The number of words in the bottom half pending bitmap */
+
+#define IRQ_PENDING_WORDS       ((NUM_IRQS + 31) / 32)
 
 /****************************************************************************
  * Private variables defintion
@@ -10,6 +24,234 @@
 
 static void (*g_ram_vectors[NUM_IRQS])(void);
 
+#ifdef CONFIG_IRQ_BOTTOM_HALF
+/* The deferred work of each interrupt */
+
+static irq_cb g_bottom_halves[NUM_IRQS];
+
+/* One bit for each interrupt with a queued bottom half */
+
+static uint32_t g_bottom_half_pending[IRQ_PENDING_WORDS];
+
+/* Posted once when the first bottom half is queued */
+
+static sem_t g_bottom_half_sema;
+static bool g_bottom_half_scheduled;
+#endif
+
+#ifdef CONFIG_IRQ_STATS
+/* The counters of each interrupt */
+
+static struct irq_stats_s g_irq_stats[NUM_IRQS];
+
+/* The interrupt that is handled now or -1 and the time it was taken */
+
+static int g_irq_active = -1;
+static uint32_t g_irq_entry_us;
+#endif
+
+/****************************************************************************
+ * Private Methods
+ ****************************************************************************/
+
+#ifdef CONFIG_IRQ_BOTTOM_HALF
+/**************************************************************************
+ * Name:
+ *  irq_bottom_half_task
+ *
+ * Description:
+ *  Run the queued bottom halves. The pending bits are taken all at once
+ *  so the interrupts are disabled only for the copy.
+ *
+ *************************************************************************/
+
+static int irq_bottom_half_task(int argc, char **argv)
+{
+  uint32_t pending[IRQ_PENDING_WORDS];
+
+  while (1)
+  {
+    sem_wait(&g_bottom_half_sema);
+
+    irq_state_t irq_state = cpu_disableint();
+    memcpy(pending, g_bottom_half_pending, sizeof(pending));
+    memset(g_bottom_half_pending, 0, sizeof(g_bottom_half_pending));
+    g_bottom_half_scheduled = false;
+    cpu_enableint(irq_state);
+
+    for (int i = 0; i < IRQ_PENDING_WORDS; i++)
+    {
+      while (pending[i] != 0)
+      {
+        int irq_num = i * 32 + __builtin_ctz(pending[i]);
+        irq_cb bottom_half = g_bottom_halves[irq_num];
+
+        pending[i] &= pending[i] - 1;
+        if (bottom_half != NULL)
+        {
+          bottom_half();
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+#endif
+
+/**************************************************************************
+ * Name:
+ *  irq_dispatch
+ *
+ * Description:
+ *  Run the handler attached to an interrupt or queue its bottom half.
+ *
+ *************************************************************************/
+
+static void irq_dispatch(int isr_num)
+{
+#ifdef CONFIG_IRQ_BOTTOM_HALF
+  /* An interrupt with only a bottom half defers all its work */
+
+  if (g_ram_vectors[isr_num] == NULL && g_bottom_halves[isr_num] != NULL)
+  {
+    irq_schedule_bottom_half(isr_num);
+    return;
+  }
+#endif
+
+  if (g_ram_vectors[isr_num] == NULL)
+  {
+    return;
+  }
+
+  TRACE_EVENT(TRACE_IRQ_ENTER, isr_num, 0, 0);
+
+  g_ram_vectors[isr_num]();
+
+  TRACE_EVENT(TRACE_IRQ_EXIT, isr_num, 0, 0);
+}
+
+#ifdef CONFIG_IRQ_STATS
+/**************************************************************************
+ * Name:
+ *  irq_stats_record
+ *
+ * Description:
+ *  Add a duration to a histogram and keep the maximum.
+ *
+ *************************************************************************/
+
+static void irq_stats_record(uint16_t *hist, uint32_t *max_us,
+                             uint32_t duration_us)
+{
+  int bucket = duration_us == 0 ? 0 : 32 - __builtin_clz(duration_us);
+
+  if (bucket >= IRQ_STATS_BUCKETS)
+  {
+    bucket = IRQ_STATS_BUCKETS - 1;
+  }
+
+  if (hist[bucket] < UINT16_MAX)
+  {
+    hist[bucket]++;
+  }
+
+  if (duration_us > *max_us)
+  {
+    *max_us = duration_us;
+  }
+}
+
+/**************************************************************************
+ * Name:
+ *  irq_stats_dispatch
+ *
+ * Description:
+ *  Run the interrupt and measure it. The boards that know when the
+ *  interrupt was raised report the delay until the handler was entered.
+ *  A nested interrupt restores the one it preempted when it returns.
+ *
+ *************************************************************************/
+
+static void irq_stats_dispatch(int isr_num)
+{
+  struct irq_stats_s *stats = &g_irq_stats[isr_num];
+  int prev_irq = g_irq_active;
+  uint32_t prev_entry_us = g_irq_entry_us;
+  uint32_t entry_us = sched_clock_us();
+
+#ifdef CONFIG_BOARD_IRQ_TIMESTAMP
+  uint32_t raised_us;
+
+  if (board_irq_get_raised_us(&raised_us) == OK)
+  {
+    int32_t raise_us = entry_us - raised_us;
+
+    irq_stats_record(stats->raise_hist, &stats->max_raise_us,
+                     raise_us > 0 ? raise_us : 0);
+  }
+#endif
+
+  g_irq_active   = isr_num;
+  g_irq_entry_us = entry_us;
+
+  irq_dispatch(isr_num);
+
+  uint32_t duration_us = sched_clock_us() - entry_us;
+
+  g_irq_active   = prev_irq;
+  g_irq_entry_us = prev_entry_us;
+
+  stats->count++;
+  stats->total_us += duration_us;
+  irq_stats_record(stats->handler_hist, &stats->max_us, duration_us);
+}
+
+#ifdef CONFIG_PROCFS
+/**************************************************************************
+ * Name:
+ *  irq_procfs_hist
+ *
+ * Description:
+ *  Print the non empty buckets of a histogram as <upper bound>:<count>.
+ *
+ *************************************************************************/
+
+static size_t irq_procfs_hist(char *buf, size_t len, int irq_num,
+                              const char *name, const uint16_t *hist)
+{
+  size_t pos = snprintf(buf, len, "%d\t%s", irq_num, name);
+
+  for (int i = 0; i < IRQ_STATS_BUCKETS && pos < len; i++)
+  {
+    if (hist[i] == 0)
+    {
+      continue;
+    }
+
+    if (i == IRQ_STATS_BUCKETS - 1)
+    {
+      pos += snprintf(buf + pos, len - pos, " >=%u:%u",
+                      1u << (i - 1), (unsigned)hist[i]);
+    }
+    else
+    {
+      pos += snprintf(buf + pos, len - pos, " <%u:%u",
+                      1u << i, (unsigned)hist[i]);
+    }
+  }
+
+  if (pos < len)
+  {
+    pos += snprintf(buf + pos, len - pos, "\n");
+  }
+
+  return pos;
+}
+#endif /* CONFIG_PROCFS */
+#endif /* CONFIG_IRQ_STATS */
+
 /****************************************************************************
  * Public Methods
  ****************************************************************************/
@@ -64,10 +306,240 @@ void irq_detach(int irq_num)
 {
   uint8_t isr_num = cpu_getirqnum();
 
-  if (isr_num >= NUM_IRQS || g_ram_vectors[isr_num] == NULL)
+  if (isr_num >= NUM_IRQS)
   {
     return;
   }
 
-  g_ram_vectors[isr_num]();
+#ifdef CONFIG_IRQ_STATS
+  irq_stats_dispatch(isr_num);
+#else
+  irq_dispatch(isr_num);
+#endif
+}
+
+#ifdef CONFIG_IRQ_BOTTOM_HALF
+/**************************************************************************
+ * Name:
+ *  irq_attach_bottom_half
+ *
+ * Description:
+ *  Attach the deferred work of an interrupt. It runs in the bottom half
+ *  task after the handler called irq_schedule_bottom_half. When no handler
+ *  is attached with irq_attach the bottom half is queued on every
+ *  interrupt.
+ *
+ * Return Value:
+ *  OK or -EINVAL for an invalid interrupt number.
+ *
+ *************************************************************************/
+
+int irq_attach_bottom_half(int irq_num, irq_cb bottom_half)
+{
+  if (irq_num < 0 || irq_num >= NUM_IRQS)
+  {
+    return -EINVAL;
+  }
+
+  irq_state_t irq_state = cpu_disableint();
+  g_bottom_halves[irq_num] = bottom_half;
+  cpu_enableint(irq_state);
+
+  return OK;
+}
+
+/**************************************************************************
+ * Name:
+ *  irq_schedule_bottom_half
+ *
+ * Description:
+ *  Queue the bottom half of an interrupt, call it from the interrupt
+ *  handler. An interrupt that is already pending is not queued again so a
+ *  burst of interrupts is served by a single run.
+ *
+ *************************************************************************/
+
+void irq_schedule_bottom_half(int irq_num)
+{
+  irq_state_t irq_state = cpu_disableint();
+
+  g_bottom_half_pending[irq_num / 32] |= 1u << (irq_num % 32);
+
+  if (!g_bottom_half_scheduled)
+  {
+    g_bottom_half_scheduled = true;
+    sem_post(&g_bottom_half_sema);
+  }
+
+  cpu_enableint(irq_state);
+}
+
+/**************************************************************************
+ * Name:
+ *  irq_bottom_half_init
+ *
+ * Description:
+ *  Start the task that runs the bottom halves with the highest priority.
+ *
+ *************************************************************************/
+
+int irq_bottom_half_init(void)
+{
+  sem_init(&g_bottom_half_sema, 0, 0);
+
+  return sched_create_task(irq_bottom_half_task,
+                           CONFIG_IRQ_BOTTOM_HALF_STACK_SIZE,
+                           0,
+                           NULL,
+                           "irq_bh",
+                           SCHED_PRIORITY_MAX);
+}
+#endif
+
+#ifdef CONFIG_IRQ_STATS
+/**************************************************************************
+ * Name:
+ *  irq_get_active
+ *
+ * Description:
+ *  Get the interrupt that is handled now and the time it was taken.
+ *
+ * Return Value:
+ *  The interrupt number or -1 when called from a task.
+ *
+ *************************************************************************/
+
+int irq_get_active(uint32_t *entry_us)
+{
+  if (g_irq_active >= 0 && entry_us != NULL)
+  {
+    *entry_us = g_irq_entry_us;
+  }
+
+  return g_irq_active;
+}
+
+/**************************************************************************
+ * Name:
+ *  irq_stats_wakeup
+ *
+ * Description:
+ *  Account the time from the interrupt entry until the task it woke up
+ *  got the CPU. It is called by the scheduler when the task runs.
+ *
+ * Assumption/Limitations:
+ *  Call this function with interrupts disabled.
+ *
+ *************************************************************************/
+
+void irq_stats_wakeup(int irq_num, uint32_t latency_us)
+{
+  struct irq_stats_s *stats = &g_irq_stats[irq_num];
+
+  stats->wakeups++;
+  irq_stats_record(stats->wakeup_hist, &stats->max_wakeup_us, latency_us);
+}
+
+/**************************************************************************
+ * Name:
+ *  irq_get_stats
+ *
+ * Description:
+ *  Copy the counters of an interrupt.
+ *
+ * Return Value:
+ *  OK or -EINVAL for an invalid interrupt number.
+ *
+ *************************************************************************/
+
+int irq_get_stats(int irq_num, struct irq_stats_s *stats)
+{
+  if (irq_num < 0 || irq_num >= NUM_IRQS || stats == NULL)
+  {
+    return -EINVAL;
+  }
+
+  irq_state_t irq_state = cpu_disableint();
+  memcpy(stats, &g_irq_stats[irq_num], sizeof(struct irq_stats_s));
+  cpu_enableint(irq_state);
+
+  return OK;
+}
+
+/**************************************************************************
+ * Name:
+ *  irq_stats_reset
+ *
+ * Description:
+ *  Clear the counters of all the interrupts.
+ *
+ *************************************************************************/
+
+void irq_stats_reset(void)
+{
+  irq_state_t irq_state = cpu_disableint();
+  memset(g_irq_stats, 0, sizeof(g_irq_stats));
+  cpu_enableint(irq_state);
+}
+
+#ifdef CONFIG_PROCFS
+/**************************************************************************
+ * Name:
+ *  irq_procfs_interrupts
+ *
+ * Description:
+ *  Fill buf with the content of /proc/interrupts: one line for each
+ *  interrupt that fired with its counters followed by the non empty
+ *  buckets of the handler duration, the raise to entry delay and the
+ *  entry to task wakeup histograms. The times are in microseconds.
+ *
+ * Return Value:
+ *  The number of characters written in buf.
+ *
+ *************************************************************************/
+
+int irq_procfs_interrupts(char *buf, size_t len)
+{
+  struct irq_stats_s stats;
+  size_t pos;
+
+  pos = snprintf(buf, len, "IRQ\tCOUNT\tTOTAL_US\tMAX_US\tRAISE_US\t"
+                 "WAKEUPS\tWAKE_US\n");
+
+  for (int i = 0; i < NUM_IRQS && pos < len; i++)
+  {
+    irq_get_stats(i, &stats);
+    if (stats.count == 0)
+    {
+      continue;
+    }
+
+    pos += snprintf(buf + pos, len - pos, "%d\t%u\t%u\t%u\t%u\t%u\t%u\n",
+                    i, (unsigned)stats.count, (unsigned)stats.total_us,
+                    (unsigned)stats.max_us, (unsigned)stats.max_raise_us,
+                    (unsigned)stats.wakeups, (unsigned)stats.max_wakeup_us);
+    if (pos < len)
+    {
+      pos += irq_procfs_hist(buf + pos, len - pos, i, "run",
+                             stats.handler_hist);
+    }
+
+    if (pos < len && stats.max_raise_us != 0)
+    {
+      pos += irq_procfs_hist(buf + pos, len - pos, i, "raise",
+                             stats.raise_hist);
+    }
+
+    if (pos < len && stats.wakeups != 0)
+    {
+      pos += irq_procfs_hist(buf + pos, len - pos, i, "wake",
+                             stats.wakeup_hist);
+    }
+  }
+
+  /* The last line was truncated */
+
+  return pos < len ? pos : len - 1;
 }
+#endif /* CONFIG_PROCFS */
+#endif /* CONFIG_IRQ_STATS */
@@ -0,0 +1,765 @@
+#include <board.h>
+
+#ifdef CONFIG_SCHEDULER_KTIMER
+
+#include <errno.h>
+#include <ktimer.h>
+#include <scheduler.h>
+#include <semaphore.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SCHEDULER_KTIMER_STACK_SIZE
+  #define CONFIG_SCHEDULER_KTIMER_STACK_SIZE  (2048)
+#endif
+
+/* The wheel has KTIMER_WHEEL_LEVELS levels of 64 slots, a slot of a level
+ * covers all the slots of the level below. The levels reach 2^24 ticks, a
+ * longer timer waits in the last level and it is placed again when that
+ * slot comes around.
+ */
+
+#define KTIMER_WHEEL_BITS           (6)
+#define KTIMER_WHEEL_SLOTS          (1 << KTIMER_WHEEL_BITS)
+#define KTIMER_WHEEL_MASK           (KTIMER_WHEEL_SLOTS - 1)
+#define KTIMER_WHEEL_LEVELS         (4)
+#define KTIMER_WHEEL_RANGE          (1u << (KTIMER_WHEEL_BITS * \
+                                            KTIMER_WHEEL_LEVELS))
+
+#define KTIMER_SLOT_INDEX(tick, level)                                      \
+  (((tick) >> ((level) * KTIMER_WHEEL_BITS)) & KTIMER_WHEEL_MASK)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* The armed timers, g_wheel_pending has a bit set for each used slot */
+
+static struct list_head g_wheel[KTIMER_WHEEL_LEVELS][KTIMER_WHEEL_SLOTS];
+static uint64_t g_wheel_pending[KTIMER_WHEEL_LEVELS];
+
+/* The next tick that the wheel has to process */
+
+static uint32_t g_wheel_tick;
+
+/* The timers whose callback runs next in the timer task */
+
+static LIST_HEAD(g_ktimer_expired);
+
+/* Posted when a timer expires before the timer task wakes up */
+
+static sem_t g_ktimer_wakeup;
+static bool g_ktimer_is_sleeping;
+static bool g_ktimer_sleeps_forever;
+static uint32_t g_ktimer_sleep_deadline;  /* The latest tick it wakes up */
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Take an armed timer out of its wheel slot or of the expired list. Call it
+ * with the interrupts disabled.
+ */
+
+static void ktimer_unlink(ktimer_t *timer)
+{
+  list_del(&timer->node);
+  INIT_LIST_HEAD(&timer->node);
+
+  if (timer->wheel_level >= 0)
+  {
+    struct list_head *slot = &g_wheel[timer->wheel_level][timer->wheel_slot];
+
+    if (slot->next == slot)
+    {
+      g_wheel_pending[timer->wheel_level] &= ~(1ull << timer->wheel_slot);
+    }
+  }
+
+  timer->wheel_level = -1;
+}
+
+/* True when no timer waits in a wheel slot. Call it with the interrupts
+ * disabled.
+ */
+
+static bool ktimer_wheel_is_empty(void)
+{
+  for (int level = 0; level < KTIMER_WHEEL_LEVELS; level++)
+  {
+    if (g_wheel_pending[level] != 0)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Place a timer in the wheel by the distance to its expiration, a timer
+ * that already expired goes in the slot that is processed next. Call it
+ * with the interrupts disabled.
+ */
+
+static void ktimer_wheel_add(ktimer_t *timer)
+{
+  int32_t delta = (int32_t)(timer->expire_tick - g_wheel_tick);
+  uint32_t tick = timer->expire_tick;
+  int level = 0;
+
+  if (delta < 0)
+  {
+    tick = g_wheel_tick;
+  }
+  else if ((uint32_t)delta >= KTIMER_WHEEL_RANGE)
+  {
+    tick = g_wheel_tick + KTIMER_WHEEL_RANGE - 1;
+  }
+
+  while (level < KTIMER_WHEEL_LEVELS - 1 &&
+         tick - g_wheel_tick >= (1u << ((level + 1) * KTIMER_WHEEL_BITS)))
+  {
+    level++;
+  }
+
+  timer->wheel_level = level;
+  timer->wheel_slot  = KTIMER_SLOT_INDEX(tick, level);
+
+  list_add_tail(&timer->node, &g_wheel[level][timer->wheel_slot]);
+  g_wheel_pending[level] |= 1ull << timer->wheel_slot;
+}
+
+/* Empty a wheel slot, the due timers go to the expired list and the others
+ * are placed again closer to their expiration. Call it with the interrupts
+ * disabled.
+ */
+
+static void ktimer_slot_flush(int level, int index)
+{
+  struct list_head *slot = &g_wheel[level][index];
+
+  g_wheel_pending[level] &= ~(1ull << index);
+
+  while (slot->next != slot)
+  {
+    ktimer_t *timer = container_of(slot->next, ktimer_t, node);
+
+    list_del(&timer->node);
+
+    if ((int32_t)(timer->expire_tick - g_wheel_tick) > 0)
+    {
+      ktimer_wheel_add(timer);
+    }
+    else
+    {
+      timer->wheel_level = -1;
+      list_add_tail(&timer->node, &g_ktimer_expired);
+    }
+  }
+}
+
+/* The first slot of a level in expiration order. The current slot of the
+ * upper levels holds the timers of the next round, unless the wheel stands
+ * at the start of the round and did not bring them down yet.
+ */
+
+static int ktimer_slot_first(int level)
+{
+  uint32_t round_mask = (1u << (level * KTIMER_WHEEL_BITS)) - 1;
+
+  return (KTIMER_SLOT_INDEX(g_wheel_tick, level) +
+          ((g_wheel_tick & round_mask) != 0)) & KTIMER_WHEEL_MASK;
+}
+
+/* The first tick that the i-th slot of a level in expiration order can
+ * hold, a slot of the first level holds a single tick.
+ */
+
+static uint32_t ktimer_slot_start(int level, int i)
+{
+  int shift = level * KTIMER_WHEEL_BITS;
+  uint32_t round = g_wheel_tick >> shift;
+
+  if ((g_wheel_tick & ((1u << shift) - 1)) != 0)
+  {
+    round++;
+  }
+
+  return (round + i) << shift;
+}
+
+/* The tick where the first used slot of the upper levels is brought down
+ * to the levels below. Call it with the interrupts disabled.
+ *
+ * Returns false when the upper levels are empty.
+ */
+
+static bool ktimer_wheel_next_cascade(uint32_t *next_tick)
+{
+  bool is_found = false;
+
+  for (int level = 1; level < KTIMER_WHEEL_LEVELS; level++)
+  {
+    uint64_t pending = g_wheel_pending[level];
+
+    if (pending == 0)
+    {
+      continue;
+    }
+
+    /* Rotate the bitmap so the bits follow the expiration order */
+
+    int start = ktimer_slot_first(level);
+
+    pending = (pending >> start) |
+              (pending << ((KTIMER_WHEEL_SLOTS - start) & KTIMER_WHEEL_MASK));
+
+    uint32_t tick = ktimer_slot_start(level, __builtin_ctzll(pending));
+
+    if (!is_found || (int32_t)(tick - *next_tick) < 0)
+    {
+      *next_tick = tick;
+      is_found   = true;
+    }
+  }
+
+  return is_found;
+}
+
+/* Process the wheel up to the current tick. The empty slots are skipped:
+ * the first level steps to its next used slot and, when it is empty, to
+ * the next used slot of the upper levels or to the current tick, so a
+ * tickless wakeup after a long sleep costs one loop per used slot and per
+ * cascade of a used slot. Call it with the interrupts disabled.
+ */
+
+static void ktimer_wheel_advance(uint32_t now)
+{
+  while ((int32_t)(now - g_wheel_tick) >= 0)
+  {
+    int index = g_wheel_tick & KTIMER_WHEEL_MASK;
+
+    /* The first level wrapped, bring down the next slot of the levels
+     * above.
+     */
+
+    for (int level = 1; index == 0 && level < KTIMER_WHEEL_LEVELS; level++)
+    {
+      int upper = KTIMER_SLOT_INDEX(g_wheel_tick, level);
+
+      ktimer_slot_flush(level, upper);
+
+      if (upper != 0)
+      {
+        break;
+      }
+    }
+
+    if (g_wheel_pending[0] & (1ull << index))
+    {
+      ktimer_slot_flush(0, index);
+      g_wheel_tick++;
+      continue;
+    }
+
+    uint64_t pending = g_wheel_pending[0] >> index;
+    uint32_t left    = now - g_wheel_tick + 1;
+    uint32_t step;
+    uint32_t next_tick;
+
+    if (pending != 0)
+    {
+      step = (uint32_t)__builtin_ctzll(pending);
+    }
+    else if (g_wheel_pending[0] != 0)
+    {
+      step = KTIMER_WHEEL_SLOTS - index;
+    }
+    else if (ktimer_wheel_next_cascade(&next_tick))
+    {
+      step = next_tick - g_wheel_tick;
+    }
+    else
+    {
+      step = left;
+    }
+
+    g_wheel_tick += step < left ? step : left;
+  }
+}
+
+/* The earliest expiration in the wheel, the first used slot of each level
+ * in expiration order holds it. Call it with the interrupts disabled.
+ *
+ * Returns false when no timer is armed.
+ */
+
+static bool ktimer_wheel_next(uint32_t *next_tick)
+{
+  bool is_found = false;
+
+  for (int level = 0; level < KTIMER_WHEEL_LEVELS; level++)
+  {
+    if (g_wheel_pending[level] == 0)
+    {
+      continue;
+    }
+
+    int start = ktimer_slot_first(level);
+
+    for (int i = 0; i < KTIMER_WHEEL_SLOTS; i++)
+    {
+      int index = (start + i) & KTIMER_WHEEL_MASK;
+
+      if (!(g_wheel_pending[level] & (1ull << index)))
+      {
+        continue;
+      }
+
+      ktimer_t *timer;
+
+      list_for_each_entry(timer, &g_wheel[level][index], node)
+      {
+        if (!is_found ||
+            (int32_t)(timer->expire_tick - *next_tick) < 0)
+        {
+          *next_tick = timer->expire_tick;
+          is_found   = true;
+        }
+      }
+
+      break;
+    }
+  }
+
+  return is_found;
+}
+
+/* The last tick that expires every timer due before it within its slack.
+ * The slots of each level are taken in expiration order and the walk of a
+ * level stops at the first slot that starts after the window, its timers
+ * and the ones of the next slots can't shorten it. Call it with the
+ * interrupts disabled.
+ */
+
+static uint32_t ktimer_wheel_deadline(uint32_t next_tick)
+{
+  /* Start past every armed timer, they expire less than 2^31 ticks away */
+
+  uint32_t deadline = next_tick + INT_MAX;
+
+  for (int level = 0; level < KTIMER_WHEEL_LEVELS; level++)
+  {
+    int start = ktimer_slot_first(level);
+
+    for (int i = 0; i < KTIMER_WHEEL_SLOTS && g_wheel_pending[level]; i++)
+    {
+      int index = (start + i) & KTIMER_WHEEL_MASK;
+
+      if (!(g_wheel_pending[level] & (1ull << index)))
+      {
+        continue;
+      }
+
+      uint32_t slot_start = ktimer_slot_start(level, i);
+
+      if ((int32_t)(slot_start - next_tick) > 0 &&
+          (int32_t)(slot_start - deadline) > 0)
+      {
+        break;
+      }
+
+      ktimer_t *timer;
+
+      list_for_each_entry(timer, &g_wheel[level][index], node)
+      {
+        uint32_t end = timer->expire_tick + timer->slack_ticks;
+
+        if ((int32_t)(timer->expire_tick - deadline) <= 0 &&
+            (int32_t)(end - deadline) < 0)
+        {
+          deadline = end;
+        }
+      }
+    }
+  }
+
+  return deadline;
+}
+
+/* The milliseconds until a tick, rounded up, at least 1 */
+
+static int ktimer_ticks_to_ms(uint32_t tick)
+{
+  int32_t ticks = (int32_t)(tick - sched_get_ticks());
+
+  if (ticks <= 0)
+  {
+    return 1;
+  }
+
+  return (int)(((uint64_t)ticks * 1000 + SCHED_TICKS_PER_SEC - 1) /
+               SCHED_TICKS_PER_SEC);
+}
+
+/* Take the next expired timer and arm a periodic timer again. The missed
+ * periods are counted as overruns instead of running the callback for each
+ * of them. Call it with the interrupts disabled.
+ */
+
+static ktimer_t *ktimer_take_expired(uint32_t now)
+{
+  if (g_ktimer_expired.next == &g_ktimer_expired)
+  {
+    return NULL;
+  }
+
+  ktimer_t *timer = container_of(g_ktimer_expired.next, ktimer_t, node);
+
+  list_del(&timer->node);
+  INIT_LIST_HEAD(&timer->node);
+
+  timer->overrun = 0;
+
+  if (timer->interval_ticks == 0)
+  {
+    timer->is_armed = false;
+    return timer;
+  }
+
+  timer->expire_tick += timer->interval_ticks;
+
+  while ((int32_t)(now - timer->expire_tick) >= 0)
+  {
+    timer->expire_tick += timer->interval_ticks;
+    timer->overrun++;
+  }
+
+  ktimer_wheel_add(timer);
+  return timer;
+}
+
+/*
+ * ktimer_main - the timer task
+ *
+ * @argc      - 0
+ * @argv      - unused
+ *
+ * Process the wheel, run the callbacks of the expired timers and block on
+ * the wakeup semaphore until the earliest expiration.
+ */
+static int ktimer_main(int argc, char **argv)
+{
+  for (;;)
+  {
+    irq_state_t irq_state = cpu_disableint();
+    uint32_t now = sched_get_ticks();
+
+    g_ktimer_is_sleeping = false;
+    ktimer_wheel_advance(now);
+
+    ktimer_t *timer = ktimer_take_expired(now);
+
+    if (timer == NULL)
+    {
+      int timeout_ms = SEM_WAIT_FOREVER;
+
+      uint32_t next_tick;
+      uint32_t slack_ms = 0;
+
+      g_ktimer_is_sleeping    = true;
+      g_ktimer_sleeps_forever = !ktimer_wheel_next(&next_tick);
+
+      if (!g_ktimer_sleeps_forever)
+      {
+        g_ktimer_sleep_deadline = ktimer_wheel_deadline(next_tick);
+
+        timeout_ms = ktimer_ticks_to_ms(next_tick);
+        slack_ms   = (uint32_t)((uint64_t)(g_ktimer_sleep_deadline -
+                                           next_tick) *
+                                1000 / SCHED_TICKS_PER_SEC);
+      }
+
+      cpu_enableint(irq_state);
+
+      /* The scheduler may wake us up until the end of the window */
+
+      sched_set_timer_slack(NULL, slack_ms);
+      sem_timedwait(&g_ktimer_wakeup, timeout_ms);
+      continue;
+    }
+
+    ktimer_cb_t callback = timer->callback;
+    void *arg            = timer->arg;
+    int worker_id        = timer->worker_id;
+
+    cpu_enableint(irq_state);
+
+    if (worker_id == KTIMER_NO_WORKER)
+    {
+      callback(arg);
+    }
+    else if (worker_submit(worker_id, &timer->work) == -EBUSY)
+    {
+      /* The worker did not start the last expiration yet */
+
+      irq_state = cpu_disableint();
+      timer->overrun++;
+      cpu_enableint(irq_state);
+    }
+  }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/*
+ * ktimer_init - start the timer task
+ *
+ * The callbacks run in a task with the highest priority and they share its
+ * CONFIG_SCHEDULER_KTIMER_STACK_SIZE bytes of stack. It is called before
+ * board_init so the drivers can arm timers.
+ *
+ * Returns 0 or a negative error code from sched_create_task.
+ */
+int ktimer_init(void)
+{
+  for (int level = 0; level < KTIMER_WHEEL_LEVELS; level++)
+  {
+    for (int index = 0; index < KTIMER_WHEEL_SLOTS; index++)
+    {
+      INIT_LIST_HEAD(&g_wheel[level][index]);
+    }
+
+    g_wheel_pending[level] = 0;
+  }
+
+  /* The board starts its timer later, the tick counts from 0 */
+
+  g_wheel_tick = 0;
+  sem_init(&g_ktimer_wakeup, 0, 0);
+
+  return sched_create_task(ktimer_main,
+                           CONFIG_SCHEDULER_KTIMER_STACK_SIZE,
+                           0,
+                           NULL,
+                           "ktimer",
+                           SCHED_PRIORITY_MAX);
+}
+
+/*
+ * ktimer_create - set up a disarmed timer
+ *
+ * @timer     - the timer state, it must outlive the timer
+ * @callback  - the function called at each expiration
+ * @arg       - the argument passed to the callback
+ * @worker_id - KTIMER_NO_WORKER to run the callback in the timer task or
+ *              the worker that runs it, timer->work.priority can be set
+ *              after the call
+ *
+ * A callback that runs in the timer task must be short, the other timers
+ * wait for it.
+ *
+ * Returns 0 or -EINVAL.
+ */
+int ktimer_create(ktimer_t *timer, ktimer_cb_t callback, void *arg,
+                  int worker_id)
+{
+  if (timer == NULL || callback == NULL)
+  {
+    return -EINVAL;
+  }
+
+  INIT_LIST_HEAD(&timer->node);
+
+  timer->callback       = callback;
+  timer->arg            = arg;
+  timer->worker_id      = worker_id;
+  timer->expire_tick    = 0;
+  timer->interval_ticks = 0;
+  timer->slack_ticks    = 0;
+  timer->overrun        = 0;
+  timer->wheel_level    = -1;
+  timer->wheel_slot     = 0;
+  timer->is_armed       = false;
+
+  timer->work = (worker_cb_t) {
+    .priority = WORKER_PRIORITY_LOW,
+    .priv_arg = arg,
+    .callback = callback,
+  };
+
+  return 0;
+}
+
+/*
+ * ktimer_settime - arm or disarm a timer
+ *
+ * @timer       - the timer
+ * @value_ms    - the time until the first expiration, 0 disarms it
+ * @interval_ms - the period of the next expirations, 0 for a one-shot
+ *
+ * The times are rounded up to the scheduler tick. It can be called from
+ * the interrupt handlers and from the timer callbacks.
+ *
+ * Returns 0 or -EINVAL.
+ */
+int ktimer_settime(ktimer_t *timer, uint32_t value_ms, uint32_t interval_ms)
+{
+  if (timer == NULL || timer->callback == NULL)
+  {
+    return -EINVAL;
+  }
+
+  irq_state_t irq_state = cpu_disableint();
+
+  if (timer->is_armed)
+  {
+    ktimer_unlink(timer);
+    timer->is_armed = false;
+  }
+
+  if (value_ms == 0)
+  {
+    cpu_enableint(irq_state);
+    return 0;
+  }
+
+  uint32_t now = sched_get_ticks();
+
+  /* The timer task does not advance an empty wheel while it sleeps, after
+   * 2^31 ticks the new timer would look expired in a stale slot. Restart
+   * the wheel from the next tick, as if it was processed up to now.
+   */
+
+  if (ktimer_wheel_is_empty())
+  {
+    g_wheel_tick = now + 1;
+  }
+
+  timer->expire_tick    = now + SCHED_MS_TO_TICKS(value_ms);
+  timer->interval_ticks = SCHED_MS_TO_TICKS(interval_ms);
+  timer->is_armed       = true;
+
+  ktimer_wheel_add(timer);
+
+  /* Wake up the timer task if it may sleep past the new slack window */
+
+  uint32_t deadline = timer->expire_tick + timer->slack_ticks;
+
+  if (g_ktimer_is_sleeping &&
+      (g_ktimer_sleeps_forever ||
+       (int32_t)(g_ktimer_sleep_deadline - deadline) > 0))
+  {
+    g_ktimer_is_sleeping = false;
+    sem_post(&g_ktimer_wakeup);
+  }
+
+  cpu_enableint(irq_state);
+  return 0;
+}
+
+/*
+ * ktimer_gettime - read the time left until the next expiration
+ *
+ * @timer       - the timer
+ * @value_ms    - the milliseconds left, rounded up, or 0 when disarmed
+ * @interval_ms - the period or 0 for a one-shot, can be NULL
+ *
+ * Returns 0 or -EINVAL.
+ */
+int ktimer_gettime(ktimer_t *timer, uint32_t *value_ms,
+                   uint32_t *interval_ms)
+{
+  if (timer == NULL || value_ms == NULL)
+  {
+    return -EINVAL;
+  }
+
+  irq_state_t irq_state = cpu_disableint();
+
+  *value_ms = timer->is_armed ? ktimer_ticks_to_ms(timer->expire_tick) : 0;
+
+  if (interval_ms != NULL)
+  {
+    *interval_ms = (uint32_t)(((uint64_t)timer->interval_ticks * 1000) /
+                              SCHED_TICKS_PER_SEC);
+  }
+
+  cpu_enableint(irq_state);
+  return 0;
+}
+
+/*
+ * ktimer_getoverrun - the expirations lost before the last callback
+ *
+ * @timer     - the timer
+ *
+ * A periodic timer whose task or worker falls behind skips the periods it
+ * missed and counts them here.
+ *
+ * Returns the count or -EINVAL.
+ */
+int ktimer_getoverrun(ktimer_t *timer)
+{
+  if (timer == NULL)
+  {
+    return -EINVAL;
+  }
+
+  return (int)timer->overrun;
+}
+
+/*
+ * ktimer_setslack - let a timer expire later to share a wakeup
+ *
+ * @timer     - the timer
+ * @slack_ms  - how late the callback may run, rounded down to the tick
+ *
+ * In tickless mode the timer task sleeps until the end of the shortest
+ * slack window among the timers that are due first, the expirations that
+ * fall in the window run together. It applies from the next expiration.
+ *
+ * Returns 0 or -EINVAL.
+ */
+int ktimer_setslack(ktimer_t *timer, uint32_t slack_ms)
+{
+  if (timer == NULL)
+  {
+    return -EINVAL;
+  }
+
+  irq_state_t irq_state = cpu_disableint();
+  timer->slack_ticks = SCHED_MS_TO_TICKS_FLOOR(slack_ms);
+  cpu_enableint(irq_state);
+
+  return 0;
+}
+
+/*
+ * ktimer_delete - disarm a timer before its structure is released
+ *
+ * @timer     - the timer
+ *
+ * A callback that the timer task already started still completes.
+ *
+ * Returns 0 or -EBUSY while the last expiration waits in the worker.
+ */
+int ktimer_delete(ktimer_t *timer)
+{
+  int ret = ktimer_settime(timer, 0, 0);
+
+  if (ret < 0)
+  {
+    return ret;
+  }
+
+  return (timer->work.flags & WORKER_WORK_QUEUED) ? -EBUSY : 0;
+}
+
+#endif /* CONFIG_SCHEDULER_KTIMER */
@@ -0,0 +1,433 @@
+#include <board.h>
+
+#include <errno.h>
+#include <mqueue.h>
+#include <scheduler.h>
+#include <stdlib.h>
+#include <string.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The end of a slot list */
+
+#define MQ_NO_SLOT                  (-1)
+
+/* The largest queue, the slots are linked by an int16_t index */
+
+#define MQ_MAX_SLOTS                (0x7FFF)
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static inline void *mq_slot_data(mq_t *mq, int index)
+{
+  return mq->data + index * mq->slot_size;
+}
+
+static int mq_slot_index(mq_t *mq, const void *slot)
+{
+  const uint8_t *ptr = slot;
+
+  if (ptr < mq->data ||
+      ptr >= mq->data + mq->attr.mq_maxmsg * mq->slot_size ||
+      (ptr - mq->data) % mq->slot_size != 0)
+  {
+    return -EINVAL;
+  }
+
+  return (ptr - mq->data) / mq->slot_size;
+}
+
+/* Take a slot from the free list, the caller owns a free_slots count */
+
+static int mq_pop_free(mq_t *mq)
+{
+  irq_state_t irq_state = cpu_disableint();
+
+  int index = mq->free_head;
+  mq->free_head = mq->slots[index].next;
+
+  cpu_enableint(irq_state);
+  return index;
+}
+
+static void mq_push_free(mq_t *mq, int index)
+{
+  irq_state_t irq_state = cpu_disableint();
+
+  mq->slots[index].next = mq->free_head;
+  mq->free_head = index;
+
+  cpu_enableint(irq_state);
+  sem_post(&mq->free_slots);
+}
+
+/* Queue a filled slot after the messages with the same or a higher
+ * priority. The common case, a priority not higher than the last queued
+ * message, is appended in constant time.
+ */
+
+static void mq_queue_slot(mq_t *mq, int index, size_t len, unsigned int prio)
+{
+  struct mq_slot_s *slot = &mq->slots[index];
+
+  slot->len  = len;
+  slot->prio = prio;
+  slot->next = MQ_NO_SLOT;
+
+  irq_state_t irq_state = cpu_disableint();
+
+  if (mq->head == MQ_NO_SLOT)
+  {
+    mq->head = mq->tail = index;
+  }
+  else if (mq->slots[mq->tail].prio >= prio)
+  {
+    mq->slots[mq->tail].next = index;
+    mq->tail = index;
+  }
+  else if (mq->slots[mq->head].prio < prio)
+  {
+    slot->next = mq->head;
+    mq->head   = index;
+  }
+  else
+  {
+    int prev = mq->head;
+
+    while (mq->slots[mq->slots[prev].next].prio >= prio)
+    {
+      prev = mq->slots[prev].next;
+    }
+
+    slot->next = mq->slots[prev].next;
+    mq->slots[prev].next = index;
+  }
+
+  cpu_enableint(irq_state);
+  sem_post(&mq->used_slots);
+}
+
+/* Take the first message, the caller owns a used_slots count */
+
+static int mq_dequeue_slot(mq_t *mq)
+{
+  irq_state_t irq_state = cpu_disableint();
+
+  int index = mq->head;
+  mq->head = mq->slots[index].next;
+  if (mq->head == MQ_NO_SLOT)
+  {
+    mq->tail = MQ_NO_SLOT;
+  }
+
+  cpu_enableint(irq_state);
+  return index;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/*
+ * mq_init - initialize a message queue
+ *
+ * @mq        - the queue
+ * @attr      - the number of slots and the maximum message size
+ * @buffer    - MQ_BUFFER_SIZE bytes of storage or NULL to allocate it
+ *
+ * All the slots are allocated up front so sending and receiving never touch
+ * the heap.
+ *
+ * Returns 0 on success, -EINVAL for invalid attributes or -ENOMEM.
+ */
+int mq_init(mq_t *mq, const struct mq_attr *attr, void *buffer)
+{
+  if (mq == NULL || attr == NULL || attr->mq_maxmsg == 0 ||
+      attr->mq_maxmsg > MQ_MAX_SLOTS || attr->mq_msgsize == 0 ||
+      attr->mq_msgsize > UINT16_MAX)
+  {
+    return -EINVAL;
+  }
+
+  mq->owns_buffer = buffer == NULL;
+  if (mq->owns_buffer)
+  {
+    buffer = malloc(MQ_BUFFER_SIZE(attr->mq_maxmsg, attr->mq_msgsize));
+    if (buffer == NULL)
+    {
+      return -ENOMEM;
+    }
+  }
+
+  mq->attr      = *attr;
+  mq->slot_size = MQ_SLOT_SIZE(attr->mq_msgsize);
+  mq->slots     = buffer;
+  mq->data      = (uint8_t *)buffer + MQ_SLOTS_SIZE(attr->mq_maxmsg);
+  mq->head      = MQ_NO_SLOT;
+  mq->tail      = MQ_NO_SLOT;
+
+  for (int i = 0; i < attr->mq_maxmsg; i++)
+  {
+    mq->slots[i].next = i + 1 < attr->mq_maxmsg ? i + 1 : MQ_NO_SLOT;
+  }
+
+  mq->free_head = 0;
+
+  sem_init(&mq->free_slots, 0, attr->mq_maxmsg);
+  sem_init(&mq->used_slots, 0, 0);
+
+  return 0;
+}
+
+/*
+ * mq_destroy - release the storage of a message queue
+ *
+ * @mq        - the queue
+ *
+ * No task should be blocked on the queue.
+ *
+ * Returns 0 on success or -EBUSY if a task waits on the queue.
+ */
+int mq_destroy(mq_t *mq)
+{
+  irq_state_t irq_state = cpu_disableint();
+
+  if (mq->free_slots.waiting_list.next != &mq->free_slots.waiting_list ||
+      mq->used_slots.waiting_list.next != &mq->used_slots.waiting_list)
+  {
+    cpu_enableint(irq_state);
+    return -EBUSY;
+  }
+
+  cpu_enableint(irq_state);
+
+  if (mq->owns_buffer)
+  {
+    free(mq->slots);
+  }
+
+  mq->slots = NULL;
+  return 0;
+}
+
+/*
+ * mq_reserve - reserve a slot to build a message in place
+ *
+ * @mq         - the queue
+ * @timeout_ms - how long to wait for a free slot, 0 to not wait or
+ *               MQ_WAIT_FOREVER
+ *
+ * The slot has room for mq_msgsize bytes. It is queued with mq_commit, the
+ * message is not copied. With a zero timeout it can be used from interrupt
+ * context.
+ *
+ * Returns the slot or NULL if no slot got free before the deadline.
+ */
+void *mq_reserve(mq_t *mq, int timeout_ms)
+{
+  if (sem_timedwait(&mq->free_slots, timeout_ms) < 0)
+  {
+    return NULL;
+  }
+
+  return mq_slot_data(mq, mq_pop_free(mq));
+}
+
+/*
+ * mq_commit - queue a slot filled in place
+ *
+ * @mq        - the queue
+ * @slot      - the slot returned by mq_reserve
+ * @len       - the message size
+ * @prio      - the message priority
+ *
+ * It never blocks and it can be used from interrupt context.
+ *
+ * Returns 0 on success or -EINVAL.
+ */
+int mq_commit(mq_t *mq, void *slot, size_t len, unsigned int prio)
+{
+  int index = mq_slot_index(mq, slot);
+
+  if (index < 0 || len > mq->attr.mq_msgsize || prio >= MQ_PRIO_MAX)
+  {
+    return -EINVAL;
+  }
+
+  mq_queue_slot(mq, index, len, prio);
+  return 0;
+}
+
+/*
+ * mq_timedsend - copy a message in the queue
+ *
+ * @mq         - the queue
+ * @msg        - the message
+ * @len        - the message size
+ * @prio       - the message priority, 0 .. MQ_PRIO_MAX - 1
+ * @timeout_ms - how long to wait for a free slot or MQ_WAIT_FOREVER
+ *
+ * The messages are received in decreasing order of priority and in the
+ * order they were sent for the same priority.
+ *
+ * Returns 0 on success, -EMSGSIZE, -EINVAL, -ETIMEDOUT if the queue stayed
+ * full or the errors of sem_timedwait.
+ */
+int mq_timedsend(mq_t *mq, const void *msg, size_t len, unsigned int prio,
+                 int timeout_ms)
+{
+  if (len > mq->attr.mq_msgsize)
+  {
+    return -EMSGSIZE;
+  }
+
+  if (prio >= MQ_PRIO_MAX)
+  {
+    return -EINVAL;
+  }
+
+  int ret = sem_timedwait(&mq->free_slots, timeout_ms);
+  if (ret < 0)
+  {
+    return ret;
+  }
+
+  int index = mq_pop_free(mq);
+  memcpy(mq_slot_data(mq, index), msg, len);
+  mq_queue_slot(mq, index, len, prio);
+
+  return 0;
+}
+
+/*
+ * mq_send - copy a message in the queue, wait while it is full
+ */
+int mq_send(mq_t *mq, const void *msg, size_t len, unsigned int prio)
+{
+  return mq_timedsend(mq, msg, len, prio, MQ_WAIT_FOREVER);
+}
+
+/*
+ * mq_trysend - copy a message in the queue if there is a free slot
+ *
+ * It never blocks and it can be used from interrupt context.
+ *
+ * Returns 0 on success, -EAGAIN if the queue is full, -EMSGSIZE or -EINVAL.
+ */
+int mq_trysend(mq_t *mq, const void *msg, size_t len, unsigned int prio)
+{
+  int ret = mq_timedsend(mq, msg, len, prio, 0);
+  return ret == -ETIMEDOUT ? -EAGAIN : ret;
+}
+
+/*
+ * mq_acquire - take the next message without copying it
+ *
+ * @mq         - the queue
+ * @len        - receives the message size
+ * @prio       - receives the message priority, it can be NULL
+ * @timeout_ms - how long to wait for a message, 0 to not wait or
+ *               MQ_WAIT_FOREVER
+ *
+ * The message stays in its slot until it is given back with mq_release.
+ *
+ * Returns the message or NULL if none arrived before the deadline.
+ */
+void *mq_acquire(mq_t *mq, size_t *len, unsigned int *prio, int timeout_ms)
+{
+  if (sem_timedwait(&mq->used_slots, timeout_ms) < 0)
+  {
+    return NULL;
+  }
+
+  int index = mq_dequeue_slot(mq);
+
+  *len = mq->slots[index].len;
+  if (prio != NULL)
+  {
+    *prio = mq->slots[index].prio;
+  }
+
+  return mq_slot_data(mq, index);
+}
+
+/*
+ * mq_release - give back a slot returned by mq_acquire
+ *
+ * It wakes up a sender that waits for a free slot. It never blocks.
+ *
+ * Returns 0 on success or -EINVAL.
+ */
+int mq_release(mq_t *mq, void *slot)
+{
+  int index = mq_slot_index(mq, slot);
+
+  if (index < 0)
+  {
+    return index;
+  }
+
+  mq_push_free(mq, index);
+  return 0;
+}
+
+/*
+ * mq_timedreceive - copy the next message out of the queue
+ *
+ * @mq         - the queue
+ * @msg        - the buffer, at least mq_msgsize bytes
+ * @len        - the buffer size
+ * @prio       - receives the message priority, it can be NULL
+ * @timeout_ms - how long to wait for a message or MQ_WAIT_FOREVER
+ *
+ * Returns the message size, -EMSGSIZE if the buffer is smaller than
+ * mq_msgsize, -ETIMEDOUT if the queue stayed empty or the errors of
+ * sem_timedwait.
+ */
+ssize_t mq_timedreceive(mq_t *mq, void *msg, size_t len, unsigned int *prio,
+                        int timeout_ms)
+{
+  if (len < mq->attr.mq_msgsize)
+  {
+    return -EMSGSIZE;
+  }
+
+  int ret = sem_timedwait(&mq->used_slots, timeout_ms);
+  if (ret < 0)
+  {
+    return ret;
+  }
+
+  int index = mq_dequeue_slot(mq);
+
+  len = mq->slots[index].len;
+  memcpy(msg, mq_slot_data(mq, index), len);
+  if (prio != NULL)
+  {
+    *prio = mq->slots[index].prio;
+  }
+
+  mq_push_free(mq, index);
+  return len;
+}
+
+/*
+ * mq_receive - copy the next message out of the queue, wait while it is
+ * empty
+ */
+ssize_t mq_receive(mq_t *mq, void *msg, size_t len, unsigned int *prio)
+{
+  return mq_timedreceive(mq, msg, len, prio, MQ_WAIT_FOREVER);
+}
+
+/*
+ * mq_getcount - the number of queued messages that no receiver claimed yet
+ */
+int mq_getcount(mq_t *mq)
+{
+  return mq->used_slots.count;
+}
@@ -15,7 +15,8 @@ void os_appstart(void)
   /* Kick off the console application */
 
 #ifdef CONFIG_CONSOLE_APP
-  sched_create_task(console_main, CONFIG_CONSOLE_STACK_SIZE, 0, NULL, "Console");
+  sched_create_task(console_main, CONFIG_CONSOLE_STACK_SIZE, 0, NULL, "Console",
+                    CONFIG_CONSOLE_PRIORITY);
 #endif
 
   /* The scheduler already kicked of the Idle task which is reponsible for
@@ -5,7 +5,11 @@
 #include <serial.h>
 #include <vfs.h>
 #include <os_start.h>
+#include <procfs.h>
+#include <trace.h>
 #include <semaphore.h>
+#include <worker.h>
+#include <ktimer.h>
 
 #ifndef UNUSED
   #define UNUSED(X)  ((void)(X))
@@ -97,6 +101,34 @@ void __start(void)
 
   vfs_init(NULL, 0);
 
+  /* The work queues can be created from now on */
+
+  worker_init();
+
+#ifdef CONFIG_SCHEDULER_TRACE
+  /* Expose the event trace in /dev/trace */
+
+  trace_init();
+#endif
+
+#ifdef CONFIG_PROCFS
+  /* Expose the kernel statistics in /proc */
+
+  procfs_init();
+#endif
+
+#ifdef CONFIG_IRQ_BOTTOM_HALF
+  /* Start the task that runs the deferred interrupt work */
+
+  irq_bottom_half_init();
+#endif
+
+#ifdef CONFIG_SCHEDULER_KTIMER
+  /* Start the task that runs the software timers */
+
+  ktimer_init();
+#endif
+
   /* This function should be implemented by each board config. It contains
    * the board specific initialization logic and it initializes the drivers.
    */
@@ -0,0 +1,219 @@
+#include <board.h>
+
+#ifdef CONFIG_SCHEDULER_PROFILE
+
+#include <errno.h>
+#include <profile.h>
+#include <scheduler.h>
+#include <string.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#if (CONFIG_SCHEDULER_PROFILE_SLOTS & (CONFIG_SCHEDULER_PROFILE_SLOTS - 1)) != 0
+  #error "CONFIG_SCHEDULER_PROFILE_SLOTS should be a power of two"
+#endif
+
+/* Bound the time spent in the sampling interrupt when the table fills up */
+
+#define PROFILE_MAX_PROBES            (16)
+
+/* The task id used for the samples taken before the first task runs */
+
+#define PROFILE_NO_TASK               (0xFFFF)
+
+/****************************************************************************
+ * Private Variables
+ ****************************************************************************/
+
+/* The histogram, an open addressing hash table keyed by PC and task. A slot
+ * with a zero count is free.
+ */
+
+static struct profile_sample_s g_profile_samples[CONFIG_SCHEDULER_PROFILE_SLOTS];
+
+/* The samples counted for each task */
+
+static struct profile_task_s g_profile_tasks[CONFIG_SCHEDULER_PROFILE_TASKS];
+
+/* The samples that did not fit in the tables */
+
+static volatile uint32_t g_profile_dropped;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void profile_count_task(tcb_t *tcb, uint16_t task_id)
+{
+  for (int i = 0; i < CONFIG_SCHEDULER_PROFILE_TASKS; i++) {
+    struct profile_task_s *task = &g_profile_tasks[i];
+
+    if (task->count == 0) {
+      task->task_id = task_id;
+      if (tcb != NULL) {
+        strncpy(task->name, tcb->task_name, PROFILE_TASK_NAME_LEN - 1);
+      }
+    }
+
+    if (task->task_id == task_id) {
+      task->count++;
+      return;
+    }
+  }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/**************************************************************************
+ * Name:
+ *  profile_sample
+ *
+ * Description:
+ *  Count a sample at the interrupted PC for the current task. It is called
+ *  by the board from the sampling interrupt with the interrupts disabled.
+ *
+ *************************************************************************/
+
+void profile_sample(uintptr_t pc)
+{
+  tcb_t *tcb = sched_get_current_task();
+  uint16_t task_id = tcb != NULL ? tcb->task_id : PROFILE_NO_TASK;
+  uint32_t hash = ((uint32_t)(pc >> 1) ^ task_id) * 2654435761u;
+
+  profile_count_task(tcb, task_id);
+
+  for (int i = 0; i < PROFILE_MAX_PROBES; i++) {
+    struct profile_sample_s *sample =
+      &g_profile_samples[(hash + i) & (CONFIG_SCHEDULER_PROFILE_SLOTS - 1)];
+
+    if (sample->count == 0) {
+      sample->pc      = pc;
+      sample->task_id = task_id;
+    }
+
+    if (sample->pc == pc && sample->task_id == task_id) {
+      sample->count++;
+      return;
+    }
+  }
+
+  g_profile_dropped++;
+}
+
+/**************************************************************************
+ * Name:
+ *  profile_start
+ *
+ * Description:
+ *  Drop the previous samples and start sampling the interrupted PC
+ *  frequency times per second.
+ *
+ * Return Value:
+ *  OK on success, -EINVAL if the frequency is 0.
+ *
+ *************************************************************************/
+
+int profile_start(unsigned int frequency)
+{
+  if (frequency == 0) {
+    return -EINVAL;
+  }
+
+  board_profile_timer(0);
+
+  irq_state_t irq_state = cpu_disableint();
+  memset(g_profile_samples, 0, sizeof(g_profile_samples));
+  memset(g_profile_tasks, 0, sizeof(g_profile_tasks));
+  g_profile_dropped = 0;
+  cpu_enableint(irq_state);
+
+  board_profile_timer(frequency);
+  return OK;
+}
+
+/**************************************************************************
+ * Name:
+ *  profile_stop
+ *
+ * Description:
+ *  Stop sampling, the histogram is kept until the next profile_start.
+ *
+ *************************************************************************/
+
+void profile_stop(void)
+{
+  board_profile_timer(0);
+}
+
+/**************************************************************************
+ * Name:
+ *  profile_snapshot
+ *
+ * Description:
+ *  Copy the non empty histogram entries. Stop the sampling first to get a
+ *  consistent copy.
+ *
+ * Return Value:
+ *  The number of entries copied.
+ *
+ *************************************************************************/
+
+int profile_snapshot(struct profile_sample_s *samples, int max_samples)
+{
+  int num_samples = 0;
+
+  for (int i = 0; i < CONFIG_SCHEDULER_PROFILE_SLOTS &&
+       num_samples < max_samples; i++) {
+    if (g_profile_samples[i].count > 0) {
+      samples[num_samples++] = g_profile_samples[i];
+    }
+  }
+
+  return num_samples;
+}
+
+/**************************************************************************
+ * Name:
+ *  profile_tasks
+ *
+ * Description:
+ *  Copy the sample counters of the tasks that were seen running.
+ *
+ * Return Value:
+ *  The number of tasks copied.
+ *
+ *************************************************************************/
+
+int profile_tasks(struct profile_task_s *tasks, int max_tasks)
+{
+  int num_tasks = 0;
+
+  for (int i = 0; i < CONFIG_SCHEDULER_PROFILE_TASKS &&
+       num_tasks < max_tasks; i++) {
+    if (g_profile_tasks[i].count > 0) {
+      tasks[num_tasks++] = g_profile_tasks[i];
+    }
+  }
+
+  return num_tasks;
+}
+
+/**************************************************************************
+ * Name:
+ *  profile_dropped
+ *
+ * Description:
+ *  The number of samples that did not fit in the histogram.
+ *
+ *************************************************************************/
+
+uint32_t profile_dropped(void)
+{
+  return g_profile_dropped;
+}
+
+#endif /* CONFIG_SCHEDULER_PROFILE */
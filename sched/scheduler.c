@@ -7,6 +7,7 @@
 
 #include <board.h>
 #include <scheduler.h>
+#include <irq_manager.h>
 
 #include <errno.h>
 #include <stdlib.h>
@@ -14,22 +15,863 @@
 #include <vfs.h>
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
+#include <trace.h>
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* The scheduler state of a CPU */
+
+struct sched_cpu_s {
+  /* The ready to run lists, one for each priority level. The running task
+   * is kept at the head of the list that matches its priority.
+   */
+
+  struct list_head ready_list[CONFIG_SCHEDULER_NUM_PRIORITIES];
+
+  /* Bit N is set when the ready list for priority N is not empty */
+
+  volatile uint32_t ready_bitmap;
+
+  /* The current running task */
+
+  struct list_head *current_tcb;
+
+#ifdef CONFIG_SCHEDULER_SMP
+  /* The Idle task pinned to this CPU */
+
+  tcb_t *idle_tcb;
+#endif
+
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+  /* When the current task was switched in or last charged */
+
+  uint32_t switch_us;
+#endif
+};
 
 /****************************************************************************
  * Public variables defintion
  ****************************************************************************/
 
-/* This list holds the ready to run and the runing task */
+/* The list holds the halted tasks. The tasks waiting for a semaphore are
+ * kept in the waiting list of that semaphore.
+ */
+
+LIST_HEAD(g_tcb_waiting_list);
+
+/* The tasks that wait for a deadline ordered by their wake-up tick. It holds
+ * the SLEEPING tasks and the tasks that wait for a semaphore with a timeout.
+ */
+
+static LIST_HEAD(g_timeout_list);
+
+/* The number of ticks since the scheduler started. In tickless mode this is
+ * the last tick processed by sched_tick and the current time comes from the
+ * board.
+ */
+
+static volatile uint32_t g_sched_ticks;
+
+#ifdef CONFIG_SCHEDULER_TICKLESS
+/* The tick the one-shot timer is programmed for, valid while it is armed */
+
+static uint32_t g_alarm_tick;
+static bool g_alarm_armed;
+#endif
+
+/* Every task from creation until the Idle task tears it down */
+
+static LIST_HEAD(g_task_list);
+
+/* The scheduler state of each CPU */
+
+static struct sched_cpu_s g_sched_cpus[SCHED_NCPUS];
+
+/* The number given to the next created task */
+
+static uint32_t g_next_task_id;
+
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+/* The time accounted since the scheduler started, summed over the CPUs */
+
+static struct sched_time_s g_sched_uptime;
+
+/* The time the board spent in board_entersleep */
+
+static struct sched_time_s g_sched_sleep_time;
+#endif
+
+#ifdef CONFIG_SCHEDULER_TASK_POOL
+/* The recycled TCB and stack slots, one list for each stack size class. A
+ * slot is linked through its next_tcb node.
+ */
+
+static struct list_head g_task_pool[SCHED_POOL_NUM_CLASSES];
+
+/* The number of slots kept in each size class */
+
+static uint8_t g_task_pool_count[SCHED_POOL_NUM_CLASSES];
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/**************************************************************************
+ * Name:
+ *  sched_fd_alloc
+ *
+ * Description:
+ *  Find the lowest unused file descriptor in the task fd table. When every
+ *  entry is in use the table and the bitmap grow with
+ *  CONFIG_SCHEDULER_FD_TABLE_CHUNK entries.
+ *
+ * Assumptions:
+ *  Call this function with pre-emption disabled.
+ *
+ * Return Value:
+ *  The file descriptor or -ENOMEM if the table could not be grown.
+ *
+ *************************************************************************/
+
+static int sched_fd_alloc(struct tcb_s *tcb)
+{
+  uint32_t num_words = (tcb->fd_table_size + 31) / 32;
+
+  for (uint32_t i = 0; i < num_words; i++) {
+    if (tcb->fd_bitmap[i] != UINT32_MAX) {
+      int fd = i * 32 + __builtin_ctz(~tcb->fd_bitmap[i]);
+      if (fd < tcb->fd_table_size) {
+        return fd;
+      }
+    }
+  }
+
+  uint32_t new_size = tcb->fd_table_size + CONFIG_SCHEDULER_FD_TABLE_CHUNK;
+  uint32_t new_words = (new_size + 31) / 32;
+
+  struct opened_resource_s **new_table = realloc(tcb->fd_table,
+      new_size * sizeof(struct opened_resource_s *));
+  if (new_table == NULL) {
+    return -ENOMEM;
+  }
+
+  tcb->fd_table = new_table;
+  memset(&new_table[tcb->fd_table_size], 0,
+         CONFIG_SCHEDULER_FD_TABLE_CHUNK * sizeof(struct opened_resource_s *));
+
+  if (new_words > num_words) {
+    uint32_t *new_bitmap = realloc(tcb->fd_bitmap,
+                                   new_words * sizeof(uint32_t));
+    if (new_bitmap == NULL) {
+      return -ENOMEM;
+    }
+
+    tcb->fd_bitmap = new_bitmap;
+    memset(&new_bitmap[num_words], 0,
+           (new_words - num_words) * sizeof(uint32_t));
+  }
+
+  int fd = tcb->fd_table_size;
+  tcb->fd_table_size = new_size;
+
+  return fd;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_fd_release
+ *
+ * Description:
+ *  Remove the resource stored at fd from the task fd table and free it.
+ *
+ * Assumptions:
+ *  Call this function with pre-emption disabled.
+ *
+ * Return Value:
+ *  The released resource vfs node or NULL if the fd is not opened.
+ *
+ *************************************************************************/
+
+static struct vfs_node_s *sched_fd_release(struct tcb_s *tcb, int fd)
+{
+  if (fd < 0 || fd >= tcb->fd_table_size || tcb->fd_table[fd] == NULL) {
+    return NULL;
+  }
+
+  struct vfs_node_s *node = tcb->fd_table[fd]->vfs_node;
+
+  free(tcb->fd_table[fd]);
+  tcb->fd_table[fd] = NULL;
+  tcb->fd_bitmap[fd / 32] &= ~(1U << (fd % 32));
+
+  return node;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_release_task_resources
+ *
+ * Description:
+ *  Free the fd table of a halted task together with any resource that was
+ *  left opened. The driver close callback is not invoked because the idle
+ *  task which runs this must not block.
+ *
+ *************************************************************************/
+
+static void sched_release_task_resources(struct tcb_s *tcb)
+{
+  for (int fd = 0; fd < tcb->fd_table_size; fd++) {
+    struct vfs_node_s *node = sched_fd_release(tcb, fd);
+    if (node != NULL && node->open_count > 0) {
+      node->open_count -= 1;
+    }
+  }
+
+  free(tcb->fd_table);
+  free(tcb->fd_bitmap);
+
+  tcb->fd_table      = NULL;
+  tcb->fd_bitmap     = NULL;
+  tcb->fd_table_size = 0;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_this_cpu
+ *
+ * Description:
+ *  Get the scheduler state of the CPU that runs the caller.
+ *
+ *************************************************************************/
+
+static inline struct sched_cpu_s *sched_this_cpu(void)
+{
+#ifdef CONFIG_SCHEDULER_SMP
+  return &g_sched_cpus[cpu_getid()];
+#else
+  return &g_sched_cpus[0];
+#endif
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_task_cpu
+ *
+ * Description:
+ *  Get the scheduler state of the CPU whose ready lists hold the task.
+ *
+ *************************************************************************/
+
+static inline struct sched_cpu_s *sched_task_cpu(tcb_t *tcb)
+{
+#ifdef CONFIG_SCHEDULER_SMP
+  return &g_sched_cpus[tcb->cpu];
+#else
+  return &g_sched_cpus[0];
+#endif
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_ready_add
+ *
+ * Description:
+ *  Place a task at the end of the ready list that matches its priority and
+ *  mark the priority level as runnable.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ *************************************************************************/
+
+static inline void sched_ready_add(tcb_t *tcb)
+{
+  struct sched_cpu_s *cpu = sched_task_cpu(tcb);
+
+  list_add_tail(&tcb->next_tcb, &cpu->ready_list[tcb->priority]);
+  cpu->ready_bitmap |= (1 << tcb->priority);
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_ready_del
+ *
+ * Description:
+ *  Remove a task from its ready list and clear the priority bit if the list
+ *  becomes empty.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ *************************************************************************/
+
+static inline void sched_ready_del(tcb_t *tcb)
+{
+  struct sched_cpu_s *cpu = sched_task_cpu(tcb);
+  struct list_head *ready_list = &cpu->ready_list[tcb->priority];
+
+  list_del(&tcb->next_tcb);
+  if (ready_list->next == ready_list)
+  {
+    cpu->ready_bitmap &= ~(1 << tcb->priority);
+  }
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_ready_highest
+ *
+ * Description:
+ *  Find the first task from the highest priority ready list. The lookup
+ *  does not depend on the number of tasks in the system, it only counts the
+ *  leading zeros from the ready bitmap.
+ *
+ * Return Value:
+ *  The TCB of the most urgent ready task or NULL if no task is ready.
+ *
+ *************************************************************************/
+
+static inline tcb_t *sched_ready_highest(struct sched_cpu_s *cpu)
+{
+  if (cpu->ready_bitmap == 0)
+  {
+    return NULL;
+  }
+
+  int priority = 31 - __builtin_clz(cpu->ready_bitmap);
+  return container_of(cpu->ready_list[priority].next, tcb_t, next_tcb);
+}
+
+#ifdef CONFIG_SCHEDULER_TICKLESS
+/**************************************************************************
+ * Name:
+ *  sched_timeout_deadline
+ *
+ * Description:
+ *  The latest tick that wakes up every waiter within its slack window,
+ *  from its wake-up tick to the wake-up tick plus its timer slack. The
+ *  waiters that wake up after that tick can't move it earlier so we stop
+ *  at the first one.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled and a non empty timeout
+ *  list.
+ *
+ *************************************************************************/
+
+static uint32_t sched_timeout_deadline(void)
+{
+  struct list_head *pos;
+  tcb_t *waiter = container_of(g_timeout_list.next, tcb_t, timeout_node);
+  uint32_t deadline = waiter->wake_tick + waiter->timer_slack;
+
+  for (pos = g_timeout_list.next->next; pos != &g_timeout_list;
+       pos = pos->next)
+  {
+    waiter = container_of(pos, tcb_t, timeout_node);
+
+    if ((int32_t)(waiter->wake_tick - deadline) > 0)
+    {
+      break;
+    }
+
+    if ((int32_t)(waiter->wake_tick + waiter->timer_slack - deadline) < 0)
+    {
+      deadline = waiter->wake_tick + waiter->timer_slack;
+    }
+  }
+
+  return deadline;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_alarm_set
+ *
+ * Description:
+ *  Program the one-shot timer, the waiters whose wake-up tick comes before
+ *  the deadline are woken up together when it fires.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ *************************************************************************/
+
+static void sched_alarm_set(uint32_t deadline)
+{
+  g_alarm_tick  = deadline;
+  g_alarm_armed = true;
+  board_tickless_set_alarm(deadline);
+}
+#endif
+
+/**************************************************************************
+ * Name:
+ *  sched_timeout_add
+ *
+ * Description:
+ *  Insert a task in the timeout list. The list is ordered by the wake-up
+ *  tick so the tick handler only has to look at the head of the list.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ *************************************************************************/
+
+static void sched_timeout_add(tcb_t *tcb)
+{
+  struct list_head *pos;
+  tcb_t *waiter;
+
+  for (pos = g_timeout_list.next; pos != &g_timeout_list; pos = pos->next)
+  {
+    waiter = container_of(pos, tcb_t, timeout_node);
+
+    /* Keep the tasks with the same wake-up tick in FIFO order */
+
+    if ((int32_t)(waiter->wake_tick - tcb->wake_tick) > 0)
+    {
+      break;
+    }
+  }
+
+  list_add_tail(&tcb->timeout_node, pos);
+
+#ifdef CONFIG_SCHEDULER_TICKLESS
+  /* The one-shot timer moves only when the new window ends before it */
+
+  uint32_t deadline = tcb->wake_tick + tcb->timer_slack;
+
+  if (!g_alarm_armed || (int32_t)(deadline - g_alarm_tick) < 0)
+  {
+    sched_alarm_set(deadline);
+  }
+#endif
+}
+
+#ifdef CONFIG_SCHEDULER_SMP
+/**************************************************************************
+ * Name:
+ *  sched_smp_cpu_is_idle
+ *
+ * Description:
+ *  Verify if a CPU runs its Idle task or if it did not start yet.
+ *
+ *************************************************************************/
+
+static bool sched_smp_cpu_is_idle(int cpu_id)
+{
+  struct sched_cpu_s *cpu = &g_sched_cpus[cpu_id];
+
+  return cpu->current_tcb == NULL ||
+         cpu->current_tcb == &cpu->idle_tcb->next_tcb;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_smp_ready_add
+ *
+ * Description:
+ *  Make a task ready on a CPU from its affinity mask. The CPU it ran on
+ *  last is preferred unless it is busy and another allowed CPU is idle.
+ *  A CPU other than ours gets an inter-processor interrupt to leave the
+ *  sleep.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ *************************************************************************/
+
+static void sched_smp_ready_add(tcb_t *tcb)
+{
+  int cpu_id = tcb->cpu;
+
+  if ((tcb->affinity & (1U << cpu_id)) == 0)
+  {
+    cpu_id = __builtin_ctz(tcb->affinity);
+  }
+
+  if (!sched_smp_cpu_is_idle(cpu_id))
+  {
+    for (int i = 0; i < SCHED_NCPUS; i++)
+    {
+      if ((tcb->affinity & (1U << i)) && sched_smp_cpu_is_idle(i))
+      {
+        cpu_id = i;
+        break;
+      }
+    }
+  }
+
+  tcb->cpu = cpu_id;
+  sched_ready_add(tcb);
+
+  if (cpu_id != cpu_getid() && g_sched_cpus[cpu_id].current_tcb != NULL)
+  {
+    cpu_send_ipi(cpu_id);
+  }
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_smp_find_steal
+ *
+ * Description:
+ *  Look in the ready lists of the other CPUs for the most urgent task that
+ *  is allowed to run on cpu_id. The running tasks are skipped, including a
+ *  task that is about to leave its CPU.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ * Return Value:
+ *  The TCB of the task or NULL if there is nothing to steal.
+ *
+ *************************************************************************/
+
+static tcb_t *sched_smp_find_steal(int cpu_id)
+{
+  tcb_t *best = NULL;
+
+  for (int i = 0; i < SCHED_NCPUS; i++)
+  {
+    struct sched_cpu_s *cpu = &g_sched_cpus[i];
+    uint32_t ready_bitmap = cpu->ready_bitmap;
+
+    if (i == cpu_id)
+    {
+      continue;
+    }
+
+    while (ready_bitmap != 0)
+    {
+      int priority = 31 - __builtin_clz(ready_bitmap);
+      struct list_head *pos;
+
+      if (best != NULL && priority <= best->priority)
+      {
+        break;
+      }
+
+      ready_bitmap &= ~(1U << priority);
+
+      for (pos = cpu->ready_list[priority].next;
+           pos != &cpu->ready_list[priority];
+           pos = pos->next)
+      {
+        tcb_t *tcb = container_of(pos, tcb_t, next_tcb);
+
+        if (tcb->t_state == READY && pos != cpu->current_tcb &&
+            (tcb->affinity & (1U << cpu_id)))
+        {
+          best = tcb;
+          break;
+        }
+      }
+    }
+  }
+
+  return best;
+}
+#endif /* CONFIG_SCHEDULER_SMP */
+
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+/**************************************************************************
+ * Name:
+ *  sched_time_add
+ *
+ * Description:
+ *  Add a number of microseconds to a time counter.
+ *
+ *************************************************************************/
+
+static void sched_time_add(struct sched_time_s *time, uint32_t delta_us)
+{
+  time->us += delta_us % 1000;
+  time->ms += delta_us / 1000 + time->us / 1000;
+  time->us %= 1000;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_account_run
+ *
+ * Description:
+ *  Charge the time elapsed since the last switch to the running task.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ * Return Value:
+ *  The current clock value.
+ *
+ *************************************************************************/
+
+static uint32_t sched_account_run(tcb_t *tcb)
+{
+  struct sched_cpu_s *cpu = sched_this_cpu();
+  uint32_t now = sched_clock_us();
+  uint32_t delta_us = now - cpu->switch_us;
+
+  sched_time_add(&tcb->run_time, delta_us);
+  sched_time_add(&g_sched_uptime, delta_us);
+  cpu->switch_us = now;
+
+  return now;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_account_switch
+ *
+ * Description:
+ *  Update the counters of the task that leaves the CPU. A task that is
+ *  still ready was switched out involuntarily, otherwise it blocked.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ *************************************************************************/
+
+static void sched_account_switch(tcb_t *prev_tcb, tcb_t *next_tcb)
+{
+  uint32_t now = sched_account_run(prev_tcb);
+
+  if (prev_tcb == next_tcb)
+  {
+    return;
+  }
+
+  if (prev_tcb->t_state == READY)
+  {
+    prev_tcb->nivcsw++;
+  }
+  else
+  {
+    prev_tcb->nvcsw++;
+
+    if (prev_tcb->t_state == WAITING_FOR_SEM)
+    {
+      prev_tcb->wait_start_us = now;
+    }
+  }
+}
+#endif /* CONFIG_SCHEDULER_CPU_STATS */
+
+#ifdef CONFIG_SCHEDULER_TASK_POOL
+/**************************************************************************
+ * Name:
+ *  sched_pool_class
+ *
+ * Description:
+ *  Get the size class of a stack. Class N holds stacks of
+ *  (1 << (SCHED_POOL_MIN_SHIFT + N)) bytes.
+ *
+ * Return Value:
+ *  The size class or a negative value if the stack is too big to be pooled.
+ *
+ *************************************************************************/
+
+static int sched_pool_class(uint32_t stack_size)
+{
+  int shift = SCHED_POOL_MIN_SHIFT;
+
+  while ((1U << shift) < stack_size)
+  {
+    shift++;
+  }
+
+  shift -= SCHED_POOL_MIN_SHIFT;
+  return shift < SCHED_POOL_NUM_CLASSES ? shift : -ENOMEM;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_pool_get
+ *
+ * Description:
+ *  Take a TCB and stack slot from the pool or allocate a new one if the
+ *  size class is empty. The slot stack is the full size of its class.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ * Return Value:
+ *  The slot TCB or NULL if we are running out of memory.
+ *
+ *************************************************************************/
+
+static struct tcb_s *sched_pool_get(int class, uint32_t *stack_size)
+{
+  struct tcb_s *tcb;
+
+  *stack_size = 1U << (SCHED_POOL_MIN_SHIFT + class);
+
+  if (g_task_pool[class].next != &g_task_pool[class])
+  {
+    tcb = container_of(g_task_pool[class].next, tcb_t, next_tcb);
+    list_del(&tcb->next_tcb);
+    g_task_pool_count[class]--;
+    memset(tcb, 0, sizeof(struct tcb_s));
+  }
+  else
+  {
+    tcb = calloc(1, sizeof(struct tcb_s) + *stack_size);
+    if (tcb == NULL)
+    {
+      return NULL;
+    }
+  }
+
+  tcb->tcb_flags = TCB_FLAG_POOLED;
+  return tcb;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_pool_put
+ *
+ * Description:
+ *  Give a slot back to the pool of its size class.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ * Return Value:
+ *  True if the pool kept the slot, false if the class is full and the
+ *  caller has to free the slot.
+ *
+ *************************************************************************/
+
+static bool sched_pool_put(struct tcb_s *tcb)
+{
+  int class = sched_pool_class(tcb->stack_ptr_top - tcb->stack_ptr_base);
+  if (class < 0 || g_task_pool_count[class] >= CONFIG_SCHEDULER_TASK_POOL_SLOTS)
+  {
+    return false;
+  }
+
+  list_add(&tcb->next_tcb, &g_task_pool[class]);
+  g_task_pool_count[class]++;
+  return true;
+}
+#endif /* CONFIG_SCHEDULER_TASK_POOL */
+
+/**************************************************************************
+ * Name:
+ *  sched_release_task_memory
+ *
+ * Description:
+ *  Give back the TCB and the stack of a halted task to its owner: the pool,
+ *  the heap or the caller of sched_create_static_task.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ *************************************************************************/
+
+static void sched_release_task_memory(struct tcb_s *tcb)
+{
+  if (tcb->tcb_flags & TCB_FLAG_STATIC)
+  {
+    /* Mark the static TCB as free to be used again */
+
+    INIT_LIST_HEAD(&tcb->next_tcb);
+    return;
+  }
+
+#ifdef CONFIG_SCHEDULER_TASK_POOL
+  if ((tcb->tcb_flags & TCB_FLAG_POOLED) && sched_pool_put(tcb))
+  {
+    return;
+  }
+#endif
+
+  free(tcb);
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_setup_task
+ *
+ * Description:
+ *  Initialize a zeroed TCB with its stack and make it ready to run.
+ *
+ * Assumptions:
+ *  Call this function with interrupts disabled.
+ *
+ * Return Value:
+ *  OK in case of success otherwise a negate value.
+ *
+ *************************************************************************/
+
+static int sched_setup_task(struct tcb_s *task_tcb,
+                            void *stack,
+                            uint32_t stack_size,
+                            int (*task_entry_point)(int argc, char **argv),
+                            int argc,
+                            char **argv,
+                            const char *task_name,
+                            uint8_t priority)
+{
+  task_tcb->entry_point    = task_entry_point;
+  task_tcb->stack_ptr_base = stack;
+  task_tcb->stack_ptr_top  = stack + stack_size;
+  task_tcb->t_state        = READY;
+  task_tcb->priority       = priority;
+  task_tcb->task_id        = g_next_task_id++;
+
+  if (task_name != NULL)
+  {
+    strncpy((char *)task_tcb->task_name, task_name, CONFIG_TASK_NAME_LEN - 1);
+  }
+
+#ifdef CONFIG_SCHEDULER_TRACE
+  uint32_t name_chars[2] = { 0 };
+  strncpy((char *)name_chars, task_tcb->task_name, sizeof(name_chars));
+  trace_record_task(task_tcb->task_id, TRACE_TASK_CREATE, priority,
+                    name_chars[0], name_chars[1]);
+#endif
 
-LIST_HEAD(g_tcb_list);
+#ifdef CONFIG_SCHEDULER_TASK_COLORATION
+  /* Paint the whole stack, sched_get_stack_usage looks for the first word
+   * that was overwritten.
+   */
 
-/* The list holds the waiting for semaphore and the halted tasks */
+  uint32_t *ptr_end = (uint32_t *)task_tcb->stack_ptr_top;
 
-LIST_HEAD(g_tcb_waiting_list);
+  for (uint32_t *ptr = task_tcb->stack_ptr_base; ptr < ptr_end; ptr++)
+  {
+    *ptr = SCHED_STACK_COLOR;
+  }
+#endif
+
+  int ret = cpu_inittask(task_tcb, argc, argv);
+  if (ret < 0) {
+    return ret;
+  }
 
-/* The current running task */
+  INIT_LIST_HEAD(&task_tcb->timeout_node);
+  task_tcb->timer_slack = SCHED_MS_TO_TICKS_FLOOR(CONFIG_SCHEDULER_TIMER_SLACK_MS);
+  list_add_tail(&task_tcb->task_node, &g_task_list);
 
-struct list_head *g_current_tcb = NULL;
+  /* Insert the task in the ready list */
+
+#ifdef CONFIG_SCHEDULER_SMP
+  task_tcb->cpu      = cpu_getid();
+  task_tcb->affinity = SCHED_CPU_MASK_ALL;
+  sched_smp_ready_add(task_tcb);
+#else
+  sched_ready_add(task_tcb);
+#endif
+
+  SCHED_DEBUG_INFO("created task %s\n", task_name);
+  return OK;
+}
 
 /**************************************************************************
  * Name:
@@ -49,7 +891,6 @@ static int sched_idle_task(int argc, char **argv)
 {
   tcb_t *current_tcb;
   struct list_head *current, *temp;
-  int fd;
 
   current_tcb = sched_get_current_task();
   SCHED_DEBUG_INFO("[%s] entry point\n", current_tcb->task_name);
@@ -77,17 +918,16 @@ static int sched_idle_task(int argc, char **argv)
       /* Remove the task from the waiting list if it's in HALTED state */
 
       list_del(current);
+      list_del(&current_tcb->task_node);
 
-      /* Close the opened resources */
+      /* Release the fd table of the halted task */
 
-      for (fd = 0; fd < current_tcb->curr_resource_opened; fd++)
-      {
-        sched_free_resource(fd);
-      }
+      sched_release_task_resources(current_tcb);
 
-      /* Tear down the task context */
+      /* Tear down the task context and give back the task memory */
 
       cpu_destroytask(current_tcb);
+      sched_release_task_memory(current_tcb);
     }
 
     cpu_enableint(irq_mask);
@@ -98,9 +938,29 @@ static int sched_idle_task(int argc, char **argv)
 
 #ifdef CONFIG_BOARD_SLEEP
 
-    /* Put the board in sleep */
+    /* Put the board in sleep if nobody else is ready. The interrupts stay
+     * disabled between the check and the sleep so that a wakeup can't slip
+     * in between, the board wakes up on the pending interrupt. On SMP a
+     * task waiting on another CPU is stolen instead.
+     */
+
+    irq_mask = cpu_disableint();
+    bool can_sleep = !sched_has_ready_task(sched_get_current_task());
+#ifdef CONFIG_SCHEDULER_SMP
+    can_sleep = can_sleep && sched_smp_find_steal(cpu_getid()) == NULL;
+#endif
+    if (can_sleep)
+    {
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+      uint32_t sleep_start_us = sched_clock_us();
+      board_entersleep();
+      sched_time_add(&g_sched_sleep_time, sched_clock_us() - sleep_start_us);
+#else
+      board_entersleep();
+#endif
+    }
 
-    board_entersleep();
+    cpu_enableint(irq_mask);
 #endif
   }
 
@@ -121,17 +981,68 @@ static int sched_idle_task(int argc, char **argv)
 
 int sched_init(void)
 {
+  for (int cpu = 0; cpu < SCHED_NCPUS; cpu++)
+  {
+    for (int i = 0; i < CONFIG_SCHEDULER_NUM_PRIORITIES; i++)
+    {
+      INIT_LIST_HEAD(&g_sched_cpus[cpu].ready_list[i]);
+    }
+
+    g_sched_cpus[cpu].ready_bitmap = 0;
+  }
+
+#ifdef CONFIG_SCHEDULER_TASK_POOL
+  for (int i = 0; i < SCHED_POOL_NUM_CLASSES; i++)
+  {
+    INIT_LIST_HEAD(&g_task_pool[i]);
+    g_task_pool_count[i] = 0;
+  }
+#endif
+
   int ret = sched_create_task(sched_idle_task,
                               CONFIG_SCHEDULER_IDLE_TASK_STACK_SIZE,
                               0,
                               NULL,
-                              "Idle");
+                              "Idle",
+                              SCHED_PRIORITY_IDLE);
   if (ret < 0)
   {
     SCHED_ERROR("failed to create Idle task %d\n", ret);
     return ret;
   }
 
+#ifdef CONFIG_SCHEDULER_SMP
+  /* Every CPU has its own Idle task pinned to it. The tasks created so far
+   * are on the boot CPU, the last one is the Idle task we just created.
+   */
+
+  g_sched_cpus[0].idle_tcb = container_of(g_task_list.prev, tcb_t,
+                                          task_node);
+  sched_set_affinity(g_sched_cpus[0].idle_tcb, 1U << 0);
+
+  for (int cpu = 1; cpu < SCHED_NCPUS; cpu++)
+  {
+    char idle_name[CONFIG_TASK_NAME_LEN];
+
+    snprintf(idle_name, sizeof(idle_name), "Idle%d", cpu);
+    ret = sched_create_task(sched_idle_task,
+                            CONFIG_SCHEDULER_IDLE_TASK_STACK_SIZE,
+                            0,
+                            NULL,
+                            idle_name,
+                            SCHED_PRIORITY_IDLE);
+    if (ret < 0)
+    {
+      SCHED_ERROR("failed to create Idle task %d\n", ret);
+      return ret;
+    }
+
+    g_sched_cpus[cpu].idle_tcb = container_of(g_task_list.prev, tcb_t,
+                                              task_node);
+    sched_set_affinity(g_sched_cpus[cpu].idle_tcb, 1U << cpu);
+  }
+#endif
+
   return 0;
 }
 
@@ -149,13 +1060,26 @@ int sched_init(void)
 
 void sched_default_task_exit_point(void)
 {
+  tcb_t *this_tcb = sched_get_current_task();
+
+  /* Close the resources left opened while we can still block in the
+   * driver close callback.
+   */
+
+  for (int fd = 0; fd < this_tcb->fd_table_size; fd++) {
+    if (this_tcb->fd_table[fd] != NULL) {
+      close(fd);
+    }
+  }
+
+  TRACE_EVENT(TRACE_TASK_EXIT, 0, 0, 0);
+
   irq_state_t irq_state = cpu_disableint();
 
   /* Move this task in the HALT state and wait for the idle task to clean up
    * it's memory.
    */
 
-  tcb_t *this_tcb             = sched_get_current_task();
   this_tcb->t_state           = HALTED;
   this_tcb->waiting_tcb_sema  = NULL;
 
@@ -171,14 +1095,19 @@ void sched_default_task_exit_point(void)
  *  sched_create_task
  *
  * Description:
- *  Create a new task.
+ *  Create a new task. The TCB and the stack are allocated together, from
+ *  the task pool when CONFIG_SCHEDULER_TASK_POOL is enabled or from the
+ *  heap otherwise.
  *
  * Input Parameters:
  *  task_entry_point - the entry point of a task
  *  stack_size       - the stack size of the new task
  *  argc             - the number of arguments
- *  argv             - the task arguments
+ *  argv             - the task arguments or, when argc is 0, an opaque
+ *                     pointer that the entry point receives unchanged
  *  task_name        - a NULL terminated string representing the task name
+ *  priority         - the task priority, from SCHED_PRIORITY_IDLE up to
+ *                     SCHED_PRIORITY_MAX
  *
  * Assumptions:
  *  Call this function with interrupts disabled.
@@ -192,89 +1121,513 @@ int sched_create_task(int (*task_entry_point)(int argc, char **argv),
                       uint32_t stack_size,
                       int argc,
                       char **argv,
-                      const char *task_name)
+                      const char *task_name,
+                      uint8_t priority)
+{
+  irq_state_t irq_state;
+  int ret;
+
+  if (priority > SCHED_PRIORITY_MAX)
+  {
+    return -EINVAL;
+  }
+
+  irq_state = cpu_disableint();
+
+  SCHED_DEBUG_INFO("try create task %s\n", task_name);
+
+  struct tcb_s *task_tcb;
+
+#ifdef CONFIG_SCHEDULER_TASK_POOL
+  int class = sched_pool_class(stack_size);
+  if (class >= 0)
+  {
+    task_tcb = sched_pool_get(class, &stack_size);
+  }
+  else
+#endif
+  {
+    task_tcb = calloc(1, sizeof(struct tcb_s) + stack_size);
+  }
+
+  if (task_tcb == NULL)
+  {
+    ret = -ENOMEM;
+    goto failed_task_creation;
+  }
+
+  ret = sched_setup_task(task_tcb, (void *)task_tcb + sizeof(struct tcb_s),
+                         stack_size, task_entry_point, argc, argv, task_name,
+                         priority);
+  if (ret < 0) {
+    sched_release_task_memory(task_tcb);
+  }
+
+failed_task_creation:
+  cpu_enableint(irq_state);
+  return ret;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_create_static_task
+ *
+ * Description:
+ *  Create a new task from a TCB and a stack provided by the caller. Nothing
+ *  is allocated from the heap. When the task exits the idle task leaves the
+ *  memory to the caller and the TCB can be used again.
+ *
+ * Input Parameters:
+ *  task_tcb         - a zeroed TCB or the TCB of a task that was torn down
+ *  stack            - the task stack, aligned to 8 bytes
+ *  stack_size       - the stack size of the new task
+ *  task_entry_point - the entry point of a task
+ *  argc             - the number of arguments
+ *  argv             - the task arguments or, when argc is 0, an opaque
+ *                     pointer that the entry point receives unchanged
+ *  task_name        - a NULL terminated string representing the task name
+ *  priority         - the task priority, from SCHED_PRIORITY_IDLE up to
+ *                     SCHED_PRIORITY_MAX
+ *
+ * Return Value:
+ *  OK in case of success, -EBUSY if the TCB still belongs to a task or
+ *  another negative value on failure.
+ *
+ *************************************************************************/
+
+int sched_create_static_task(tcb_t *task_tcb,
+                             void *stack,
+                             uint32_t stack_size,
+                             int (*task_entry_point)(int argc, char **argv),
+                             int argc,
+                             char **argv,
+                             const char *task_name,
+                             uint8_t priority)
+{
+  irq_state_t irq_state;
+  int ret;
+
+  if (task_tcb == NULL || stack == NULL || priority > SCHED_PRIORITY_MAX)
+  {
+    return -EINVAL;
+  }
+
+  irq_state = cpu_disableint();
+
+  /* A TCB that was never used is zeroed and a torn down one points to
+   * itself, anything else is still owned by the scheduler.
+   */
+
+  if (task_tcb->next_tcb.next != NULL &&
+      task_tcb->next_tcb.next != &task_tcb->next_tcb)
+  {
+    cpu_enableint(irq_state);
+    return -EBUSY;
+  }
+
+  memset(task_tcb, 0, sizeof(tcb_t));
+  task_tcb->tcb_flags = TCB_FLAG_STATIC;
+
+  ret = sched_setup_task(task_tcb, stack, stack_size, task_entry_point, argc,
+                         argv, task_name, priority);
+  if (ret < 0)
+  {
+    INIT_LIST_HEAD(&task_tcb->next_tcb);
+  }
+
+  cpu_enableint(irq_state);
+  return ret;
+}
+
+#ifdef CONFIG_SCHEDULER_TASK_POOL
+/**************************************************************************
+ * Name:
+ *  sched_task_pool_reserve
+ *
+ * Description:
+ *  Build TCB and stack slots ahead of time so that the next tasks created
+ *  with this stack size do not allocate. The pool keeps at most
+ *  CONFIG_SCHEDULER_TASK_POOL_SLOTS slots for each size class.
+ *
+ * Input Parameters:
+ *  stack_size - the stack size of the tasks that will use the slots
+ *  num_slots  - the number of slots to build
+ *
+ * Return Value:
+ *  The number of slots available for the stack size or a negative value
+ *  on failure.
+ *
+ *************************************************************************/
+
+int sched_task_pool_reserve(uint32_t stack_size, int num_slots)
+{
+  int class = sched_pool_class(stack_size);
+  if (class < 0)
+  {
+    return class;
+  }
+
+  stack_size = 1U << (SCHED_POOL_MIN_SHIFT + class);
+
+  irq_state_t irq_state = cpu_disableint();
+
+  while (num_slots-- > 0 &&
+         g_task_pool_count[class] < CONFIG_SCHEDULER_TASK_POOL_SLOTS)
+  {
+    struct tcb_s *tcb = calloc(1, sizeof(struct tcb_s) + stack_size);
+    if (tcb == NULL)
+    {
+      break;
+    }
+
+    tcb->stack_ptr_base = (void *)tcb + sizeof(struct tcb_s);
+    tcb->stack_ptr_top  = tcb->stack_ptr_base + stack_size;
+    sched_pool_put(tcb);
+  }
+
+  int ret = g_task_pool_count[class];
+  cpu_enableint(irq_state);
+
+  return ret > 0 ? ret : -ENOMEM;
+}
+#endif /* CONFIG_SCHEDULER_TASK_POOL */
+
+/**************************************************************************
+* Name:
+* sched_get_next_task
+*
+* Description:
+*  Get the task that will run next: the first task from the highest priority
+*  ready list. Should not be called before sched_init.
+*
+* Return Value:
+*  The TCB of the next task or NULL if there is no ready task.
+*
+*************************************************************************/
+
+struct tcb_s *sched_get_next_task(void)
+{
+  return sched_ready_highest(sched_this_cpu());
+}
+
+/**************************************************************************
+* Name:
+* sched_has_ready_task
+*
+* Description:
+*  Verify if there is a ready task, other than except_tcb, that can take the
+*  CPU. This is used to avoid blocking the last runnable task.
+*
+* Input Arguments:
+*  except_tcb - the task that is not taken into account
+*
+* Assumptions:
+*  Call this function with interrupts disabled.
+*
+*************************************************************************/
+
+bool sched_has_ready_task(tcb_t *except_tcb)
+{
+  struct sched_cpu_s *cpu = sched_this_cpu();
+  uint32_t ready_bitmap = cpu->ready_bitmap;
+  struct list_head *ready_list = &cpu->ready_list[except_tcb->priority];
+
+  /* Ignore the priority level if except_tcb is alone in the list */
+
+  if (ready_list->next == &except_tcb->next_tcb &&
+      ready_list->prev == &except_tcb->next_tcb)
+  {
+    ready_bitmap &= ~(1 << except_tcb->priority);
+  }
+
+  return ready_bitmap != 0;
+}
+
+/**************************************************************************
+* Name:
+* sched_wakeup_task
+*
+* Description:
+*  Move a task that was blocked back in the ready list that matches its
+*  priority. The task will run when the scheduler picks it, we don't have
+*  to wait for another task to scan the blocked tasks.
+*
+* Input Arguments:
+*  tcb - the task that was removed from a waiting list
+*
+* Assumptions:
+*  Call this function with interrupts disabled.
+*
+*************************************************************************/
+
+void sched_wakeup_task(tcb_t *tcb)
+{
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+  /* The running task takes a posted semaphore without leaving the CPU */
+
+  if (tcb->t_state == WAITING_FOR_SEM && tcb != sched_get_current_task())
+  {
+    sched_time_add(&tcb->wait_time, sched_clock_us() - tcb->wait_start_us);
+  }
+#endif
+
+#ifdef CONFIG_IRQ_STATS
+  /* Remember the interrupt that made the task ready, the time until the
+   * task gets the CPU is its wakeup latency.
+   */
+
+  uint32_t irq_entry_us;
+  int irq_num = irq_get_active(&irq_entry_us);
+
+  if (irq_num >= 0)
+  {
+    tcb->wakeup_irq    = irq_num + 1;
+    tcb->wakeup_irq_us = irq_entry_us;
+  }
+#endif
+
+  TRACE_EVENT(TRACE_WAKEUP, tcb->t_state, tcb->task_id, 0);
+
+  tcb->t_state = READY;
+#ifdef CONFIG_SCHEDULER_SMP
+  sched_smp_ready_add(tcb);
+#else
+  sched_ready_add(tcb);
+#endif
+}
+
+#ifdef CONFIG_SCHEDULER_SMP
+/**************************************************************************
+* Name:
+* sched_set_affinity
+*
+* Description:
+*  Set the CPUs a task can run on, bit N stands for CPU N. A ready task
+*  that waits on a CPU it can't use anymore is moved right away, the
+*  running task moves when it leaves the CPU.
+*
+* Input Arguments:
+*  tcb      - the task
+*  cpu_mask - the allowed CPUs
+*
+* Return Value:
+*  OK or -EINVAL if the mask has no valid CPU.
+*
+*************************************************************************/
+
+int sched_set_affinity(tcb_t *tcb, uint32_t cpu_mask)
+{
+  cpu_mask &= SCHED_CPU_MASK_ALL;
+  if (tcb == NULL || cpu_mask == 0)
+  {
+    return -EINVAL;
+  }
+
+  irq_state_t irq_state = cpu_disableint();
+
+  tcb->affinity = cpu_mask;
+
+  if (tcb->t_state == READY && (cpu_mask & (1U << tcb->cpu)) == 0 &&
+      g_sched_cpus[tcb->cpu].current_tcb != &tcb->next_tcb)
+  {
+    sched_ready_del(tcb);
+    sched_smp_ready_add(tcb);
+  }
+
+  cpu_enableint(irq_state);
+  return OK;
+}
+#endif
+
+/**************************************************************************
+* Name:
+* sched_cancel_timeout
+*
+* Description:
+*  Remove a blocked task from the timeout list because it was woken up
+*  before its deadline. In tickless mode the one-shot timer is left armed,
+*  when it fires sched_tick finds nothing to expire and re-arms it for the
+*  next deadline.
+*
+* Assumptions:
+*  Call this function with interrupts disabled.
+*
+*************************************************************************/
+
+void sched_cancel_timeout(tcb_t *tcb)
+{
+  if (tcb->timeout_node.next != &tcb->timeout_node)
+  {
+    list_del(&tcb->timeout_node);
+    INIT_LIST_HEAD(&tcb->timeout_node);
+  }
+}
+
+/**************************************************************************
+* Name:
+* sched_tick
+*
+* Description:
+*  Advance the scheduler tick count and wake up the tasks whose deadline
+*  expired. The timeout list is ordered so we stop at the first task that
+*  still has to wait. A task that waits for a semaphore is removed from the
+*  semaphore waiting list and it will see -ETIMEDOUT.
+*
+* Assumptions:
+*  Called by the board from the periodic tick interrupt or from the one-shot
+*  timer interrupt in tickless mode. The woken up tasks are not run from here,
+*  they take the CPU at the next scheduling point.
+*
+*************************************************************************/
+
+void sched_tick(void)
 {
   irq_state_t irq_state = cpu_disableint();
-  int ret;
+  tcb_t *waiter;
 
-  SCHED_DEBUG_INFO("try create task %s\n", task_name);
+#ifdef CONFIG_SCHEDULER_TICKLESS
+  uint32_t now = board_tickless_get_ticks();
+  g_sched_ticks = now;
+#else
+  uint32_t now = ++g_sched_ticks;
+#endif
 
-  struct tcb_s *task_tcb = calloc(1, sizeof(struct tcb_s) + stack_size);
-  if (task_tcb == NULL)
+  while (g_timeout_list.next != &g_timeout_list)
   {
-    ret = -ENOMEM;
-    goto failed_task_creation;
-  }
+    waiter = container_of(g_timeout_list.next, tcb_t, timeout_node);
+    if ((int32_t)(waiter->wake_tick - now) > 0)
+    {
+      break;
+    }
 
-  task_tcb->entry_point    = task_entry_point;
-  task_tcb->stack_ptr_base = (void *)task_tcb + sizeof(struct tcb_s);
-  task_tcb->stack_ptr_top  = (void *)task_tcb + stack_size + sizeof(struct tcb_s);
-  task_tcb->t_state        = READY;
+    sched_cancel_timeout(waiter);
 
-  if (task_name != NULL)
-  {
-    strncpy((char *)task_tcb->task_name, task_name, strlen(task_name));
-  }
+    if (waiter->t_state == WAITING_FOR_SEM)
+    {
+      list_del(&waiter->next_tcb);
+      waiter->waiting_tcb_sema = NULL;
+      waiter->wait_result      = -ETIMEDOUT;
+    }
 
-#ifdef CONFIG_SCHEDULER_TASK_COLORATION
-  /* The effective stack size is base - top */
+    sched_wakeup_task(waiter);
+  }
 
-  uint32_t *ptr_end = (uint32_t *)(task_tcb->stack_ptr_base +
-    (task_tcb->stack_ptr_top - task_tcb->stack_ptr_base) / sizeof(uint32_t));
+#ifdef CONFIG_SCHEDULER_TICKLESS
+  /* Program the one-shot timer for the next deadline */
 
-  for (uint32_t *ptr = task_tcb->stack_ptr_base; ptr < ptr_end; ptr++)
+  if (g_timeout_list.next != &g_timeout_list)
+  {
+    sched_alarm_set(sched_timeout_deadline());
+  }
+  else
   {
-    *ptr = 0xDEADBEEF;
+    g_alarm_armed = false;
+    board_tickless_cancel_alarm();
   }
 #endif
 
-  ret = cpu_inittask(task_tcb, argc, argv);
-  if (ret < 0) {
-    free(task_tcb);
-    goto failed_task_creation;
-  }
+  cpu_enableint(irq_state);
+}
+
+/**************************************************************************
+* Name:
+* sched_get_ticks
+*
+* Description:
+*  Get the number of scheduler ticks since boot. The counter wraps around so
+*  compare the values by their difference.
+*
+*************************************************************************/
 
-  /* Init resource list */
+uint32_t sched_get_ticks(void)
+{
+#ifdef CONFIG_SCHEDULER_TICKLESS
+  return board_tickless_get_ticks();
+#else
+  return g_sched_ticks;
+#endif
+}
 
-  INIT_LIST_HEAD(&task_tcb->opened_resource);
+/**************************************************************************
+* Name:
+* sched_sleep
+*
+* Description:
+*  Suspend the current task for the specified number of scheduler ticks. The
+*  task is placed in the timeout list and it does not consume CPU time until
+*  it is woken up by sched_tick.
+*
+* Input Arguments:
+*  ticks - the number of ticks to sleep, 0 only yields the CPU
+*
+* Return Value:
+*  OK when the task was woken up or -EAGAIN if the scheduler is not running
+*  or there is no other task that can run while we sleep.
+*
+*************************************************************************/
 
-  /* Insert the task in the list */
+int sched_sleep(uint32_t ticks)
+{
+  irq_state_t irq_state = cpu_disableint();
+  tcb_t *this_tcb = sched_get_current_task();
 
-  list_add(&task_tcb->next_tcb, &g_tcb_list);
-  
-  ret = OK;
+  if (this_tcb == NULL || !sched_has_ready_task(this_tcb))
+  {
+    cpu_enableint(irq_state);
+    return -EAGAIN;
+  }
 
-  SCHED_DEBUG_INFO("created task %s\n", task_name);
+  if (ticks == 0)
+  {
+    this_tcb->t_state = READY;
+  }
+  else
+  {
+    this_tcb->wake_tick   = sched_get_ticks() + ticks;
+    this_tcb->has_timeout = true;
+    this_tcb->t_state     = SLEEPING;
+  }
 
-failed_task_creation:
   cpu_enableint(irq_state);
-  return ret;
+  sched_preempt_task(this_tcb);
+
+  return OK;
 }
 
 /**************************************************************************
 * Name:
-* sched_get_next_task
+* sched_set_timer_slack
 *
 * Description:
-*  Init scheduler resources. Should not be called before sched_init
+*  Let the timeouts of a task expire up to slack_ms milliseconds late. In
+*  tickless mode the one-shot timer is programmed for the latest tick that
+*  is still within the slack of every waiting task, so the nearby timeouts
+*  are served by one wakeup. It applies to the next sleep or semaphore
+*  timeout of the task.
+*
+* Input Arguments:
+*  tcb      - the task or NULL for the calling task
+*  slack_ms - the slack, rounded down to the scheduler tick
 *
 * Return Value:
-*  The TCB of the next task or NULL if the scheduler is not initialized.
+*  OK or -EINVAL when there is no task.
 *
 *************************************************************************/
 
-struct tcb_s *sched_get_next_task(void)
+int sched_set_timer_slack(tcb_t *tcb, uint32_t slack_ms)
 {
-  g_current_tcb = g_current_tcb->next;
-  if (g_current_tcb == &g_tcb_list)
-    {
-      g_current_tcb = g_current_tcb->next;
-    }
+  if (tcb == NULL)
+  {
+    tcb = sched_get_current_task();
+  }
+
+  if (tcb == NULL)
+  {
+    return -EINVAL;
+  }
 
-  struct tcb_s *next_tcb = (struct tcb_s *)container_of(g_current_tcb,
-                                                        struct tcb_s,
-                                                        next_tcb);
-  return next_tcb;
+  tcb->timer_slack = SCHED_MS_TO_TICKS_FLOOR(slack_ms);
+  return OK;
 }
 
 /**************************************************************************
@@ -282,8 +1635,8 @@ struct tcb_s *sched_get_next_task(void)
 * sched_allocate_resource
 *
 * Description:
-*  Allocate a new resource and store the file desscriptor in the resource
-*  structure.
+*  Allocate a new resource and store the lowest free file descriptor in the
+*  resource structure.
 *
 * Return Value:
 *  The opened container resource or NULL in case we are running out of memory.
@@ -295,7 +1648,6 @@ struct opened_resource_s *sched_allocate_resource(const struct vfs_node_s *vfs_n
 {
   irq_state_t irq_state = cpu_disableint();
   struct tcb_s *curr_tcb = sched_get_current_task();
-  assert(curr_tcb->curr_resource_opened >= 0);
 
   struct opened_resource_s *new_res = calloc(1,
       sizeof(struct opened_resource_s));
@@ -304,13 +1656,20 @@ struct opened_resource_s *sched_allocate_resource(const struct vfs_node_s *vfs_n
     return NULL;
   }
 
-  new_res->fd        = curr_tcb->curr_resource_opened;
+  int fd = sched_fd_alloc(curr_tcb);
+  if (fd < 0) {
+    free(new_res);
+    cpu_enableint(irq_state);
+    return NULL;
+  }
+
+  new_res->fd        = fd;
   new_res->open_mode = open_mode;
   new_res->vfs_node  = (struct vfs_node_s *)vfs_node;
 
-  curr_tcb->curr_resource_opened++;
+  curr_tcb->fd_table[fd] = new_res;
+  curr_tcb->fd_bitmap[fd / 32] |= 1U << (fd % 32);
 
-  list_add(&new_res->node, &curr_tcb->opened_resource);
   cpu_enableint(irq_state);
 
   return new_res;
@@ -322,10 +1681,8 @@ struct opened_resource_s *sched_allocate_resource(const struct vfs_node_s *vfs_n
  *
  * Description:
  *  This method tears down the resources allocated for an object that has been
- *  opened. It should be called from close() context.
- *
- * Assumptions:
- *  Call this function with pre-emption disabled.
+ *  opened. It should be called from close() context. The fd becomes
+ *  available for the next open().
  *
  * Return Value:
  *  OK or a negative value on failure.
@@ -335,63 +1692,242 @@ struct opened_resource_s *sched_allocate_resource(const struct vfs_node_s *vfs_n
 int sched_free_resource(int fd)
 {
   irq_state_t irq_state = cpu_disableint();
-
   struct tcb_s *curr_tcb = sched_get_current_task();
-  assert(curr_tcb->curr_resource_opened >= 0);
 
-  /* Iterate over opened resource list find the fd and free the resource */
+  struct vfs_node_s *node = sched_fd_release(curr_tcb, fd);
 
-  struct opened_resource_s *resource = sched_find_opened_resource(fd);
+  cpu_enableint(irq_state);
+  return node != NULL ? OK : -ENOENT;
+}
 
-  if (resource) {
-    list_del(&resource->node);
+/**************************************************************************
+ * Name:
+ *  sched_find_opened_resource
+ *
+ * Description:
+ *  Look up the opened resource with specified fd number in the current tcb.
+ *
+ * Return Value:
+ *  The opened container resource or NULL if the fd is not opened.
+ *
+ *************************************************************************/
 
-    free(resource);
-    cpu_enableint(irq_state);
-    return OK;
+struct opened_resource_s *sched_find_opened_resource(int fd)
+{
+  struct tcb_s *curr_tcb = sched_get_current_task();
+
+  if (fd < 0 || fd >= curr_tcb->fd_table_size) {
+    return NULL;
   }
 
-  cpu_enableint(irq_state);
-  return -ENOENT;
+  return curr_tcb->fd_table[fd];
 }
 
 /**************************************************************************
  * Name:
- *  sched_find_opened_resource
+ *  sched_clock_us
+ *
+ * Description:
+ *  Read the clock used by the CPU accounting and by the tracer. It is a
+ *  wrapping microsecond counter so only the difference of two readings is
+ *  meaningful. Without CONFIG_BOARD_CLOCK_US it has the tick resolution.
+ *
+ *************************************************************************/
+
+uint32_t sched_clock_us(void)
+{
+#ifdef CONFIG_BOARD_CLOCK_US
+  return board_clock_get_us();
+#else
+  return sched_get_ticks() * (1000000 / SCHED_TICKS_PER_SEC);
+#endif
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_get_stack_usage
  *
  * Description:
- *  Search for an opened resource with specified fd number in the current tcb.
+ *  Get the peak stack usage of a task. The stack grows down so the scan
+ *  starts from the stack base and stops at the first painted word that was
+ *  overwritten.
  *
  * Assumptions:
- *  Call this function with pre-emption disabled.
+ *  Call this function with interrupts disabled if the task can exit.
  *
  * Return Value:
- *  The opened container resource or NULL in case we are running out of memory.
+ *  The number of bytes used at the deepest point or -ENOSYS when the stacks
+ *  are not painted.
  *
  *************************************************************************/
 
-struct opened_resource_s *sched_find_opened_resource(int fd)
+int sched_get_stack_usage(tcb_t *tcb)
 {
-  struct tcb_s *curr_tcb = sched_get_current_task();
-  assert(curr_tcb->curr_resource_opened >= 0);
+#ifdef CONFIG_SCHEDULER_TASK_COLORATION
+  uint32_t *ptr = tcb->stack_ptr_base;
+  uint32_t *ptr_end = (uint32_t *)tcb->stack_ptr_top;
+
+  while (ptr < ptr_end && *ptr == SCHED_STACK_COLOR)
+  {
+    ptr++;
+  }
+
+  return (void *)ptr_end - (void *)ptr;
+#else
+  return -ENOSYS;
+#endif
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_foreach_task
+ *
+ * Description:
+ *  Call task_cb for every task known by the scheduler, the halted tasks
+ *  that were not torn down yet included. The callback runs with interrupts
+ *  disabled so it must not block.
+ *
+ * Input Parameters:
+ *  task_cb - the callback, a non-zero return value stops the walk
+ *  arg     - the callback argument
+ *
+ * Return Value:
+ *  The value returned by the callback that stopped the walk or OK.
+ *
+ *************************************************************************/
+
+int sched_foreach_task(int (*task_cb)(tcb_t *tcb, void *arg), void *arg)
+{
+  int ret = OK;
+  tcb_t *tcb;
+
+  irq_state_t irq_state = cpu_disableint();
 
-  struct opened_resource_s *resource = NULL;
-  list_for_each_entry(resource, &curr_tcb->opened_resource, node)
+  list_for_each_entry(tcb, &g_task_list, task_node)
   {
-    if (resource && resource->fd == fd) {
-      return resource;
+    ret = task_cb(tcb, arg);
+    if (ret != OK)
+    {
+      break;
     }
   }
 
-  return NULL;
+  cpu_enableint(irq_state);
+  return ret;
+}
+
+#ifdef CONFIG_PROCFS
+/* The output buffer of sched_procfs_stacks */
+
+struct sched_procfs_buf_s {
+  char *buf;
+  size_t len;
+  size_t pos;
+};
+
+static int sched_procfs_stack_line(tcb_t *tcb, void *arg)
+{
+  struct sched_procfs_buf_s *out = arg;
+
+  /* The buffer is full, snprintf returned the truncated size */
+
+  if (out->pos >= out->len)
+  {
+    return OK;
+  }
+
+  out->pos += snprintf(out->buf + out->pos, out->len - out->pos,
+                       "%d\t%d\t%s\n", sched_get_stack_usage(tcb),
+                       (int)(tcb->stack_ptr_top - tcb->stack_ptr_base),
+                       tcb->task_name);
+  return OK;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_procfs_stacks
+ *
+ * Description:
+ *  Fill buf with the peak stack usage and the stack size of every task,
+ *  one task for each line. This is the content of /proc/stacks.
+ *
+ * Return Value:
+ *  The number of characters written in buf.
+ *
+ *************************************************************************/
+
+int sched_procfs_stacks(char *buf, size_t len)
+{
+  struct sched_procfs_buf_s out = { .buf = buf, .len = len };
+
+  out.pos = snprintf(buf, len, "USED\tSIZE\tTASK\n");
+  sched_foreach_task(sched_procfs_stack_line, &out);
+
+  return out.pos;
+}
+
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+static int sched_procfs_cpu_line(tcb_t *tcb, void *arg)
+{
+  struct sched_procfs_buf_s *out = arg;
+
+  /* The buffer is full, snprintf returned the truncated size */
+
+  if (out->pos >= out->len)
+  {
+    return OK;
+  }
+
+  out->pos += snprintf(out->buf + out->pos, out->len - out->pos,
+                       "%d\t%d\t%d\t%d\t%d\t%s\n", (int)tcb->task_id,
+                       (int)tcb->run_time.ms, (int)tcb->wait_time.ms,
+                       (int)tcb->nvcsw, (int)tcb->nivcsw, tcb->task_name);
+  return OK;
+}
+
+/**************************************************************************
+ * Name:
+ *  sched_procfs_cpu
+ *
+ * Description:
+ *  Fill buf with the content of /proc/cpu: the accounted uptime, the time
+ *  the board slept and then one line for each task with its id, the run
+ *  time and the semaphore wait time in milliseconds, the voluntary and the
+ *  involuntary context switches and the task name. The Idle task run time
+ *  is the idle residency.
+ *
+ * Return Value:
+ *  The number of characters written in buf.
+ *
+ *************************************************************************/
+
+int sched_procfs_cpu(char *buf, size_t len)
+{
+  struct sched_procfs_buf_s out = { .buf = buf, .len = len };
+
+  /* Charge the reader for the time it ran so far */
+
+  irq_state_t irq_state = cpu_disableint();
+  sched_account_run(sched_get_current_task());
+  cpu_enableint(irq_state);
+
+  out.pos = snprintf(buf, len, "uptime_ms\t%d\nsleep_ms\t%d\n"
+                     "ID\tRUN_MS\tWAIT_MS\tVCSW\tIVCSW\tTASK\n",
+                     (int)g_sched_uptime.ms, (int)g_sched_sleep_time.ms);
+  sched_foreach_task(sched_procfs_cpu_line, &out);
+
+  return out.pos;
 }
+#endif /* CONFIG_SCHEDULER_CPU_STATS */
+#endif /* CONFIG_PROCFS */
 
 /**************************************************************************
 * Name:
 * sched_run
 *
 * Description:
-*  Pick the next task to be run.
+*  Pick the next task to be run. On SMP the boot CPU starts the other CPUs
+*  the first time it is called and they call it to run their Idle task.
 *
 *************************************************************************/
 
@@ -399,20 +1935,34 @@ void sched_run(void)
 {
   irq_state_t irq_mask = cpu_disableint();
 
+  struct sched_cpu_s *cpu = sched_this_cpu();
   tcb_t *current_task = sched_get_current_task();
-  if (g_current_tcb == NULL)
+  if (cpu->current_tcb == NULL)
   {
     /* In the initial phase there is no task, it is only the __start
      * entry point which is called after reset.
      */
 
-    g_current_tcb = g_tcb_list.next;
-    current_task = container_of(g_current_tcb, tcb_t, next_tcb);
+    current_task     = sched_ready_highest(cpu);
+    cpu->current_tcb = &current_task->next_tcb;
 
     /* Switch the task state to running */
 
     current_task->t_state = RUNNING;
 
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+    cpu->switch_us = sched_clock_us();
+#endif
+
+#ifdef CONFIG_SCHEDULER_SMP
+    /* The other CPUs wait for the kernel lock until we switch out */
+
+    if (cpu_getid() == 0)
+    {
+      cpu_start_secondaries(SCHED_NCPUS);
+    }
+#endif
+
     /* Re-enable the interrupts */
 
     cpu_enableint(irq_mask);
@@ -448,10 +1998,12 @@ void sched_run(void)
 
 tcb_t *sched_get_current_task(void)
 {
-  if (g_current_tcb == NULL)
+  struct sched_cpu_s *cpu = sched_this_cpu();
+
+  if (cpu->current_tcb == NULL)
     return NULL;
 
-  return (tcb_t *)container_of(g_current_tcb, tcb_t, next_tcb);
+  return (tcb_t *)container_of(cpu->current_tcb, tcb_t, next_tcb);
 }
 
 /**************************************************************************
@@ -472,49 +2024,93 @@ tcb_t *sched_get_current_task(void)
 void sched_preempt_task(tcb_t *to_preempt_tcb)
 {
   tcb_t *new_tcb = NULL;
-  struct list_head *current, *temp;
-  irq_state_t irq_state = cpu_disableint();
 
-  /* Is there any task in the waiting list that needs to be added back
-   * in the ready list ?
+#ifdef CONFIG_SCHEDULER_SMP
+  /* Only one CPU runs the kernel at a time, let the others in. The task is
+   * still the current one of this CPU so nobody can take it meanwhile.
    */
 
-  list_for_each_safe(current, temp, &g_tcb_waiting_list)
-  {
-    new_tcb = container_of(current, tcb_t, next_tcb);
-    if (new_tcb && new_tcb->t_state == READY)
-    {
-      list_del(current);
-      list_add(current, &g_tcb_list);
-    }
-  }
+  cpu_kernel_yield();
+#endif
+
+  irq_state_t irq_state = cpu_disableint();
+  struct sched_cpu_s *cpu = sched_this_cpu();
 
   /* If the task to preempt is not in :
-   * READY, WAITING_FOR_SEM or HALTED
+   * READY, WAITING_FOR_SEM, SLEEPING or HALTED
    * something is wrong.
    */
 
   assert(to_preempt_tcb->t_state != RUNNING);
 
-  /* Delete the task from the current list */
+  /* Delete the task from the ready list */
 
-  list_del(&to_preempt_tcb->next_tcb);
+  sched_ready_del(to_preempt_tcb);
 
   if (to_preempt_tcb->t_state == READY)
   {
     /* The task slot expired we need to scheduler a new task.
-     * Place the task at the end of the list.
+     * Place the task at the end of its priority list so that the tasks with
+     * the same priority are run in a round-robin fashion.
      */
 
     SCHED_DEBUG_INFO("%s preempted\n", to_preempt_tcb->task_name);
-    list_add_tail(&to_preempt_tcb->next_tcb, &g_tcb_list);
+#ifdef CONFIG_SCHEDULER_SMP
+    if ((to_preempt_tcb->affinity & (1U << to_preempt_tcb->cpu)) == 0)
+    {
+      /* The affinity changed while it was running */
+
+      sched_smp_ready_add(to_preempt_tcb);
+    }
+    else
+#endif
+    {
+      sched_ready_add(to_preempt_tcb);
+    }
+  }
+  else if (to_preempt_tcb->t_state == WAITING_FOR_SEM &&
+           to_preempt_tcb->waiting_tcb_sema->count > 0)
+  {
+    /* The semaphore was posted after the task decided to block and before
+     * we disabled the interrupts. Take it and keep the task ready.
+     */
+
+    to_preempt_tcb->waiting_tcb_sema->count--;
+    to_preempt_tcb->waiting_tcb_sema = NULL;
+    sched_wakeup_task(to_preempt_tcb);
+  }
+  else if (to_preempt_tcb->t_state == WAITING_FOR_SEM)
+  {
+    /* The task is preempted because it was blocked by a semaphore. Queue it
+     * at the end of the semaphore waiting list, sem_post wakes up the
+     * tasks in FIFO order.
+     */
+
+    list_add_tail(&to_preempt_tcb->next_tcb,
+                  &to_preempt_tcb->waiting_tcb_sema->waiting_list);
+
+    /* Arm the deadline, sched_tick takes the task out of the semaphore
+     * waiting list if nobody posts the semaphore in time.
+     */
+
+    if (to_preempt_tcb->has_timeout)
+    {
+      sched_timeout_add(to_preempt_tcb);
+    }
+  }
+  else if (to_preempt_tcb->t_state == SLEEPING)
+  {
+    /* The task went to sleep, sched_tick moves it back in the ready list
+     * when its wake-up tick expires.
+     */
+
+    sched_timeout_add(to_preempt_tcb);
   }
-  else if (to_preempt_tcb->t_state == WAITING_FOR_SEM ||
-           to_preempt_tcb->t_state == HALTED)
+  else if (to_preempt_tcb->t_state == HALTED)
   {
-     /* The task is preempted because it was blocked by a semaphore
-      * or it was done executing the entry point and it needs to be halted.
-      */
+    /* The task was done executing the entry point and it needs to be
+     * halted.
+     */
 
     list_add(&to_preempt_tcb->next_tcb, &g_tcb_waiting_list);
   }
@@ -529,29 +2125,66 @@ void sched_preempt_task(tcb_t *to_preempt_tcb)
   }
 
   SCHED_DEBUG_INFO("%s saved context\n", to_preempt_tcb->task_name);
-  list_for_each_entry(new_tcb, &g_tcb_list, next_tcb)
+
+  /* Pick the first task from the highest priority ready list. The Idle task
+   * is always ready so we should always find one.
+   */
+
+  new_tcb = sched_ready_highest(cpu);
+  assert(new_tcb != NULL);
+
+#ifdef CONFIG_SCHEDULER_SMP
+  /* Rather than idle take the most urgent task waiting on another CPU */
+
+  if (new_tcb == cpu->idle_tcb)
   {
-    /* All the tasks from this list should be in the READY state */
+    tcb_t *stolen_tcb = sched_smp_find_steal(cpu_getid());
+    if (stolen_tcb != NULL)
+    {
+      sched_ready_del(stolen_tcb);
+      stolen_tcb->cpu = cpu_getid();
+      sched_ready_add(stolen_tcb);
+      new_tcb = stolen_tcb;
+    }
+  }
+#endif
 
-    assert(new_tcb->t_state == READY);
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+  sched_account_switch(to_preempt_tcb, new_tcb);
+#endif
 
-    /* Great, we found a task that it is the ready state.
-     * Move the task in the runing state and restore its context.
-     */
+#ifdef CONFIG_IRQ_STATS
+  if (new_tcb->wakeup_irq != 0)
+  {
+    irq_stats_wakeup(new_tcb->wakeup_irq - 1,
+                     sched_clock_us() - new_tcb->wakeup_irq_us);
+    new_tcb->wakeup_irq = 0;
+  }
+#endif
+
+  if (new_tcb != to_preempt_tcb)
+  {
+    TRACE_EVENT(TRACE_SWITCH, to_preempt_tcb->t_state, new_tcb->task_id, 0);
+  }
 
-    new_tcb->t_state = RUNNING;
+  /* All the tasks from the ready lists should be in the READY state */
 
-    g_current_tcb = &new_tcb->next_tcb;
-    SCHED_DEBUG_INFO("%s now run\n", new_tcb->task_name);
+  assert(new_tcb->t_state == READY);
 
-    /* Re-enable the interrupts */
+  /* Great, we found a task that it is the ready state.
+   * Move the task in the runing state and restore its context.
+   */
 
-    cpu_enableint(irq_state);
+  new_tcb->t_state = RUNNING;
 
-    /* Switch the context to the new task */
+  cpu->current_tcb = &new_tcb->next_tcb;
+  SCHED_DEBUG_INFO("%s now run\n", new_tcb->task_name);
 
-    cpu_restorecontext(new_tcb->mcu_context);
-  }
+  /* Re-enable the interrupts */
 
   cpu_enableint(irq_state);
+
+  /* Switch the context to the new task */
+
+  cpu_restorecontext(new_tcb->mcu_context);
 }
@@ -1,14 +1,12 @@
 #include <board.h>
 
 #include <assert.h>
+#include <coroutine.h>
 #include <errno.h>
 #include <semaphore.h>
 #include <scheduler.h>
 #include <stdbool.h>
-
-extern struct list_head g_tcb_list;
-extern struct list_head g_tcb_waiting_list;
-extern struct list_head *g_current_tcb;
+#include <trace.h>
 
 /*
  * sem_init - initialize the semaphore
@@ -28,6 +26,10 @@ int sem_init(sem_t *sem, int pshared, unsigned int value)
   }
 
   sem->count = value;
+  INIT_LIST_HEAD(&sem->waiting_list);
+#ifdef CONFIG_SCHEDULER_COROUTINE
+  INIT_LIST_HEAD(&sem->coro_waiting_list);
+#endif
 
   return 0;
 }
@@ -39,74 +41,38 @@ int sem_init(sem_t *sem, int pshared, unsigned int value)
  *
  * The call of this function can suspend the current execution if the semaphore
  * value is less than or equal to 0. Use this primitive for signalling purpose
- * or for locking implementation.
+ * or for locking implementation. The suspended task is queued in the
+ * semaphore waiting list and it owns the semaphore when it is woken up.
  *
  */
 int sem_wait(sem_t *sem)
 {
-  /* Disable context switch by disabling interrupts */
-
-  irq_state_t irq_state = cpu_disableint();
-
-  /* Verify the semaphore value and decrement it if it's > 0 */
-
-  if (sem->count > 0)
-  {
-    sem->count--;
-  }
-  else
-  {
-    struct tcb_s *tcb     = sched_get_current_task();
-
-    /* There was an error or tasks were not initialized.
-     * If there is only one task in the ready to run list don't change
-     * the state to WAITING_FOR_SEM. Instead, we should return an error
-     * like EAGAIN.
-     */
-
-    assert(!((tcb->t_state == WAITING_FOR_SEM) ||
-           (tcb->t_state == HALTED)));
-
-    if ((tcb == NULL) || (g_current_tcb->next == g_current_tcb->prev))
-    {
-      cpu_enableint(irq_state);
-      return -EAGAIN;
-    }
-
-    tcb->t_state          = WAITING_FOR_SEM;
-    tcb->waiting_tcb_sema = sem;
-
-    SCHED_DEBUG_INFO("%s WAIT for sema\n", tcb->task_name);
-
-    /* Switch context to the next running task */
-
-    cpu_enableint(irq_state);
-
-    /* Place the current task in the waiting list and remove the task from the
-     * running queue. Activate a new task that is prepared to be run.
-     */
-
-    sched_preempt_task(tcb);
-    return 0;
-  }
-
-  /* Re-enable interrupts */
-
-  cpu_enableint(irq_state);
-  return 0;
+  return sem_timedwait(sem, SEM_WAIT_FOREVER);
 }
 
 /*
- * sem_trywait - decrement the semaphore
+ * sem_trywait - decrement the semaphore without blocking
  *
  * @sem       - the semaphore address
  *
- * Not implemneted yet.
+ * Take the semaphore only if it is available. This is the fast path, it never
+ * touches the scheduler so it can be used from interrupt context.
  *
+ * Returns 0 if the semaphore was taken or -EAGAIN if the value was 0.
  */
 int sem_trywait(sem_t *sem)
 {
-  return -1;
+  int ret = -EAGAIN;
+  irq_state_t irq_state = cpu_disableint();
+
+  if (sem->count > 0)
+  {
+    sem->count--;
+    ret = 0;
+  }
+
+  cpu_enableint(irq_state);
+  return ret;
 }
 
 /*
@@ -114,8 +80,10 @@ int sem_trywait(sem_t *sem)
  *
  * @sem       - the semaphore address
  *
- * This function increments the semaphore value and unblocks all the tasks
- * that are holding it.
+ * If there are tasks blocked on the semaphore the first one is moved straight
+ * in the ready queue and it takes the semaphore, the blocked coroutines are
+ * served the same way after the tasks. Otherwise the semaphore value is
+ * incremented. The cost does not depend on the number of blocked tasks.
  */
 int sem_post(sem_t *sem)
 {
@@ -123,40 +91,41 @@ int sem_post(sem_t *sem)
 
   irq_state_t irq_state = cpu_disableint();
 
-  sem->count += 1;
+  TRACE_EVENT(TRACE_SEM_POST, 0, (uintptr_t)sem, 0);
 
-  if (sem->count == 1)
+  if (sem->waiting_list.next != &sem->waiting_list)
   {
-    /* Unblock task from waiting list that is blocked by this semaphore and
-     * place it in the running list
-     */
+    /* Hand the semaphore to the task that waits for the longest time */
 
-    struct tcb_s *current = NULL;
+    struct tcb_s *waiter = container_of(sem->waiting_list.next, struct tcb_s,
+                                        next_tcb);
 
-    list_for_each_entry(current, &g_tcb_waiting_list, next_tcb)
-    {
-      if (current != NULL && current->waiting_tcb_sema == sem)
-      {
-        /* If the task is not in the waiting state then somwthing went
-         * wrong.
-         */
+    /* If the task is not in the waiting state then somwthing went
+     * wrong.
+     */
 
-        assert(current->t_state == WAITING_FOR_SEM); 
+    assert(waiter->t_state == WAITING_FOR_SEM);
 
-        /* Move the task state to ready and remove the semaphore from */
+    list_del(&waiter->next_tcb);
+    sched_cancel_timeout(waiter);
+    waiter->waiting_tcb_sema = NULL;
+    waiter->wait_result      = 0;
 
-        current->waiting_tcb_sema = NULL;
-        current->t_state          = READY;
+    SCHED_DEBUG_INFO("%s received POST sema\n", waiter->task_name);
 
-        SCHED_DEBUG_INFO("%s received POST sema\n", current->task_name);
+    sched_wakeup_task(waiter);
+  }
+#ifdef CONFIG_SCHEDULER_COROUTINE
+  else if (sem->coro_waiting_list.next != &sem->coro_waiting_list)
+  {
+    /* The tasks go first, then the coroutines blocked in CORO_SEM_WAIT */
 
-        /* Let the sched_preempt_task function Delete the task from the
-         * waiting list and add it to the ready to run list in front of other
-         * tasks.
-         */
-        break;
-      }
-    }
+    coro_sem_wakeup(sem);
+  }
+#endif
+  else
+  {
+    sem->count += 1;
   }
 
   /* Re-enable interrupts for the current task */
@@ -167,21 +136,96 @@ int sem_post(sem_t *sem)
 }
 
 /*
- * sem_timedwait - wait on a semaphore with timeoute
+ * sem_timedwait - wait on a semaphore with timeout
  *
- * @sem       - the semaphore address
+ * @sem        - the semaphore address
+ * @timeout_ms - the relative timeout in milliseconds or SEM_WAIT_FOREVER
  *
- * Not implemneted yet. It only works with SEM_WAIT_FOREVER.
+ * Same as sem_wait but the blocked task is also placed in the kernel timeout
+ * list. If nobody posts the semaphore before the deadline the task is removed
+ * from the semaphore waiting list and woken up by the scheduler tick.
  *
+ * Returns 0 if the semaphore was taken, -ETIMEDOUT when the deadline expired,
+ * -EINVAL for a negative timeout, -EAGAIN if there is no other task that can
+ * run while we wait or -ENOSYS for a timeout when the board doesn't drive the
+ * scheduler tick.
  */
-int sem_timedwait(sem_t *sem, int timeout_abs)
+int sem_timedwait(sem_t *sem, int timeout_ms)
 {
-  if (timeout_abs == SEM_WAIT_FOREVER)
+  /* Disable context switch by disabling interrupts */
+
+  irq_state_t irq_state = cpu_disableint();
+
+  /* Verify the semaphore value and decrement it if it's > 0 */
+
+  if (sem->count > 0)
   {
-    return sem_wait(sem);
+    sem->count--;
+    cpu_enableint(irq_state);
+    return 0;
   }
-  else
+
+  if (timeout_ms == 0)
   {
+    cpu_enableint(irq_state);
+    return -ETIMEDOUT;
+  }
+
+  if (timeout_ms < 0 && timeout_ms != SEM_WAIT_FOREVER)
+  {
+    cpu_enableint(irq_state);
+    return -EINVAL;
+  }
+
+#ifndef CONFIG_SCHEDULER_TICK
+  /* Nobody advances the ticks so the deadline would never expire */
+
+  if (timeout_ms != SEM_WAIT_FOREVER)
+  {
+    cpu_enableint(irq_state);
     return -ENOSYS;
   }
+#endif
+
+  struct tcb_s *tcb = sched_get_current_task();
+
+  /* There was an error or tasks were not initialized.
+   * If there is no other task in the ready to run lists don't change
+   * the state to WAITING_FOR_SEM. Instead, we should return an error
+   * like EAGAIN.
+   */
+
+  if ((tcb == NULL) || !sched_has_ready_task(tcb))
+  {
+    cpu_enableint(irq_state);
+    return -EAGAIN;
+  }
+
+  assert(!((tcb->t_state == WAITING_FOR_SEM) ||
+         (tcb->t_state == HALTED)));
+
+  tcb->t_state          = WAITING_FOR_SEM;
+  tcb->waiting_tcb_sema = sem;
+  tcb->wait_result      = 0;
+  tcb->has_timeout      = timeout_ms != SEM_WAIT_FOREVER;
+
+  if (tcb->has_timeout)
+  {
+    tcb->wake_tick = sched_get_ticks() + SCHED_MS_TO_TICKS(timeout_ms);
+  }
+
+  SCHED_DEBUG_INFO("%s WAIT for sema\n", tcb->task_name);
+  TRACE_EVENT(TRACE_SEM_BLOCK, 0, (uintptr_t)sem, timeout_ms);
+
+  /* Switch context to the next running task */
+
+  cpu_enableint(irq_state);
+
+  /* Place the current task in the semaphore waiting list and remove the
+   * task from the ready queue. Activate a new task that is prepared to be
+   * run.
+   */
+
+  sched_preempt_task(tcb);
+  return tcb->wait_result;
 }
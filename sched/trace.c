@@ -0,0 +1,262 @@
+#include <board.h>
+
+#ifdef CONFIG_SCHEDULER_TRACE
+
+#include <errno.h>
+#include <scheduler.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+#include <vfs.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#if (CONFIG_SCHEDULER_TRACE_EVENTS & (CONFIG_SCHEDULER_TRACE_EVENTS - 1)) != 0
+  #error "CONFIG_SCHEDULER_TRACE_EVENTS should be a power of two"
+#endif
+
+/* The path of the binary trace node */
+
+#define TRACE_DEV_PATH                "/dev/trace"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* The read position of an opened /dev/trace */
+
+struct trace_cursor_s {
+  uint32_t pos;                     /* The next event to read */
+  uint32_t end;                     /* The events recorded at open time */
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static int trace_open(struct opened_resource_s *priv, const char *pathname,
+                      int flags, mode_t mode);
+static int trace_close(struct opened_resource_s *priv);
+static int trace_read(struct opened_resource_s *priv, void *buf,
+                      size_t count);
+
+/****************************************************************************
+ * Private Variables
+ ****************************************************************************/
+
+/* The ring buffer, the event N is stored at N % CONFIG_SCHEDULER_TRACE_EVENTS
+ * and the oldest events are overwritten.
+ */
+
+static struct trace_event_s g_trace_buffer[CONFIG_SCHEDULER_TRACE_EVENTS];
+
+/* The number of events recorded so far */
+
+static volatile uint32_t g_trace_head;
+
+/* The recording can be stopped while the buffer is read */
+
+static volatile bool g_trace_enabled = true;
+
+static struct vfs_ops_s g_trace_ops = {
+  .open  = trace_open,
+  .close = trace_close,
+  .read  = trace_read,
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static uint32_t trace_oldest(uint32_t head)
+{
+  return head > CONFIG_SCHEDULER_TRACE_EVENTS ?
+    head - CONFIG_SCHEDULER_TRACE_EVENTS : 0;
+}
+
+static int trace_open(struct opened_resource_s *priv, const char *pathname,
+                      int flags, mode_t mode)
+{
+  struct trace_cursor_s *cursor = malloc(sizeof(struct trace_cursor_s));
+  if (cursor == NULL) {
+    return -ENOMEM;
+  }
+
+  cursor->end = g_trace_head;
+  cursor->pos = trace_oldest(cursor->end);
+  priv->priv  = cursor;
+
+  return OK;
+}
+
+static int trace_close(struct opened_resource_s *priv)
+{
+  free(priv->priv);
+  priv->priv = NULL;
+
+  return OK;
+}
+
+static int trace_read(struct opened_resource_s *priv, void *buf,
+                      size_t count)
+{
+  struct trace_cursor_s *cursor = priv->priv;
+  struct trace_event_s *out = buf;
+  int num_events = 0;
+
+  /* Skip the events that were overwritten since the node was opened */
+
+  if (cursor->pos < trace_oldest(g_trace_head)) {
+    cursor->pos = trace_oldest(g_trace_head);
+  }
+
+  while (count >= sizeof(struct trace_event_s) && cursor->pos < cursor->end) {
+    out[num_events++] =
+      g_trace_buffer[cursor->pos++ & (CONFIG_SCHEDULER_TRACE_EVENTS - 1)];
+    count -= sizeof(struct trace_event_s);
+  }
+
+  return num_events * sizeof(struct trace_event_s);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/**************************************************************************
+ * Name:
+ *  trace_record_task
+ *
+ * Description:
+ *  Record an event on behalf of a task. The slot is reserved with the
+ *  interrupts disabled so the tasks and the interrupt handlers can record
+ *  on ARMv5 and ARMv6-M too, they have no atomic add. The cost is one
+ *  clock read and a 16 byte store.
+ *
+ *************************************************************************/
+
+void trace_record_task(uint16_t task_id, uint8_t type, uint8_t arg8,
+                       uint32_t arg0, uint32_t arg1)
+{
+  if (!g_trace_enabled) {
+    return;
+  }
+
+  irq_state_t irq_state = cpu_disableint();
+  uint32_t slot = g_trace_head++;
+  cpu_enableint(irq_state);
+
+  struct trace_event_s *event =
+    &g_trace_buffer[slot & (CONFIG_SCHEDULER_TRACE_EVENTS - 1)];
+
+  event->timestamp_us = sched_clock_us();
+  event->type         = type;
+  event->arg8         = arg8;
+  event->task_id      = task_id;
+  event->arg0         = arg0;
+  event->arg1         = arg1;
+}
+
+/**************************************************************************
+ * Name:
+ *  trace_record
+ *
+ * Description:
+ *  Record an event for the current task. Use it through TRACE_EVENT.
+ *
+ *************************************************************************/
+
+void trace_record(uint8_t type, uint8_t arg8, uint32_t arg0, uint32_t arg1)
+{
+  tcb_t *tcb = sched_get_current_task();
+
+  trace_record_task(tcb != NULL ? tcb->task_id : TRACE_NO_TASK, type, arg8,
+                    arg0, arg1);
+}
+
+/**************************************************************************
+ * Name:
+ *  trace_enable
+ *
+ * Description:
+ *  Start or stop the recording.
+ *
+ * Return Value:
+ *  The previous state.
+ *
+ *************************************************************************/
+
+bool trace_enable(bool enable)
+{
+  bool was_enabled = g_trace_enabled;
+
+  g_trace_enabled = enable;
+  return was_enabled;
+}
+
+/**************************************************************************
+ * Name:
+ *  trace_clear
+ *
+ * Description:
+ *  Drop the recorded events.
+ *
+ *************************************************************************/
+
+void trace_clear(void)
+{
+  irq_state_t irq_state = cpu_disableint();
+  g_trace_head = 0;
+  cpu_enableint(irq_state);
+}
+
+/**************************************************************************
+ * Name:
+ *  trace_snapshot
+ *
+ * Description:
+ *  Copy the last recorded events, the oldest first. Stop the recording
+ *  with trace_enable(false) to get a consistent copy.
+ *
+ * Return Value:
+ *  The number of events copied.
+ *
+ *************************************************************************/
+
+int trace_snapshot(struct trace_event_s *events, int max_events)
+{
+  uint32_t head = g_trace_head;
+  uint32_t pos  = trace_oldest(head);
+
+  if (head - pos > max_events) {
+    pos = head - max_events;
+  }
+
+  int num_events = 0;
+  while (pos < head) {
+    events[num_events++] =
+      g_trace_buffer[pos++ & (CONFIG_SCHEDULER_TRACE_EVENTS - 1)];
+  }
+
+  return num_events;
+}
+
+/**************************************************************************
+ * Name:
+ *  trace_init
+ *
+ * Description:
+ *  Register /dev/trace, reading it returns the recorded events as an array
+ *  of struct trace_event_s, the oldest first. Call it after vfs_init.
+ *
+ *************************************************************************/
+
+int trace_init(void)
+{
+  return vfs_register_node(TRACE_DEV_PATH, strlen(TRACE_DEV_PATH),
+                           &g_trace_ops, VFS_TYPE_CHAR_DEVICE, NULL);
+}
+
+#endif /* CONFIG_SCHEDULER_TRACE */
@@ -1,21 +1,27 @@
 import subprocess
+import time
 from nbstreamreader import NonBlockingStreamReader as NBSR
 import json
 from difflib import SequenceMatcher
 from rapidfuzz import fuzz
 from rapidfuzz import process
 
-def send_cmd_wait_response(proc, cmd, nbsr):
+def send_cmd_wait_response(proc, cmd, nbsr, wait = 0):
     lines = ""
+    num_lines = 0
     proc.stdin.write(bytes(cmd, 'ascii'))
     proc.stdin.flush()
 
+    # Commands that sample for a while print their output after 'wait' seconds
+    deadline = time.time() + wait
+
     while True:
-        output = nbsr.readline(.1)
+        output = nbsr.readline(max(deadline - time.time(), .1))
         if output is None:
             break
         lines += str(output)
-    return lines
+        num_lines += 1
+    return lines, num_lines
 
 
 def run_json_cmd_check(proc, nbsr, json_test):
@@ -32,16 +38,23 @@ def run_json_cmd_check(proc, nbsr, json_test):
         isTestPassed = False
         output = None
         while times < maxAmountTestCmdTimes:
-            output = send_cmd_wait_response(proc, distro['cmd'], nbsr)
+            output, num_lines = send_cmd_wait_response(proc, distro['cmd'],
+                                                       nbsr,
+                                                       distro.get('wait', 0))
             print('Got stdout:', output)
             print('Expected:', distro['expected'])
 
             #m = SequenceMatcher(None, distro['expected'], output)
             diffRatio = fuzz.partial_ratio(str(distro['expected']), output, score_cutoff=80)
 
+            # The self tests print a verdict that must match exactly
+            if distro.get('exact', False) and distro['expected'] not in output:
+                diffRatio = 0
+
             #print("Result matches: " + str(diffRatio))
 
-            if diffRatio < 60:
+            # 'min_lines' counts the echo of the command too
+            if diffRatio < 60 or num_lines < distro.get('min_lines', 0):
                 times = times + 1
             else:
                 isTestPassed = True
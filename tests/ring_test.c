@@ -0,0 +1,155 @@
+#include <board.h>
+
+#include <ring.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The number of failed checks */
+
+static int g_failures;
+
+#define RING_CHECK(cond)                                                  \
+  do {                                                                    \
+    if (!(cond)) {                                                        \
+      printf("FAIL %s:%d %s\n", __func__, __LINE__, #cond);               \
+      g_failures++;                                                       \
+    }                                                                     \
+  } while (0)
+
+#define RING_TEST_SIZE          (8)
+
+static void test_init(void)
+{
+  struct ring_s ring;
+  uint8_t buffer[RING_TEST_SIZE];
+
+  RING_CHECK(ring_init(&ring, buffer, 0) == -EINVAL);
+  RING_CHECK(ring_init(&ring, buffer, 6) == -EINVAL);
+  RING_CHECK(ring_init(&ring, buffer, RING_TEST_SIZE) == OK);
+}
+
+static void test_empty_full(void)
+{
+  struct ring_s ring;
+  uint8_t buffer[RING_TEST_SIZE];
+  uint8_t data[RING_TEST_SIZE + 1] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+  uint8_t out[RING_TEST_SIZE + 1];
+  uint32_t len;
+
+  ring_init(&ring, buffer, RING_TEST_SIZE);
+
+  RING_CHECK(ring_count(&ring) == 0);
+  RING_CHECK(ring_space(&ring) == RING_TEST_SIZE);
+  RING_CHECK(ring_pop(&ring, out, sizeof(out)) == 0);
+  ring_peek_read(&ring, &len);
+  RING_CHECK(len == 0);
+
+  /* Only the room left is copied, a full ring rejects the bytes */
+
+  RING_CHECK(ring_push(&ring, data, sizeof(data)) == RING_TEST_SIZE);
+  RING_CHECK(ring_count(&ring) == RING_TEST_SIZE);
+  RING_CHECK(ring_space(&ring) == 0);
+  RING_CHECK(ring_push(&ring, data, 1) == 0);
+  RING_CHECK(ring_push_byte(&ring, 9) == -EAGAIN);
+  ring_peek_write(&ring, &len);
+  RING_CHECK(len == 0);
+
+  RING_CHECK(ring_pop(&ring, out, sizeof(out)) == RING_TEST_SIZE);
+  RING_CHECK(memcmp(out, data, RING_TEST_SIZE) == 0);
+  RING_CHECK(ring_count(&ring) == 0);
+}
+
+static void test_wraparound(void)
+{
+  struct ring_s ring;
+  uint8_t buffer[RING_TEST_SIZE];
+  uint8_t out[RING_TEST_SIZE];
+
+  ring_init(&ring, buffer, RING_TEST_SIZE);
+
+  /* Move the indices to the middle, the next bulk copies are split */
+
+  for (int i = 0; i < 5; i++) {
+    RING_CHECK(ring_push_byte(&ring, i) == OK);
+  }
+
+  RING_CHECK(ring_pop(&ring, out, 5) == 5);
+
+  const uint8_t data[RING_TEST_SIZE] = { 10, 11, 12, 13, 14, 15, 16, 17 };
+  RING_CHECK(ring_push(&ring, data, sizeof(data)) == RING_TEST_SIZE);
+  RING_CHECK(buffer[0] == 13 && buffer[5] == 10);
+
+  memset(out, 0, sizeof(out));
+  RING_CHECK(ring_pop(&ring, out, sizeof(out)) == RING_TEST_SIZE);
+  RING_CHECK(memcmp(out, data, sizeof(data)) == 0);
+
+  /* The free running indices wrap at 2^32 */
+
+  ring.head = ring.tail = UINT32_MAX - 2;
+  RING_CHECK(ring_push(&ring, data, 6) == 6);
+  RING_CHECK(ring_count(&ring) == 6);
+  RING_CHECK(ring_space(&ring) == RING_TEST_SIZE - 6);
+  RING_CHECK(ring_pop(&ring, out, sizeof(out)) == 6);
+  RING_CHECK(memcmp(out, data, 6) == 0);
+  RING_CHECK(ring.head == 3 && ring.tail == 3);
+}
+
+static void test_peek_commit_split(void)
+{
+  struct ring_s ring;
+  uint8_t buffer[RING_TEST_SIZE];
+  uint8_t out[RING_TEST_SIZE];
+  uint32_t len;
+
+  ring_init(&ring, buffer, RING_TEST_SIZE);
+
+  for (int i = 0; i < 6; i++) {
+    ring_push_byte(&ring, i);
+  }
+
+  RING_CHECK(ring_pop(&ring, out, 6) == 6);
+
+  /* The free region stops at the end of the buffer */
+
+  uint8_t *region = ring_peek_write(&ring, &len);
+  RING_CHECK(region == buffer + 6 && len == 2);
+  region[0] = 20;
+  region[1] = 21;
+  ring_commit_write(&ring, 2);
+
+  region = ring_peek_write(&ring, &len);
+  RING_CHECK(region == buffer && len == RING_TEST_SIZE - 2);
+  region[0] = 22;
+  ring_commit_write(&ring, 1);
+  RING_CHECK(ring_count(&ring) == 3);
+
+  /* The queued bytes are read in two regions as well */
+
+  const uint8_t *queued = ring_peek_read(&ring, &len);
+  RING_CHECK(queued == buffer + 6 && len == 2);
+  RING_CHECK(queued[0] == 20 && queued[1] == 21);
+  ring_commit_read(&ring, len);
+
+  queued = ring_peek_read(&ring, &len);
+  RING_CHECK(queued == buffer && len == 1 && queued[0] == 22);
+  ring_commit_read(&ring, len);
+
+  RING_CHECK(ring_count(&ring) == 0);
+  RING_CHECK(ring_space(&ring) == RING_TEST_SIZE);
+}
+
+int main(int argc, char *argv[])
+{
+  test_init();
+  test_empty_full();
+  test_wraparound();
+  test_peek_commit_split();
+
+  if (g_failures > 0) {
+    printf("ring_test: %d checks failed\n", g_failures);
+    return 1;
+  }
+
+  printf("ring_test: passed\n");
+  return 0;
+}
@@ -0,0 +1,14 @@
+/*
+ * tests/stubs/board.h
+ *
+ * The board definitions needed to build the kernel utilities on the host.
+ */
+
+#ifndef __BOARD_H
+#define __BOARD_H
+
+#include <errno.h>
+
+#define OK                      (0)
+
+#endif /* __BOARD_H */
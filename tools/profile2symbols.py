@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+#
+# Resolve the Calypso OS profiler samples to functions and print the hot
+# spots, for all the tasks and for each task.
+#
+# The input is the console output of the 'profile' command, the lines that
+# start with "profile:", and the firmware image used to run it.
+#
+# Usage:
+#   ./build.elf | tee console.log
+#   python3 tools/profile2symbols.py build.elf console.log
+#
+# Use --nm arm-none-eabi-nm for the boards.
+#
+
+import argparse
+import bisect
+import collections
+import subprocess
+import sys
+
+# The function whose address is printed as the "base" line
+
+BASE_SYMBOL = "profile_start"
+
+
+def load_symbols(nm, image):
+    output = subprocess.run([nm, "-n", "-S", image], check=True,
+                            stdout=subprocess.PIPE,
+                            universal_newlines=True).stdout
+
+    addresses = []
+    sizes = []
+    names = []
+    for line in output.splitlines():
+        fields = line.split()
+
+        # The size column is missing for the assembly symbols
+
+        if len(fields) == 3:
+            fields.insert(1, "0")
+
+        if len(fields) != 4 or fields[2] not in "tTW":
+            continue
+
+        # Skip the weak data symbols, like data_start from the C runtime
+
+        if fields[2] == "W" and int(fields[1], 16) == 0:
+            continue
+
+        name = fields[3]
+
+        # The Mach-O symbols have a leading underscore
+
+        if sys.platform == "darwin" and name.startswith("_"):
+            name = name[1:]
+
+        addresses.append(int(fields[0], 16))
+        sizes.append(int(fields[1], 16))
+        names.append(name)
+
+    return addresses, sizes, names
+
+
+def parse_profile(path):
+    base = None
+    dropped = 0
+    tasks = {}
+    samples = []
+
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            pos = line.find("profile:")
+            if pos < 0:
+                continue
+
+            fields = line[pos + len("profile:"):].split()
+            try:
+                if fields[0] == "base":
+                    base = int(fields[1], 16)
+                elif fields[0] == "dropped":
+                    dropped = int(fields[1])
+                elif fields[0] == "task":
+                    tasks[int(fields[1])] = (" ".join(fields[3:]),
+                                             int(fields[2]))
+                elif fields[0] == "pc":
+                    samples.append((int(fields[1], 16), int(fields[2]),
+                                    int(fields[3])))
+            except (IndexError, ValueError):
+                continue
+
+    return base, dropped, tasks, samples
+
+
+def symbolize(pc, addresses, sizes, names):
+    """The PCs outside of the image, in the host libraries on the sim, are
+    reported as unknown."""
+    index = bisect.bisect_right(addresses, pc) - 1
+    if index < 0 or index == len(addresses) - 1 and sizes[index] == 0:
+        return "[unknown]"
+    if sizes[index] > 0 and pc >= addresses[index] + sizes[index]:
+        return "[unknown]"
+    return names[index]
+
+
+def print_top(title, counts, total, limit):
+    print(title)
+    print("%8s %6s  %s" % ("SAMPLES", "SHARE", "FUNCTION"))
+    for name, count in counts.most_common(limit):
+        print("%8d %5.1f%%  %s" % (count, 100.0 * count / total, name))
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("image", help="the firmware, build.elf on the sim")
+    parser.add_argument("log", help="the console output of 'profile'")
+    parser.add_argument("--nm", default="nm", help="the nm of the toolchain")
+    parser.add_argument("-n", "--limit", type=int, default=20,
+                        help="the number of functions shown")
+    args = parser.parse_args()
+
+    base, dropped, tasks, samples = parse_profile(args.log)
+    if not samples:
+        sys.exit("no profile samples found in %s" % args.log)
+
+    addresses, sizes, names = load_symbols(args.nm, args.image)
+
+    # Relocate the samples when the image was loaded at a different address,
+    # a position independent executable on the sim.
+
+    offset = 0
+    if base is not None and BASE_SYMBOL in names:
+        offset = base - addresses[names.index(BASE_SYMBOL)]
+
+    total = collections.Counter()
+    per_task = collections.defaultdict(collections.Counter)
+    for pc, count, task_id in samples:
+        name = symbolize(pc - offset, addresses, sizes, names)
+        total[name] += count
+        per_task[task_id][name] += count
+
+    num_samples = sum(total.values())
+    print("%d samples, %d dropped\n" % (num_samples, dropped))
+    print_top("All tasks", total, num_samples, args.limit)
+
+    for task_id, counts in sorted(per_task.items(),
+                                  key=lambda item: -sum(item[1].values())):
+        name = tasks.get(task_id, ("task %d" % task_id, 0))[0]
+        task_samples = sum(counts.values())
+        print_top("%s (%d), %d samples" % (name, task_id, task_samples),
+                  counts, task_samples, args.limit)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+#
+# Convert the Calypso OS scheduler trace to the Chrome JSON trace format that
+# can be opened in ui.perfetto.dev or chrome://tracing.
+#
+# The input is either the console output of the 'trace' command, the lines
+# that contain "trace: <timestamp_us> <type> <task_id> <arg8> <arg0> <arg1>",
+# or with --binary the raw content of /dev/trace.
+#
+# Usage:
+#   ./build.elf | tee console.log
+#   python3 tools/trace2perfetto.py console.log -o trace.json
+#
+
+import argparse
+import json
+import struct
+import sys
+
+# Keep these in sync with enum trace_event_type_e from sched/include/trace.h
+
+TRACE_SWITCH      = 0
+TRACE_WAKEUP      = 1
+TRACE_SEM_BLOCK   = 2
+TRACE_SEM_POST    = 3
+TRACE_IRQ_ENTER   = 4
+TRACE_IRQ_EXIT    = 5
+TRACE_TASK_CREATE = 6
+TRACE_TASK_EXIT   = 7
+
+# Keep these in sync with enum task_state_e from sched/include/scheduler.h
+
+TASK_STATES = ["READY", "RUNNING", "WAITING_FOR_SEM", "SLEEPING", "HALTED"]
+
+# struct trace_event_s
+
+BINARY_EVENT = struct.Struct("<IBBHII")
+
+TASKS_PID = 0
+IRQS_PID  = 1
+
+# TRACE_NO_TASK, events recorded before the first task runs
+
+NO_TASK = 0xFFFF
+
+
+def parse_text(path):
+    events = []
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            pos = line.find("trace:")
+            if pos < 0:
+                continue
+
+            fields = line[pos + len("trace:"):].split()
+            if len(fields) != 6:
+                continue
+
+            try:
+                events.append((int(fields[0]) & 0xFFFFFFFF, int(fields[1]),
+                               int(fields[2]), int(fields[3]),
+                               int(fields[4], 16), int(fields[5], 16)))
+            except ValueError:
+                continue
+    return events
+
+
+def parse_binary(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    events = []
+    for offset in range(0, len(data) - BINARY_EVENT.size + 1,
+                        BINARY_EVENT.size):
+        ts, ev_type, arg8, task_id, arg0, arg1 = \
+            BINARY_EVENT.unpack_from(data, offset)
+        events.append((ts, ev_type, task_id, arg8, arg0, arg1))
+    return events
+
+
+def unwrap_timestamps(events):
+    """The timestamps are a wrapping 32 bit microsecond counter."""
+    unwrapped = []
+    offset = 0
+    prev = None
+    for ev in events:
+        ts = ev[0]
+        if prev is not None and ts + offset < prev - (1 << 31):
+            offset += 1 << 32
+        prev = ts + offset
+        unwrapped.append((prev,) + ev[1:])
+    return unwrapped
+
+
+def task_name(arg0, arg1):
+    raw = struct.pack("<II", arg0, arg1)
+    return raw.split(b"\0")[0].decode("ascii", errors="replace")
+
+
+def convert(events):
+    out = []
+    names = {}
+    running = None
+    run_start = None
+    irq_start = {}
+
+    def instant(ts, tid, name, args):
+        out.append({"name": name, "ph": "i", "s": "t", "ts": ts,
+                    "pid": TASKS_PID, "tid": tid, "args": args})
+
+    for ts, ev_type, task_id, arg8, arg0, arg1 in events:
+        if ev_type == TRACE_SWITCH:
+            start = run_start if running == task_id else events[0][0]
+            state = TASK_STATES[arg8] if arg8 < len(TASK_STATES) else arg8
+            out.append({"name": "running", "ph": "X", "ts": start,
+                        "dur": ts - start, "pid": TASKS_PID, "tid": task_id,
+                        "args": {"switched_out": state, "next": arg0}})
+            running = arg0
+            run_start = ts
+        elif ev_type == TRACE_WAKEUP:
+            instant(ts, arg0, "wakeup", {"by": task_id})
+        elif ev_type == TRACE_SEM_BLOCK:
+            instant(ts, task_id, "sem_block",
+                    {"sem": hex(arg0), "timeout_ms": struct.unpack(
+                        "<i", struct.pack("<I", arg1))[0]})
+        elif ev_type == TRACE_SEM_POST:
+            instant(ts, task_id, "sem_post", {"sem": hex(arg0)})
+        elif ev_type == TRACE_IRQ_ENTER:
+            irq_start[arg8] = ts
+        elif ev_type == TRACE_IRQ_EXIT:
+            start = irq_start.pop(arg8, ts)
+            out.append({"name": "irq %d" % arg8, "ph": "X", "ts": start,
+                        "dur": ts - start, "pid": IRQS_PID, "tid": arg8,
+                        "args": {"task": task_id}})
+        elif ev_type == TRACE_TASK_CREATE:
+            names[task_id] = task_name(arg0, arg1)
+            instant(ts, task_id, "create", {"priority": arg8})
+        elif ev_type == TRACE_TASK_EXIT:
+            instant(ts, task_id, "exit", {})
+
+    out.append({"name": "process_name", "ph": "M", "pid": TASKS_PID,
+                "args": {"name": "Tasks"}})
+    out.append({"name": "process_name", "ph": "M", "pid": IRQS_PID,
+                "args": {"name": "Interrupts"}})
+
+    for tid in sorted(set(e["tid"] for e in out if e.get("pid") == TASKS_PID
+                          and "tid" in e)):
+        name = "no task" if tid == NO_TASK else names.get(tid, "task %d" % tid)
+        out.append({"name": "thread_name", "ph": "M", "pid": TASKS_PID,
+                    "tid": tid, "args": {"name": "%s (%d)" % (name, tid)}})
+
+    return {"traceEvents": out, "displayTimeUnit": "ms"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("input", help="console log or /dev/trace dump")
+    parser.add_argument("-o", "--output", default="-",
+                        help="the JSON file, stdout by default")
+    parser.add_argument("--binary", action="store_true",
+                        help="the input is the raw content of /dev/trace")
+    args = parser.parse_args()
+
+    events = parse_binary(args.input) if args.binary else \
+        parse_text(args.input)
+    if not events:
+        sys.exit("no trace events found in %s" % args.input)
+
+    trace = convert(unwrap_timestamps(events))
+
+    if args.output == "-":
+        json.dump(trace, sys.stdout)
+    else:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+
+
+if __name__ == "__main__":
+    main()
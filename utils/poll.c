@@ -20,45 +20,90 @@
 int poll(struct pollfd fds[], size_t nfds, int timeout)
 {
   sem_t poll_sema;
-  bool is_poll_wait_needed;
+  int num_ready = 0;
   int ret = 0;
 
-  /* Check the pollers if we have to wait for events */
+  sem_init(&poll_sema, 0, 0);
+
+  /* Register the poll semaphore with the drivers and collect the events that
+   * are already pending.
+   */
 
   for (int i = 0; i < nfds; i++)
   {
-		if (IS_POLL_EVENT_SET(fds[i].events, POLLIN) ||
-        IS_POLL_EVENT_SET(fds[i].events, POLLOUT))
+    struct pollfd *poller = &fds[i];
+
+    /* Clear out the returned events */
+
+    poller->revents = 0;
+
+    if (!IS_POLL_EVENT_SET(poller->events, POLLIN) &&
+        !IS_POLL_EVENT_SET(poller->events, POLLOUT))
     {
-      struct pollfd *poller = &fds[i];
-    
-      /* Clear out the returned events */
+      continue;
+    }
 
-      poller->revents     = 0;
+    /* Get the opened resource from the file descriptor */
 
-      /* Get the opened resource from the file descriptor */
+    irq_state_t irq_state = cpu_disableint();
+    struct opened_resource_s *res = sched_find_opened_resource(poller->fd);
+    cpu_enableint(irq_state);
 
-      irq_state_t irq_state = cpu_disableint();
-      struct opened_resource_s *res = sched_find_opened_resource(poller->fd);
-      cpu_enableint(irq_state);
+    if (res == NULL)
+    {
+      poller->revents |= (1 << POLLNVAL);
+      continue;
+    }
 
-      if (res->vfs_node->ops || res->vfs_node->ops->poll)
-      {
-        return -ENOSYS;
-      }
+    if (!res->vfs_node->ops || !res->vfs_node->ops->poll)
+    {
+      ret = -ENOSYS;
+      goto unregister_pollers;
+    }
 
-      ret = res->vfs_node->ops->poll(res, &poll_sema, &poller->revents); 
-      if (ret == 0)
-      {
-        is_poll_wait_needed = true;
-      }
+    ret = res->vfs_node->ops->poll(res, &poll_sema, &poller->revents);
+    if (ret < 0)
+    {
+      goto unregister_pollers;
     }
   }
 
-  if (is_poll_wait_needed)
+  for (int i = 0; i < nfds; i++)
+  {
+    num_ready += fds[i].revents != 0;
+  }
+
+  /* Block until a driver posts the semaphore or the timeout expires */
+
+  if (num_ready == 0 && timeout != 0)
   {
-    sem_timedwait(&poll_sema, POLL_WAIT_FOREVER);
+    ret = sem_timedwait(&poll_sema, timeout);
+    if (ret == -ETIMEDOUT)
+    {
+      ret = 0;
+    }
+
+    for (int i = 0; i < nfds; i++)
+    {
+      num_ready += fds[i].revents != 0;
+    }
+  }
+
+unregister_pollers:
+
+  /* The semaphore lives on our stack, make sure the drivers drop it */
+
+  for (int i = 0; i < nfds; i++)
+  {
+    irq_state_t irq_state = cpu_disableint();
+    struct opened_resource_s *res = sched_find_opened_resource(fds[i].fd);
+    cpu_enableint(irq_state);
+
+    if (res != NULL && res->vfs_node->ops && res->vfs_node->ops->poll)
+    {
+      res->vfs_node->ops->poll(res, NULL, &fds[i].revents);
+    }
   }
 
-  return ret;
+  return ret < 0 ? ret : num_ready;
 }
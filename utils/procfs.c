@@ -0,0 +1,158 @@
+/*
+ * utils/procfs.c
+ *
+ * Created: 17/10/2026
+ *  Author: sene
+ */
+
+#include <board.h>
+
+#ifdef CONFIG_PROCFS
+
+#include <errno.h>
+#include <irq_manager.h>
+#include <procfs.h>
+#include <scheduler.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vfs.h>
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* The snapshot of a node taken at open time */
+
+struct procfs_snapshot_s {
+  size_t len;                       /* The number of valid bytes in data */
+  size_t pos;                       /* The read offset */
+  char data[];
+};
+
+/* The kernel nodes registered by procfs_init */
+
+struct procfs_entry_s {
+  const char *name;
+  procfs_show_cb show;
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static int procfs_open(struct opened_resource_s *priv, const char *pathname,
+                       int flags, mode_t mode);
+static int procfs_close(struct opened_resource_s *priv);
+static int procfs_read(struct opened_resource_s *priv, void *buf,
+                       size_t count);
+
+/****************************************************************************
+ * Private Variables
+ ****************************************************************************/
+
+static struct vfs_ops_s g_procfs_ops = {
+  .open  = procfs_open,
+  .close = procfs_close,
+  .read  = procfs_read,
+};
+
+static const struct procfs_entry_s g_procfs_entries[] = {
+#ifdef CONFIG_SCHEDULER_TASK_COLORATION
+  { "stacks", sched_procfs_stacks },
+#endif
+#ifdef CONFIG_SCHEDULER_CPU_STATS
+  { "cpu",    sched_procfs_cpu },
+#endif
+#ifdef CONFIG_IRQ_STATS
+  { "interrupts", irq_procfs_interrupts },
+#endif
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int procfs_open(struct opened_resource_s *priv, const char *pathname,
+                       int flags, mode_t mode)
+{
+  procfs_show_cb show = (procfs_show_cb)priv->vfs_node->priv;
+
+  struct procfs_snapshot_s *snapshot =
+    malloc(sizeof(struct procfs_snapshot_s) + CONFIG_PROCFS_BUFFER_SIZE);
+  if (snapshot == NULL) {
+    return -ENOMEM;
+  }
+
+  int len = show(snapshot->data, CONFIG_PROCFS_BUFFER_SIZE);
+  if (len < 0) {
+    free(snapshot);
+    return len;
+  }
+
+  /* A truncated snapshot returns the size it wanted, like snprintf */
+
+  if (len > CONFIG_PROCFS_BUFFER_SIZE) {
+    len = CONFIG_PROCFS_BUFFER_SIZE;
+  }
+
+  snapshot->len  = len;
+  snapshot->pos  = 0;
+  priv->priv     = snapshot;
+
+  return OK;
+}
+
+static int procfs_close(struct opened_resource_s *priv)
+{
+  free(priv->priv);
+  priv->priv = NULL;
+
+  return OK;
+}
+
+static int procfs_read(struct opened_resource_s *priv, void *buf,
+                       size_t count)
+{
+  struct procfs_snapshot_s *snapshot = priv->priv;
+
+  if (count > snapshot->len - snapshot->pos) {
+    count = snapshot->len - snapshot->pos;
+  }
+
+  memcpy(buf, snapshot->data + snapshot->pos, count);
+  snapshot->pos += count;
+
+  return count;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int procfs_register(const char *name, procfs_show_cb show)
+{
+  char path[VFS_MAX_PATH_LEN];
+
+  if (name == NULL || show == NULL) {
+    return -EINVAL;
+  }
+
+  int len = snprintf(path, sizeof(path), PROCFS_PATH "%s", name);
+  if (len < 0) {
+    return -EINVAL;
+  } else if (len >= sizeof(path)) {
+    return -ENAMETOOLONG;
+  }
+
+  return vfs_register_node(path, len, &g_procfs_ops, VFS_TYPE_FILE,
+                           (void *)show);
+}
+
+void procfs_init(void)
+{
+  for (int i = 0; i < ARRAY_LEN(g_procfs_entries); i++) {
+    procfs_register(g_procfs_entries[i].name, g_procfs_entries[i].show);
+  }
+}
+
+#endif /* CONFIG_PROCFS */
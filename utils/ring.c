@@ -0,0 +1,149 @@
+/*
+ * utils/ring.c
+ *
+ * Created: 17/10/2026
+ *  Author: sene
+ */
+
+#include <board.h>
+
+#include <ring.h>
+#include <string.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* A side reads the index of the other side with acquire semantics and it
+ * publishes its own index with release semantics, so the data copied in
+ * the buffer is visible before the index that covers it. The ARMv5 cores
+ * have no barrier instruction, they are single core and the interrupts
+ * only need the compiler ordering.
+ */
+
+#if defined(__ARM_ARCH) && (__ARM_ARCH < 6)
+  #define RING_LOAD_ACQUIRE(ptr)                                            \
+    ({ uint32_t __val = *(volatile uint32_t *)(ptr);                        \
+       __atomic_signal_fence(__ATOMIC_ACQUIRE); __val; })
+  #define RING_STORE_RELEASE(ptr, val)                                      \
+    do { __atomic_signal_fence(__ATOMIC_RELEASE);                           \
+         *(volatile uint32_t *)(ptr) = (val); } while (0)
+#else
+  #define RING_LOAD_ACQUIRE(ptr)        __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+  #define RING_STORE_RELEASE(ptr, val)                                      \
+    __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static inline uint32_t ring_min(uint32_t a, uint32_t b)
+{
+  return a < b ? a : b;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int ring_init(struct ring_s *ring, void *buffer, uint32_t size)
+{
+  if (size == 0 || (size & (size - 1)) != 0) {
+    return -EINVAL;
+  }
+
+  ring->buffer = buffer;
+  ring->mask   = size - 1;
+  ring->head   = 0;
+  ring->tail   = 0;
+
+  return OK;
+}
+
+uint32_t ring_count(struct ring_s *ring)
+{
+  return RING_LOAD_ACQUIRE(&ring->head) - RING_LOAD_ACQUIRE(&ring->tail);
+}
+
+uint32_t ring_space(struct ring_s *ring)
+{
+  return ring->mask + 1 - ring_count(ring);
+}
+
+uint32_t ring_push(struct ring_s *ring, const void *data, uint32_t len)
+{
+  uint32_t head = ring->head;
+  uint32_t free = ring->mask + 1 - (head - RING_LOAD_ACQUIRE(&ring->tail));
+  uint32_t offset = head & ring->mask;
+
+  len = ring_min(len, free);
+
+  /* Copy up to the end of the buffer and wrap around for the rest */
+
+  uint32_t first = ring_min(len, ring->mask + 1 - offset);
+  memcpy(ring->buffer + offset, data, first);
+  memcpy(ring->buffer, (const uint8_t *)data + first, len - first);
+
+  RING_STORE_RELEASE(&ring->head, head + len);
+  return len;
+}
+
+int ring_push_byte(struct ring_s *ring, uint8_t byte)
+{
+  uint32_t head = ring->head;
+
+  if (head - RING_LOAD_ACQUIRE(&ring->tail) > ring->mask) {
+    return -EAGAIN;
+  }
+
+  ring->buffer[head & ring->mask] = byte;
+  RING_STORE_RELEASE(&ring->head, head + 1);
+  return OK;
+}
+
+uint32_t ring_pop(struct ring_s *ring, void *data, uint32_t len)
+{
+  uint32_t tail = ring->tail;
+  uint32_t used = RING_LOAD_ACQUIRE(&ring->head) - tail;
+  uint32_t offset = tail & ring->mask;
+
+  len = ring_min(len, used);
+
+  uint32_t first = ring_min(len, ring->mask + 1 - offset);
+  memcpy(data, ring->buffer + offset, first);
+  memcpy((uint8_t *)data + first, ring->buffer, len - first);
+
+  RING_STORE_RELEASE(&ring->tail, tail + len);
+  return len;
+}
+
+void *ring_peek_write(struct ring_s *ring, uint32_t *len)
+{
+  uint32_t head = ring->head;
+  uint32_t free = ring->mask + 1 - (head - RING_LOAD_ACQUIRE(&ring->tail));
+  uint32_t offset = head & ring->mask;
+
+  *len = ring_min(free, ring->mask + 1 - offset);
+  return ring->buffer + offset;
+}
+
+void ring_commit_write(struct ring_s *ring, uint32_t len)
+{
+  RING_STORE_RELEASE(&ring->head, ring->head + len);
+}
+
+const void *ring_peek_read(struct ring_s *ring, uint32_t *len)
+{
+  uint32_t tail = ring->tail;
+  uint32_t used = RING_LOAD_ACQUIRE(&ring->head) - tail;
+  uint32_t offset = tail & ring->mask;
+
+  *len = ring_min(used, ring->mask + 1 - offset);
+  return ring->buffer + offset;
+}
+
+void ring_commit_read(struct ring_s *ring, uint32_t len)
+{
+  RING_STORE_RELEASE(&ring->tail, ring->tail + len);
+}
@@ -135,13 +135,8 @@ int ioctl(int fd, unsigned long request, unsigned long arg)
   int ret = -EINVAL;
   irq_state_t irq_state = cpu_disableint();
 
-  struct tcb_s *curr_tcb = sched_get_current_task();
-  assert(curr_tcb->curr_resource_opened >= 0);
-
-  /* Iterate over opened resource list find the fd and free the resource */
-
   struct opened_resource_s *resource = sched_find_opened_resource(fd);
-  if (resource->vfs_node == NULL) {
+  if (resource == NULL || resource->vfs_node == NULL) {
     goto cancel_ioctl;
   }
 
@@ -127,17 +127,42 @@ int close(int fd)
     return -ENOSYS;
   }
 
-  sem_wait(&res->vfs_node->lock);
+  struct vfs_node_s *node = res->vfs_node;
 
-  int ret = res->vfs_node->ops->close(res);
+  sem_wait(&node->lock);
+
+  int ret = node->ops->close(res);
   sched_free_resource(fd);
-  res->vfs_node->open_count -= 1;
+  node->open_count -= 1;
 
-  sem_post(&res->vfs_node->lock);
+  sem_post(&node->lock);
 
   return ret;
 }
 
+#ifdef CONFIG_SCHEDULER_TICK
+/**************************************************************************
+ * Name:
+ *  usec_to_ticks
+ *
+ * Description:
+ *  Convert an interval in microseconds to scheduler ticks. The result is
+ *  rounded up so that we never sleep less than requested.
+ *
+ *************************************************************************/
+static inline uint32_t usec_to_ticks(uint32_t microseconds)
+{
+  uint32_t usec_per_tick = USEC_PER_SEC / SCHED_TICKS_PER_SEC;
+  uint32_t ticks = microseconds / usec_per_tick;
+
+  if (microseconds % usec_per_tick) {
+    ticks++;
+  }
+
+  return ticks;
+}
+
+#else
 static inline void wait_usec(void)
 {
   volatile uint32_t counter = 0;
@@ -145,13 +170,16 @@ static inline void wait_usec(void)
   /* 1 us takes this time */
   for (counter; counter < CONFIG_SYSTEM_CLOCK_FREQUENCY; ++counter);
 }
+#endif /* CONFIG_SCHEDULER_TICK */
 
 /**************************************************************************
  * Name:
  *  usleep
  *
  * Description:
- *  Put the calling process into sleep state for 'microseconds'
+ *  Put the calling process into sleep state for 'microseconds'. When the
+ *  board drives the scheduler tick the task waits in the sleep queue and
+ *  the CPU is given to the other tasks, otherwise we busy wait.
  *
  * Return Value:
  *  Zero on success otherwise a negative value.
@@ -159,12 +187,86 @@ static inline void wait_usec(void)
  *************************************************************************/
 int usleep(useconds_t microseconds)
 {
+#ifdef CONFIG_SCHEDULER_TICK
+  int ret;
+
+  /* Avoid the 64 bit division, we can't sleep for more than ~71 minutes */
+
+  if (microseconds > UINT32_MAX) {
+    microseconds = UINT32_MAX;
+  }
+
+  ret = sched_sleep(usec_to_ticks((uint32_t)microseconds));
+  if (ret != -EAGAIN) {
+    return ret;
+  }
+
+  /* There is no other task to run, for example we are called before the
+   * scheduler starts, so fall back to waiting for the ticks in place.
+   */
+
+  uint32_t wake_tick = sched_get_ticks() +
+    usec_to_ticks((uint32_t)microseconds);
+  while ((int32_t)(wake_tick - sched_get_ticks()) > 0);
+#else
   while (microseconds-- > 0)
     wait_usec();
+#endif
 
   return OK;
 }
 
+/**************************************************************************
+ * Name:
+ *  nanosleep
+ *
+ * Description:
+ *  Suspend the calling task for at least the interval specified in req.
+ *
+ * Return Value:
+ *  Zero on success otherwise a negative value.
+ *
+ *************************************************************************/
+int nanosleep(const struct timespec *req, struct timespec *rem)
+{
+  useconds_t microseconds;
+  int ret;
+
+  if (req == NULL || req->tv_sec < 0 || req->tv_nsec < 0 ||
+      req->tv_nsec >= NSEC_PER_SEC) {
+    return -EINVAL;
+  }
+
+  microseconds = (useconds_t)req->tv_sec * USEC_PER_SEC +
+    (uint32_t)(req->tv_nsec + NSEC_PER_USEC - 1) / NSEC_PER_USEC;
+
+  ret = usleep(microseconds);
+
+  if (rem != NULL) {
+    rem->tv_sec  = 0;
+    rem->tv_nsec = 0;
+  }
+
+  return ret;
+}
+
+/**************************************************************************
+ * Name:
+ *  sleep
+ *
+ * Description:
+ *  Put the calling process into sleep state for 'seconds'
+ *
+ * Return Value:
+ *  Zero when the requested time has elapsed.
+ *
+ *************************************************************************/
+unsigned int sleep(unsigned int seconds)
+{
+  usleep((useconds_t)seconds * USEC_PER_SEC);
+  return 0;
+}
+
 /**************************************************************************
  * Name:
  *  unlink
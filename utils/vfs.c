@@ -25,8 +25,8 @@ static sem_t g_vfs_sema;
 /* VFS default mountpoints */
 
 static struct vfs_init_mountpoint_s g_vfs_default_mtpt = {
-  .node_name = {"dev", "mnt", "bin", "otp", "home"},
-  .num_nodes = 5,
+  .node_name = {"dev", "mnt", "bin", "otp", "home", "proc"},
+  .num_nodes = 6,
 };
 
 /* Known filesystems list */
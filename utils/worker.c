@@ -18,10 +18,22 @@
  */
 
 #include <board.h>
+#include <scheduler.h>
 #include <semaphore.h>
+#include <stdlib.h>
 #include <string.h>
 #include <worker.h>
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The initial number of slots in the heap of a worker, it doubles when it
+ * gets full.
+ */
+
+#define WORKER_HEAP_INITIAL_CAPACITY    (8)
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
@@ -30,7 +42,9 @@
 
 static LIST_HEAD(g_system_workers);
 
-/* Exclusive access to the system workers list */
+/* Exclusive access to the system workers list, the changes to the list are
+ * also made with the interrupts disabled so worker_submit can walk it.
+ */
 
 static sem_t g_lock_system_workers;
 
@@ -43,51 +57,163 @@ static volatile int g_uid_counter;
  ****************************************************************************/
 
 /**
- * worker_main - entry point for the worker thread
+ * worker_is_before - compare two work items by their deadline
  *
- * @argc: the number of argumentsd
- * @argv: arguments array
+ * @a: the first work item
+ * @b: the second work item
  *
- * Iterate through the worker callbacks and execute them. Pass the required
- * arguments.
+ * The ticks wrap around so they are compared by their difference, the
+ * work enqueued first wins on the same tick.
+ */
+static bool worker_is_before(const worker_cb_t *a, const worker_cb_t *b)
+{
+  int32_t diff = (int32_t)(a->wake_tick - b->wake_tick);
+
+  if (diff != 0) {
+    return diff < 0;
+  }
+
+  return (int32_t)(a->seq - b->seq) < 0;
+}
+
+/**
+ * worker_heap_sift_up - move a work item up to its place in the heap
  *
- * Returns 0 (OK) on successful completion otherwise a negative error code.
+ * @thread: the worker task that owns the heap
+ * @index: the slot of the work item
  */
-static int worker_main(int argc, char **argv)
+static void worker_heap_sift_up(worker_thread_t *thread, int index)
 {
-  int ret = 0;
-  worker_t *worker = (worker_t *)argv;
+  worker_cb_t *work = thread->heap[index];
 
-  while (worker->is_running_enabled)
-  {
-    sem_wait(&worker->g_lock_worker_list);
+  while (index > 0) {
+    int parent = (index - 1) / 2;
 
-    struct list_head *pos, *temp;
-    list_for_each_safe(pos, temp, &worker->worker_cb) {
-      worker_cb_t *work_callback = container_of(pos, worker_cb_t, work_list);
+    if (!worker_is_before(work, thread->heap[parent])) {
+      break;
+    }
 
-      sem_post(&worker->g_lock_worker_list);
+    thread->heap[index] = thread->heap[parent];
+    index = parent;
+  }
 
-      if (work_callback->callback) {
-        work_callback->callback(work_callback->priv_arg);
-      }
+  thread->heap[index] = work;
+}
 
-      list_del(&work_callback->work_list);
+/**
+ * worker_heap_sift_down - move a work item down to its place in the heap
+ *
+ * @thread: the worker task that owns the heap
+ * @index: the slot of the work item
+ */
+static void worker_heap_sift_down(worker_thread_t *thread, int index)
+{
+  worker_cb_t *work = thread->heap[index];
 
-      if (work_callback->cleanup_cb) {
-        work_callback->cleanup_cb(work_callback->priv_arg);
-      }
+  for (;;) {
+    int child = 2 * index + 1;
 
-      free(work_callback);
-      sem_wait(&worker->g_lock_worker_list);
+    if (child >= thread->heap_count) {
+      break;
     }
 
-    sem_post(&worker->g_lock_worker_list);
+    if (child + 1 < thread->heap_count &&
+        worker_is_before(thread->heap[child + 1], thread->heap[child])) {
+      child++;
+    }
+
+    if (!worker_is_before(thread->heap[child], work)) {
+      break;
+    }
+
+    thread->heap[index] = thread->heap[child];
+    index = child;
   }
 
-  sem_post(&worker->shutdown_notify);
+  thread->heap[index] = work;
+}
+
+/**
+ * worker_heap_push - add a work item to the heap
+ *
+ * @thread: the worker task that owns the heap
+ * @work: the work item
+ *
+ * Assumption: lock with g_lock_worker_list before calling this function
+ *
+ * Returns 0 (OK) or -ENOMEM when the heap can't grow.
+ */
+static int worker_heap_push(worker_thread_t *thread, worker_cb_t *work)
+{
+  if (thread->heap_count == thread->heap_capacity) {
+    int capacity = thread->heap_capacity > 0 ?
+      thread->heap_capacity * 2 : WORKER_HEAP_INITIAL_CAPACITY;
+    worker_cb_t **heap = realloc(thread->heap, capacity * sizeof(*heap));
+
+    if (heap == NULL) {
+      return -ENOMEM;
+    }
+
+    thread->heap          = heap;
+    thread->heap_capacity = capacity;
+  }
 
-  return ret;
+  thread->heap[thread->heap_count++] = work;
+  worker_heap_sift_up(thread, thread->heap_count - 1);
+
+  return 0;
+}
+
+/**
+ * worker_heap_remove - take a work item out of the heap
+ *
+ * @thread: the worker task that owns the heap
+ * @index: the slot of the work item
+ *
+ * Assumption: lock with g_lock_worker_list before calling this function
+ *
+ * Returns the work item.
+ */
+static worker_cb_t *worker_heap_remove(worker_thread_t *thread, int index)
+{
+  worker_cb_t *work = thread->heap[index];
+
+  thread->heap_count--;
+
+  if (index < thread->heap_count) {
+    thread->heap[index] = thread->heap[thread->heap_count];
+
+    if (index > 0 && worker_is_before(thread->heap[index],
+                                      thread->heap[(index - 1) / 2])) {
+      worker_heap_sift_up(thread, index);
+    } else {
+      worker_heap_sift_down(thread, index);
+    }
+  }
+
+  return work;
+}
+
+/**
+ * worker_release_work - give a work item back when it leaves the worker
+ *
+ * @work: the work item
+ *
+ * A submitted work item goes back to its owner and it can be submitted
+ * again. A copy made by worker_enqueue is freed with its arguments.
+ */
+static void worker_release_work(worker_cb_t *work)
+{
+  if (!(work->flags & WORKER_WORK_ALLOCATED)) {
+    work->flags &= ~WORKER_WORK_QUEUED;
+    return;
+  }
+
+  if (work->cleanup_cb) {
+    work->cleanup_cb(work->priv_arg);
+  }
+
+  free(work);
 }
 
 /**
@@ -95,12 +221,13 @@ static int worker_main(int argc, char **argv)
  *
  * @worker_id - the unique identifier for a worker
 *
- * Assumption: lock with g_lock_system_workers before calling this function
+ * Assumption: lock with g_lock_system_workers or disable the interrupts
+ * before calling this function
  */
 static worker_t *worker_get(int worker_id)
 {
   worker_t *worker = NULL;
-  list_for_each_entry(worker, &g_system_workers, worker_cb) {
+  list_for_each_entry(worker, &g_system_workers, node) {
 
     if (worker->workqueue_id == worker_id) {
       return worker;
@@ -110,6 +237,412 @@ static worker_t *worker_get(int worker_id)
   return NULL;
 }
 
+/**
+ * worker_find - get the worker from the worker id
+ *
+ * @worker_id - the unique identifier for a worker
+ *
+ * Returns the worker or NULL if there is no worker with this id.
+ */
+static worker_t *worker_find(int worker_id)
+{
+  sem_wait(&g_lock_system_workers);
+  worker_t *worker = worker_get(worker_id);
+  sem_post(&g_lock_system_workers);
+
+  return worker;
+}
+
+/**
+ * worker_take_inbox - detach the work submitted to a worker
+ *
+ * @worker: the worker
+ *
+ * Returns the chain of submitted work, the oldest first, or NULL.
+ */
+static worker_cb_t *worker_take_inbox(worker_t *worker)
+{
+  irq_state_t irq_state = cpu_disableint();
+
+  worker_cb_t *work = worker->inbox_head;
+
+  worker->inbox_head = NULL;
+  worker->inbox_tail = NULL;
+
+  cpu_enableint(irq_state);
+
+  return work;
+}
+
+/**
+ * worker_next_timeout_ms - the time until a deadline
+ *
+ * @wake_tick: the deadline
+ *
+ * Returns the milliseconds until the tick, rounded up, or 0 if it passed.
+ */
+static int worker_next_timeout_ms(uint32_t wake_tick)
+{
+#ifdef CONFIG_SCHEDULER_TICK
+  int32_t ticks = (int32_t)(wake_tick - sched_get_ticks());
+
+  if (ticks <= 0) {
+    return 0;
+  }
+
+  return (int)(((uint64_t)ticks * 1000 + SCHED_TICKS_PER_SEC - 1) /
+               SCHED_TICKS_PER_SEC);
+#else
+  /* Without the tick there are no deadlines, the work runs in order */
+
+  return 0;
+#endif
+}
+
+/**
+ * worker_drain_inbox - move the submitted work to the heap of a task
+ *
+ * @worker: the worker
+ * @self: the task that drains the inbox
+ *
+ * The work items get their sequence here so the ones submitted together
+ * keep their order. If the heap can't grow the work goes straight to the
+ * ready list, it runs early rather than never.
+ *
+ * Assumption: lock with g_lock_worker_list before calling this function
+ */
+static void worker_drain_inbox(worker_t *worker, worker_thread_t *self)
+{
+  worker_cb_t *work = worker_take_inbox(worker);
+
+  while (work != NULL) {
+    worker_cb_t *next = work->inbox_next;
+
+    work->inbox_next = NULL;
+    work->seq        = worker->next_seq++;
+
+    if (worker_heap_push(self, work) < 0) {
+      list_add_tail(&work->node, &self->ready[work->priority]);
+    }
+
+    work = next;
+  }
+}
+
+/**
+ * worker_move_due - move the due delayed work of a task to its ready lists
+ *
+ * @thread: the worker task
+ *
+ * Assumption: lock with g_lock_worker_list before calling this function
+ */
+static void worker_move_due(worker_thread_t *thread)
+{
+  while (thread->heap_count > 0 &&
+         worker_next_timeout_ms(thread->heap[0]->wake_tick) == 0) {
+    worker_cb_t *work = worker_heap_remove(thread, 0);
+
+    list_add_tail(&work->node, &thread->ready[work->priority]);
+  }
+}
+
+/**
+ * worker_ready_priority - the highest priority with ready work
+ *
+ * @thread: the worker task
+ *
+ * Returns the priority or -1 when the task has no ready work.
+ */
+static int worker_ready_priority(worker_thread_t *thread)
+{
+  for (int prio = WORKER_PRIORITY_HIGH; prio >= WORKER_PRIORITY_LOW; prio--) {
+    if (thread->ready[prio].next != &thread->ready[prio]) {
+      return prio;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * worker_take_ready - take the oldest ready work of a priority
+ *
+ * @thread: the worker task
+ * @prio: the priority
+ */
+static worker_cb_t *worker_take_ready(worker_thread_t *thread, int prio)
+{
+  worker_cb_t *work = container_of(thread->ready[prio].next, worker_cb_t,
+                                   node);
+
+  list_del(&work->node);
+  return work;
+}
+
+/**
+ * worker_next_work - pick the work that a task runs next
+ *
+ * @worker: the worker
+ * @self: the task that asks for work
+ *
+ * The task runs its own due work first. When it has none it steals the
+ * most urgent due work of the other tasks, the ones that are busy with a
+ * long job.
+ *
+ * Assumption: lock with g_lock_worker_list before calling this function
+ *
+ * Returns the work or NULL if nothing is due.
+ */
+static worker_cb_t *worker_next_work(worker_t *worker, worker_thread_t *self)
+{
+  worker_thread_t *victim = NULL;
+  int victim_prio = -1;
+
+  worker_drain_inbox(worker, self);
+  worker_move_due(self);
+
+  int prio = worker_ready_priority(self);
+  if (prio >= 0) {
+    return worker_take_ready(self, prio);
+  }
+
+  for (int i = 0; i < worker->num_threads; i++) {
+    worker_thread_t *thread = &worker->threads[i];
+
+    if (thread == self) {
+      continue;
+    }
+
+    worker_move_due(thread);
+
+    prio = worker_ready_priority(thread);
+    if (prio > victim_prio) {
+      victim      = thread;
+      victim_prio = prio;
+    }
+  }
+
+  if (victim == NULL) {
+    return NULL;
+  }
+
+  return worker_take_ready(victim, victim_prio);
+}
+
+/**
+ * worker_heap_window - shorten a slack window with the delayed work of a task
+ *
+ * @thread: the worker task
+ * @deadline: the end of the window
+ *
+ * Only the work due before the end of the window can shorten it. The heap
+ * is walked in pre-order and a subtree is skipped as soon as its root is
+ * due later, all of its work is due even later, so the cost follows the
+ * work that falls in the window and not the size of the heap.
+ *
+ * Assumption: lock with g_lock_worker_list before calling this function
+ *
+ * Returns the end of the window.
+ */
+static uint32_t worker_heap_window(worker_thread_t *thread, uint32_t deadline)
+{
+  int index = 0;
+
+  for (;;) {
+    if (index < thread->heap_count &&
+        (int32_t)(thread->heap[index]->wake_tick - deadline) <= 0) {
+      worker_cb_t *work = thread->heap[index];
+
+      if ((int32_t)(work->deadline_tick - deadline) < 0) {
+        deadline = work->deadline_tick;
+      }
+
+      if (2 * index + 1 < thread->heap_count) {
+        index = 2 * index + 1;
+        continue;
+      }
+    }
+
+    /* Go to the next sibling, climb up from the right children first */
+
+    while (index > 0 && (index & 1) == 0) {
+      index = (index - 1) / 2;
+    }
+
+    if (index == 0) {
+      break;
+    }
+
+    index++;
+  }
+
+  return deadline;
+}
+
+/**
+ * worker_next_deadline_ms - the time until the earliest delayed work
+ *
+ * @worker: the worker
+ * @slack_ms: how late the task may wake up
+ *
+ * An idle task may steal the delayed work of the other tasks so it waits
+ * for the earliest deadline of the whole pool. It may wake up as late as
+ * the end of the shortest slack window among the work due before that, so
+ * the scheduler can serve it with another wakeup.
+ *
+ * Assumption: lock with g_lock_worker_list before calling this function
+ *
+ * Returns the milliseconds or SEM_WAIT_FOREVER.
+ */
+static int worker_next_deadline_ms(worker_t *worker, uint32_t *slack_ms)
+{
+  worker_cb_t *first = NULL;
+
+  for (int i = 0; i < worker->num_threads; i++) {
+    worker_thread_t *thread = &worker->threads[i];
+
+    if (thread->heap_count > 0 &&
+        (first == NULL || worker_is_before(thread->heap[0], first))) {
+      first = thread->heap[0];
+    }
+  }
+
+  *slack_ms = 0;
+
+  if (first == NULL) {
+    return SEM_WAIT_FOREVER;
+  }
+
+  uint32_t deadline = first->deadline_tick;
+
+  for (int i = 0; i < worker->num_threads; i++) {
+    deadline = worker_heap_window(&worker->threads[i], deadline);
+  }
+
+  *slack_ms = (uint32_t)((uint64_t)(deadline - first->wake_tick) * 1000 /
+                         SCHED_TICKS_PER_SEC);
+
+  int timeout_ms = worker_next_timeout_ms(first->wake_tick);
+  return timeout_ms > 0 ? timeout_ms : 1;
+}
+
+/**
+ * worker_main - entry point for the worker thread
+ *
+ * @argc: 0
+ * @argv: the worker_thread_t of the task in the pool
+ *
+ * Run the due work items, the highest priority first, and sleep on the
+ * wakeup semaphore of the task until the earliest deadline or until new
+ * work arrives when there is nothing due.
+ *
+ * Returns 0 (OK) on successful completion otherwise a negative error code.
+ */
+static int worker_main(int argc, char **argv)
+{
+  worker_thread_t *self = (worker_thread_t *)argv;
+  worker_t *worker = self->worker;
+
+  self->task = sched_get_current_task();
+
+  for (;;) {
+    int timeout_ms = SEM_WAIT_FOREVER;
+    uint32_t slack_ms = 0;
+
+    sem_wait(&worker->g_lock_worker_list);
+
+    if (!worker->is_running_enabled) {
+      sem_post(&worker->g_lock_worker_list);
+      break;
+    }
+
+    worker_cb_t *work = worker_next_work(worker, self);
+    if (work == NULL) {
+      timeout_ms = worker_next_deadline_ms(worker, &slack_ms);
+
+      /* The task goes idle only if nothing was submitted since it drained
+       * the inbox, worker_submit wakes up the idle tasks.
+       */
+
+      irq_state_t irq_state = cpu_disableint();
+      self->is_idle = worker->inbox_head == NULL;
+      cpu_enableint(irq_state);
+    }
+
+    sem_post(&worker->g_lock_worker_list);
+
+    if (work == NULL) {
+      if (self->is_idle) {
+        sched_set_timer_slack(self->task, slack_ms);
+        sem_timedwait(&self->wakeup, timeout_ms);
+      }
+
+      continue;
+    }
+
+    /* A submitted work item is released before its callback runs so the
+     * callback can submit it again.
+     */
+
+    worker_cb callback = work->callback;
+    void *priv_arg     = work->priv_arg;
+    bool is_allocated  = (work->flags & WORKER_WORK_ALLOCATED) != 0;
+
+    if (!is_allocated) {
+      worker_release_work(work);
+    }
+
+    if (callback) {
+      callback(priv_arg);
+    }
+
+    if (is_allocated) {
+      worker_release_work(work);
+    }
+  }
+
+  sem_post(&worker->shutdown_notify);
+
+  return 0;
+}
+
+/**
+ * worker_remove_work - take a pending work item out by its uid
+ *
+ * @worker: the worker
+ * @job_uid: the uid returned by worker_enqueue
+ *
+ * Take the work out of the delayed heap or the ready list where it waits.
+ *
+ * Assumption: lock with g_lock_worker_list before calling this function
+ *
+ * Returns the work or NULL if it is not pending.
+ */
+static worker_cb_t *worker_remove_work(worker_t *worker, int job_uid)
+{
+  for (int i = 0; i < worker->num_threads; i++) {
+    worker_thread_t *thread = &worker->threads[i];
+    worker_cb_t *work;
+
+    for (int j = 0; j < thread->heap_count; j++) {
+      if (thread->heap[j]->work_uid == job_uid) {
+        return worker_heap_remove(thread, j);
+      }
+    }
+
+    for (int prio = WORKER_PRIORITY_LOW; prio < WORKER_PRIORITY_LEVELS; prio++) {
+      list_for_each_entry(work, &thread->ready[prio], node) {
+        if (work->work_uid == job_uid) {
+          list_del(&work->node);
+          return work;
+        }
+      }
+    }
+  }
+
+  return NULL;
+}
+
 /****************************************************************************
  * Public Methods
  ****************************************************************************/
@@ -120,7 +653,7 @@ static worker_t *worker_get(int worker_id)
 int worker_init(void)
 {
   g_uid_counter = 0;
-  return sem_init(&g_lock_system_workers, 0, 0);
+  return sem_init(&g_lock_system_workers, 0, 1);
 }
 
 /**
@@ -130,55 +663,122 @@ int worker_init(void)
  * @name: friendly name of the worker thread
  *
  * Create a new worker thread and return the handle to the worker thread on
- * success.
- *
- * Assumption: priority is ignored if the scheduler is FIFO without priority
- * scheduling.
+ * success. The priority is one of the scheduler levels, between
+ * SCHED_PRIORITY_IDLE and SCHED_PRIORITY_MAX.
  */
 int worker_create(int priority, const char *name)
 {
+  return worker_create_pool(priority, name, 1);
+}
+
+/**
+ * worker_create_pool - create a worker run by several tasks
+ *
+ * @priority: the priority of the tasks
+ * @name: friendly name of the worker tasks
+ * @num_threads: the number of tasks
+ *
+ * The tasks share the work of the worker: each one runs the work queued to
+ * it and steals the due work of the others when it has nothing to do, so a
+ * slow job does not hold back the rest. With CONFIG_SCHEDULER_SMP they are
+ * spread over the CPUs.
+ *
+ * Returns the handle of the worker otherwise a negative error code.
+ */
+int worker_create_pool(int priority, const char *name, int num_threads)
+{
+  if (num_threads <= 0) {
+    return -EINVAL;
+  }
+
   worker_t *new_worker = calloc(1, sizeof(worker_t));
   if (new_worker == NULL) {
     return -ENOMEM;
   }
 
-  sem_init(&new_worker->g_lock_worker_list, 0, 0);
+  new_worker->threads = calloc(num_threads, sizeof(worker_thread_t));
+  if (new_worker->threads == NULL) {
+    free(new_worker);
+    return -ENOMEM;
+  }
+
+  for (int i = 0; i < num_threads; i++) {
+    worker_thread_t *thread = &new_worker->threads[i];
+
+    thread->worker = new_worker;
+
+    for (int prio = WORKER_PRIORITY_LOW; prio < WORKER_PRIORITY_LEVELS; prio++) {
+      INIT_LIST_HEAD(&thread->ready[prio]);
+    }
+
+    sem_init(&thread->wakeup, 0, 0);
+  }
+
+  sem_init(&new_worker->g_lock_worker_list, 0, 1);
   sem_init(&new_worker->shutdown_notify, 0, 0);
 
+  new_worker->num_threads = num_threads;
   new_worker->is_running_enabled = true;
-  int ret = sched_create_task(worker_main,
-                              CONFIG_WORKER_STACK_SIZE,
-                              1,
-                              (char **)new_worker,
-                              "Worker");
-  if (ret != 0) {
-    ret = -EINVAL;
-    goto free_with_worker;
-  }
+  new_worker->worker_priority = priority;
+  new_worker->worker_name     = name;
 
-  sem_wait(&g_lock_system_workers);
+  /* The worker is registered before its tasks start to run */
 
-  new_worker->workqueue_id = g_uid_counter;
+  sem_wait(&g_lock_system_workers);
 
   if (g_uid_counter == INT_MAX) {
-    ret = -ENOSPC;
     sem_post(&g_lock_system_workers);
-    goto free_with_task;
+    free(new_worker->threads);
+    free(new_worker);
+    return -ENOSPC;
   }
 
-  g_uid_counter++;
-  list_add(&new_worker->worker_cb, &g_system_workers);
+  new_worker->workqueue_id = g_uid_counter++;
+
+  irq_state_t irq_state = cpu_disableint();
+  list_add(&new_worker->node, &g_system_workers);
+  cpu_enableint(irq_state);
 
   sem_post(&g_lock_system_workers);
 
+  /* Each task gets its own slot of the pool as an opaque argument */
+
+  for (int i = 0; i < num_threads; i++) {
+    int ret = sched_create_task(worker_main,
+                                CONFIG_WORKER_STACK_SIZE,
+                                0,
+                                (char **)&new_worker->threads[i],
+                                name != NULL ? name : "Worker",
+                                priority);
+    if (ret != 0) {
+      /* Stop the tasks that already started */
+
+      new_worker->num_threads = i;
+      worker_destroy(new_worker->workqueue_id);
+      return ret;
+    }
+  }
+
   return new_worker->workqueue_id;
+}
 
-free_with_task:
-  new_worker->is_running_enabled = false;
+/**
+ * worker_work_init - prepare a work item owned by the caller
+ *
+ * @work: the work structure
+ * @callback: the function that runs the work
+ * @arg: the argument passed to the callback
+ *
+ * Clear the structure, so it is not taken for a queued one by
+ * worker_submit, and set the callback. The work runs right away with
+ * WORKER_PRIORITY_LOW unless the caller changes the other fields.
+ */
+void worker_work_init(worker_cb_t *work, worker_cb callback, void *arg)
+{
+  memset(work, 0, sizeof(worker_cb_t));
 
-free_with_worker:
-  free(new_worker);
-  return ret;
+  work->callback = callback;
+  work->priv_arg = arg;
 }
 
 /**
@@ -187,26 +787,29 @@ free_with_worker:
  * @worker_id: the id of the worker threadd
  * @work: the work structure
  *
- * Create a new worker thread and return the handle to the worker thread on
- * success.
+ * The worker keeps a copy of the work structure and runs the callback
+ * wake_ms milliseconds from now. The due work runs by priority and the
+ * work items with the same priority and deadline run in the enqueue order.
+ * The work goes to an idle task of the pool if there is one, otherwise the
+ * tasks take it in turn.
  *
- * Assumption: priority is ignored if the scheduler is FIFO without priority
- * scheduling.
+ * Returns the uid of the work, used by worker_cancel_work, otherwise a
+ * negative error code.
  */
 int worker_enqueue(int worker_id, worker_cb_t *work)
 {
-  sem_wait(&g_lock_system_workers);
+  if (work == NULL || work->priority < WORKER_PRIORITY_LOW ||
+      work->priority > WORKER_PRIORITY_HIGH) {
+    return -EINVAL;
+  }
 
   /* Get the system worker from the worker_id */
 
-  worker_t *worker = worker_get(worker_id);
+  worker_t *worker = worker_find(worker_id);
   if (worker == NULL) {
-    sem_post(&g_lock_system_workers);
     return -EINVAL;
   }
 
-  sem_post(&g_lock_system_workers);
-
   /* Create a copy of the object */
 
   worker_cb_t *work_copy = calloc(1, sizeof(worker_cb_t));
@@ -216,134 +819,257 @@ int worker_enqueue(int worker_id, worker_cb_t *work)
 
   memcpy(work_copy, work, sizeof(worker_cb_t));
 
-  /* Find a place where to insert the work item */
+  work_copy->inbox_next = NULL;
+  work_copy->flags      = WORKER_WORK_QUEUED | WORKER_WORK_ALLOCATED;
 
-  sem_wait(&worker->g_lock_worker_list);
+  work_copy->wake_tick     = sched_get_ticks() +
+                             SCHED_MS_TO_TICKS(work->wake_ms);
+  work_copy->deadline_tick = work_copy->wake_tick +
+                             SCHED_MS_TO_TICKS_FLOOR(work->slack_ms);
 
-  struct list_head *pos, *temp;
-  list_for_each_safe(pos, temp, &worker->worker_cb) {
-    worker_cb_t *current_work = container_of(pos, worker_cb_t, work_list);
+  sem_wait(&worker->g_lock_worker_list);
 
-    /* Work that need to be done first is placed at the beggining of the list
-     */
+  /* Prefer an idle task, it is marked busy so the next enqueue picks
+   * another one.
+   */
 
-    if (current_work->wake_ms > work_copy->wake_ms) {
-      list_del(pos);
-      list_add(&work_copy->work_list, &worker->worker_cb);
-      list_add(pos, &worker->worker_cb);
+  worker_thread_t *target = &worker->threads[worker->next_thread];
 
-      sem_post(&worker->g_lock_worker_list);
-      return 0;
+  for (int i = 0; i < worker->num_threads; i++) {
+    worker_thread_t *thread = &worker->threads[(worker->next_thread + i) %
+                                               worker->num_threads];
+    if (thread->is_idle) {
+      target = thread;
+      break;
     }
   }
 
-  list_add(&work_copy->work_list, &worker->worker_cb);
+  worker->next_thread = (target - worker->threads + 1) % worker->num_threads;
+
+  work_copy->work_uid = worker->next_work_uid;
+  work_copy->seq      = worker->next_seq++;
+  worker->next_work_uid = (worker->next_work_uid + 1) & INT_MAX;
+
+  int ret = worker_heap_push(target, work_copy);
+  bool is_wakeup = ret == 0 &&
+    (target->is_idle || target->heap[0] == work_copy);
+
+  target->is_idle = false;
+
   sem_post(&worker->g_lock_worker_list);
 
-  return 0;
+  if (ret < 0) {
+    free(work_copy);
+    return ret;
+  }
+
+  if (is_wakeup) {
+    sem_post(&target->wakeup);
+  }
+
+  return work_copy->work_uid;
 }
 
 /**
- * worker_cancel_work - cancel work that was enqueued on a worker threadr
+ * worker_submit - queue a work item owned by the caller
  *
- * @worker_id: the id of the worker threadd
- * @job_uid: the job that we wish to cancele
+ * @worker_id: the id of the worker
+ * @work: the work structure from worker_work_init, it stays valid until
+ *        the callback starts
  *
- * Cancels a job that was enqueued on a worker thread. This function does not
- * guarantee that the cancellation will occur because a work item can be 
- * scheduled to run by the time we call this function.
+ * The allocation free variant of worker_enqueue, it can be called from the
+ * interrupt handlers. The work item is linked in the inbox of the worker
+ * and an idle task takes it, so the callback runs wake_ms milliseconds
+ * from now with the same priority rules. WORKER_WORK_QUEUED stays set in
+ * the flags until the callback starts or the worker is destroyed, the
+ * work item can be submitted again from its own callback.
  *
- * Returns 0(OK) in case the job was cancelled otherwise -EINVAL.
+ * Returns 0 (OK), -EINVAL if there is no such worker or -EBUSY when the
+ * work item is already queued.
  */
-int worker_cancel_work(int worker_id, int job_uid)
+int worker_submit(int worker_id, worker_cb_t *work)
 {
-  sem_wait(&g_lock_system_workers);
+  worker_thread_t *target = NULL;
 
-  /* Get the system worker from the worker_id */
+  if (work == NULL || work->priority < WORKER_PRIORITY_LOW ||
+      work->priority > WORKER_PRIORITY_HIGH) {
+    return -EINVAL;
+  }
+
+  /* The lists are only linked with the interrupts disabled, the semaphores
+   * can't be taken from an interrupt handler.
+   */
+
+  irq_state_t irq_state = cpu_disableint();
 
   worker_t *worker = worker_get(worker_id);
   if (worker == NULL) {
-    sem_post(&g_lock_system_workers);
+    cpu_enableint(irq_state);
     return -EINVAL;
   }
 
-  sem_post(&g_lock_system_workers);
-
-  sem_wait(&worker->g_lock_worker_list);
+  if (work->flags & WORKER_WORK_QUEUED) {
+    cpu_enableint(irq_state);
+    return -EBUSY;
+  }
 
-  struct list_head *pos, *temp;
-  list_for_each_safe(pos, temp, &worker->worker_cb) {
-    worker_cb_t *current_work = container_of(pos, worker_cb_t, work_list);
+  work->flags      = WORKER_WORK_QUEUED;
+  work->work_uid   = -1;
+  work->wake_tick  = sched_get_ticks() + SCHED_MS_TO_TICKS(work->wake_ms);
+  work->inbox_next = NULL;
 
-    /* If we found the job unique identifier call the clean up callback
-     * remove the work item from the list and free the work item.
-     */
+  work->deadline_tick = work->wake_tick +
+                        SCHED_MS_TO_TICKS_FLOOR(work->slack_ms);
 
-    if (current_work->work_uid == job_uid) {
-      list_del(pos);
-      if (current_work->cleanup_cb) {
-        current_work->cleanup_cb(current_work->priv_arg);
-      }
+  if (worker->inbox_tail != NULL) {
+    worker->inbox_tail->inbox_next = work;
+  } else {
+    worker->inbox_head = work;
+  }
 
-      free(current_work);
+  worker->inbox_tail = work;
 
-      sem_post(&worker->g_lock_worker_list);
-      return 0;
+  for (int i = 0; i < worker->num_threads; i++) {
+    if (worker->threads[i].is_idle) {
+      target          = &worker->threads[i];
+      target->is_idle = false;
+      break;
     }
   }
 
-  sem_post(&worker->g_lock_worker_list);
+  cpu_enableint(irq_state);
+
+  /* A busy task drains the inbox before it looks for the next work */
 
-  return -EINVAL;
+  if (target != NULL) {
+    sem_post(&target->wakeup);
+  }
+
+  return 0;
 }
 
 /**
- * worker_destroy - destroy a worker with all the associated resources
+ * worker_cancel_work - cancel work that was enqueued on a worker threadr
  *
  * @worker_id: the id of the worker threadd
+ * @job_uid: the job that we wish to cancele
  *
  * Cancels a job that was enqueued on a worker thread. This function does not
  * guarantee that the cancellation will occur because a work item can be 
  * scheduled to run by the time we call this function.
  *
+ * Returns 0(OK) in case the job was cancelled otherwise -EINVAL.
  */
-int worker_destroy(int worker_id)
+int worker_cancel_work(int worker_id, int job_uid)
 {
-  sem_wait(&g_lock_system_workers);
+  worker_t *worker = worker_find(worker_id);
+  if (worker == NULL || job_uid < 0) {
+    return -EINVAL;
+  }
 
-  /* Get the system worker from the worker_id */
+  sem_wait(&worker->g_lock_worker_list);
+  worker_cb_t *work = worker_remove_work(worker, job_uid);
+  sem_post(&worker->g_lock_worker_list);
 
-  worker_t *worker = worker_get(worker_id);
+  if (work == NULL) {
+    return -EINVAL;
+  }
+
+  /* A later deadline only makes the worker wake up for nothing once */
+
+  worker_release_work(work);
+  return 0;
+}
+
+/**
+ * worker_destroy - destroy a worker with all the associated resources
+ *
+ * @worker_id: the id of the worker threadd
+ *
+ * Stop the worker tasks once the work items that run now return and free
+ * the pending work items with their cleanup callback.
+ *
+ * Returns 0 (OK), -EINVAL if there is no such worker or -EBUSY when it is
+ * called from a work item of the same worker.
+ */
+int worker_destroy(int worker_id)
+{
+  worker_t *worker = worker_find(worker_id);
   if (worker == NULL) {
-    sem_post(&g_lock_system_workers);
     return -EINVAL;
   }
 
-  sem_post(&g_lock_system_workers);
+  struct tcb_s *current = sched_get_current_task();
+
+  for (int i = 0; i < worker->num_threads; i++) {
+    if (worker->threads[i].task == current) {
+      return -EBUSY;
+    }
+  }
 
-  /* Shutdown the worker task */
+  /* Shutdown the worker tasks */
+
+  sem_wait(&worker->g_lock_worker_list);
+
+  if (!worker->is_running_enabled) {
+    sem_post(&worker->g_lock_worker_list);
+    return -EINVAL;
+  }
 
   worker->is_running_enabled = false;
-  sem_wait(&worker->shutdown_notify);
 
-  /* Free the resources - CAUTIO
+  sem_post(&worker->g_lock_worker_list);
+
+  for (int i = 0; i < worker->num_threads; i++) {
+    sem_post(&worker->threads[i].wakeup);
+  }
+
+  for (int i = 0; i < worker->num_threads; i++) {
+    sem_wait(&worker->shutdown_notify);
+  }
+
+  sem_wait(&g_lock_system_workers);
+
+  irq_state_t irq_state = cpu_disableint();
+  list_del(&worker->node);
+  cpu_enableint(irq_state);
+
+  sem_post(&g_lock_system_workers);
+
+  /* Free the resources - CAUTION
    *
    * If there are work items that have arguments allocated on the heap
    * freeing the work item may cause leaking the arguments if no cleanup
-   * callback was assigned to the work item.
+   * callback was assigned to the work item. The submitted work items go
+   * back to their owners.
    */
 
-  struct list_head *pos, *temp;
-  list_for_each_safe(pos, temp, &worker->worker_cb) {
-    worker_cb_t *current_work = container_of(pos, worker_cb_t, work_list);
-    list_del(pos);
+  for (worker_cb_t *work = worker_take_inbox(worker); work != NULL;) {
+    worker_cb_t *next = work->inbox_next;
 
-    if (current_work->cleanup_cb) {
-      current_work->cleanup_cb(current_work->priv_arg);
+    work->inbox_next = NULL;
+    worker_release_work(work);
+    work = next;
+  }
+
+  for (int i = 0; i < worker->num_threads; i++) {
+    worker_thread_t *thread = &worker->threads[i];
+
+    while (thread->heap_count > 0) {
+      worker_release_work(worker_heap_remove(thread, thread->heap_count - 1));
+    }
+
+    for (int prio = WORKER_PRIORITY_LOW; prio < WORKER_PRIORITY_LEVELS; prio++) {
+      while (thread->ready[prio].next != &thread->ready[prio]) {
+        worker_release_work(worker_take_ready(thread, prio));
+      }
     }
 
-    free(current_work);
+    free(thread->heap);
   }
 
+  free(worker->threads);
+  free(worker);
+
   return 0;
 }